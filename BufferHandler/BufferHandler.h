@@ -30,11 +30,54 @@ of the authors and should not be interpreted as representing official policies,
 either expressed or implied, of the FreeBSD Project.
 */
 #include <cstring>
+#include <string>
 #include <stdexcept>
 #include <cassert>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
 #include <boost/smart_ptr.hpp>
 #include <boost/cstdint.hpp>
 #include <boost/static_assert.hpp>
+#include "Instrumentation.h"
+#if defined(__SSSE3__) || defined(__AVX2__) || defined(__AVX512BW__)
+#include <immintrin.h>
+#endif
+
+//the BMI2 backend (PEXT/PDEP) is available on x86-64 unless disabled with BUFFERHANDLER_NO_BMI2. It is only used if
+//the CPU supports it at runtime, and for single field handlers only if BUFFERHANDLER_GENERIC_BMI2 is defined.
+#if !defined(BUFFERHANDLER_NO_BMI2) && (defined(__x86_64__) || defined(_M_X64))
+#define BUFFERHANDLER_BMI2_BACKEND
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define BUFFERHANDLER_TARGET_BMI2
+#else
+#define BUFFERHANDLER_TARGET_BMI2 __attribute__((target("bmi2")))
+#endif
+#endif
+
+//the AVX2 kernels are compiled on x86-64 unless disabled with BUFFERHANDLER_NO_AVX2, independent of the compiler flags.
+//They are only used if the CPU supports AVX2 at runtime.
+#if !defined(BUFFERHANDLER_NO_AVX2) && (defined(__x86_64__) || defined(_M_X64))
+#define BUFFERHANDLER_AVX2_BACKEND
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define BUFFERHANDLER_TARGET_AVX2
+#else
+#define BUFFERHANDLER_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+//bounds checking of the handlers against the bufferSize / recordSize passed by the caller, see BoundsCheckNone,
+//BoundsCheckPerCall and BoundsCheckPerBatch. Define BUFFERHANDLER_BOUNDS_CHECK to one of the values to select it.
+#define BUFFERHANDLER_UNCHECKED 0
+#define BUFFERHANDLER_CHECK_PER_CALL 1
+#define BUFFERHANDLER_CHECK_PER_BATCH 2
+#if !defined(BUFFERHANDLER_BOUNDS_CHECK)
+#define BUFFERHANDLER_BOUNDS_CHECK BUFFERHANDLER_CHECK_PER_BATCH
+#endif
 
 
 namespace BufferHandler
@@ -54,7 +97,7 @@ enum DataType
 };
 
 /**
-Swaps the 2 bytes of a 16bit value. Uses the built-in intrinsic of Visual Studio if available.
+Swaps the 2 bytes of a 16bit value. Uses the built-in intrinsic of Visual Studio or GCC/Clang if available.
 Example: 0x0102 --> 0x0201
 @param src value to be swapped
 @return swapped value
@@ -63,13 +106,15 @@ inline boost::uint16_t Swap16(boost::uint16_t src)
 {
 #if (_MSC_VER >= 1400)
 	return _byteswap_ushort(src);
+#elif defined(__GNUC__)
+	return __builtin_bswap16(src);
 #else
 	return src << 8 | src >> 8;
 #endif
 }
 
 /**
-Swaps the 4 bytes of a 32bit value. Uses the built-in intrinsic of Visual Studio if available.
+Swaps the 4 bytes of a 32bit value. Uses the built-in intrinsic of Visual Studio or GCC/Clang if available.
 Example: 0x01020304 --> 0x04030201
 @param src value to be swapped
 @return swapped value
@@ -78,6 +123,8 @@ inline boost::uint32_t Swap32(boost::uint32_t src)
 {
 #if (_MSC_VER >= 1400)
 	return _byteswap_ulong(src);
+#elif defined(__GNUC__)
+	return __builtin_bswap32(src);
 #else
 	boost::uint32_t result = src << 16 | src >> 16;
 	boost::uint32_t mask = 0xFF00FF00;
@@ -87,7 +134,7 @@ inline boost::uint32_t Swap32(boost::uint32_t src)
 }
 
 /**
-Swaps the 8 bytes of a 64bit value. Uses the built-in intrinsic of Visual Studio if available.
+Swaps the 8 bytes of a 64bit value. Uses the built-in intrinsic of Visual Studio or GCC/Clang if available.
 Example: 0x01020304050607 --> 0x00706054030201
 @param src value to be swapped
 @return swapped value
@@ -96,6 +143,8 @@ inline boost::uint64_t Swap64(boost::uint64_t src)
 {
 #if (_MSC_VER >= 1400)
 	return _byteswap_uint64(src);
+#elif defined(__GNUC__)
+	return __builtin_bswap64(src);
 #else
 	boost::uint64_t result = src << 32 | src >> 32;
 	boost::uint64_t mask = 0xFFFF0000FFFF0000;
@@ -106,6 +155,297 @@ inline boost::uint64_t Swap64(boost::uint64_t src)
 #endif
 }
 
+namespace Implementation
+{
+
+/**
+Takes over the bit pattern of value (the first sizeof(To) bytes). Unlike a reinterpret_cast of the pointer this
+doesn't violate the strict aliasing rules, the compilers reduce the memcpy to a register move.
+*/
+template<typename To, typename From>
+inline To BitCast(const From& value)
+{
+	static_assert(sizeof(To) <= sizeof(From), "BitCast would read beyond the source");
+	To result;
+	memcpy(&result, &value, sizeof(To));
+	return result;
+}
+
+/**
+Checks once whether the CPU supports the BMI2 instructions (PEXT/PDEP).
+@return true if the BMI2 backend can be used
+*/
+inline bool CpuSupportsBmi2()
+{
+#if defined(BUFFERHANDLER_BMI2_BACKEND)
+#if defined(_MSC_VER)
+	static const bool supported = []() -> bool
+	{
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+		{
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 8)) != 0;
+	}();
+#else
+	static const bool supported = __builtin_cpu_supports("bmi2") != 0;
+#endif
+	return supported;
+#else
+	return false;
+#endif
+}
+
+/**
+Checks once whether the CPU and the operating system support the AVX2 instructions.
+@return true if the AVX2 kernels can be used
+*/
+inline bool CpuSupportsAvx2()
+{
+#if defined(BUFFERHANDLER_AVX2_BACKEND)
+#if defined(_MSC_VER)
+	static const bool supported = []() -> bool
+	{
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+		{
+			return false;
+		}
+		__cpuid(info, 1);
+		const int osxsaveAndAvx = (1 << 27) | (1 << 28);
+		if ((info[2] & osxsaveAndAvx) != osxsaveAndAvx || (_xgetbv(0) & 6) != 6)
+		{
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+	}();
+#else
+	static const bool supported = __builtin_cpu_supports("avx2") != 0;
+#endif
+	return supported;
+#else
+	return false;
+#endif
+}
+
+#if defined(BUFFERHANDLER_AVX2_BACKEND)
+/**
+Byte swaps every elementSize bytes of src into dst with the AVX2 byte shuffle, see \ref SwapBytesSimd. Requires
+\ref CpuSupportsAvx2.
+@return number of bytes that were swapped
+*/
+BUFFERHANDLER_TARGET_AVX2 inline size_t SwapBytesAvx2(const unsigned char* src, unsigned char* dst, size_t size, unsigned int elementSize)
+{
+	size_t done = 0;
+	char pattern[16];
+	for (unsigned int i=0; i<16; ++i)
+	{
+		pattern[i] = static_cast<char>((i/elementSize)*elementSize + elementSize-1 - i%elementSize);
+	}
+	const __m128i shuffle128 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern));
+	const __m256i shuffle256 = _mm256_broadcastsi128_si256(shuffle128);
+	for (; done+32<=size; done+=32)
+	{
+		__m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src+done));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst+done), _mm256_shuffle_epi8(value, shuffle256));
+	}
+	for (; done+16<=size; done+=16)
+	{
+		__m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src+done));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst+done), _mm_shuffle_epi8(value, shuffle128));
+	}
+	return done;
+}
+#endif
+
+/**
+Byte swaps every elementSize bytes of src into dst using the widest byte shuffle the compiler targets (SSSE3, AVX2
+or AVX-512BW). If the compiler targets none of them, the AVX2 shuffle is used if the CPU supports it. Only whole
+vectors are processed, the remaining bytes are left to the caller.
+@param src source bytes
+@param dst destination bytes, may be equal to src
+@param size number of bytes in src
+@param elementSize size of one element (2, 4 or 8)
+@return number of bytes that were swapped
+*/
+inline size_t SwapBytesSimd(const unsigned char* src, unsigned char* dst, size_t size, unsigned int elementSize)
+{
+	size_t done = 0;
+#if defined(__SSSE3__) || defined(__AVX2__) || defined(__AVX512BW__)
+	//shuffle pattern that reverses the bytes inside of each element of a 16 byte lane
+	char pattern[16];
+	for (unsigned int i=0; i<16; ++i)
+	{
+		pattern[i] = static_cast<char>((i/elementSize)*elementSize + elementSize-1 - i%elementSize);
+	}
+	const __m128i shuffle128 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern));
+#if defined(__AVX512BW__)
+	const __m512i shuffle512 = _mm512_broadcast_i32x4(shuffle128);
+	for (; done+64<=size; done+=64)
+	{
+		__m512i value = _mm512_loadu_si512(reinterpret_cast<const void*>(src+done));
+		_mm512_storeu_si512(reinterpret_cast<void*>(dst+done), _mm512_shuffle_epi8(value, shuffle512));
+	}
+#endif
+#if defined(__AVX2__)
+	const __m256i shuffle256 = _mm256_broadcastsi128_si256(shuffle128);
+	for (; done+32<=size; done+=32)
+	{
+		__m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src+done));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst+done), _mm256_shuffle_epi8(value, shuffle256));
+	}
+#endif
+	for (; done+16<=size; done+=16)
+	{
+		__m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src+done));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst+done), _mm_shuffle_epi8(value, shuffle128));
+	}
+#elif defined(BUFFERHANDLER_AVX2_BACKEND)
+	if (CpuSupportsAvx2())
+	{
+		done = SwapBytesAvx2(src, dst, size, elementSize);
+	}
+#else
+	(void)src;
+	(void)dst;
+	(void)size;
+	(void)elementSize;
+#endif
+	return done;
+}
+
+#if defined(BUFFERHANDLER_BMI2_BACKEND)
+/**
+Gathers the bits of value selected by mask into the lowest bits (PEXT). Requires \ref CpuSupportsBmi2.
+*/
+BUFFERHANDLER_TARGET_BMI2 inline boost::uint32_t Pext(boost::uint32_t value, boost::uint32_t mask) { return _pext_u32(value, mask); }
+BUFFERHANDLER_TARGET_BMI2 inline boost::uint64_t Pext(boost::uint64_t value, boost::uint64_t mask) { return _pext_u64(value, mask); }
+/**
+Scatters the lowest bits of value to the positions selected by mask (PDEP). Requires \ref CpuSupportsBmi2.
+*/
+BUFFERHANDLER_TARGET_BMI2 inline boost::uint32_t Pdep(boost::uint32_t value, boost::uint32_t mask) { return _pdep_u32(value, mask); }
+BUFFERHANDLER_TARGET_BMI2 inline boost::uint64_t Pdep(boost::uint64_t value, boost::uint64_t mask) { return _pdep_u64(value, mask); }
+#endif
+
+}
+
+/**
+Swaps the 2 bytes of each of count 16bit values. Uses SIMD byte shuffles if the compiler targets SSSE3 or better
+or the CPU supports AVX2.
+@param src values to be swapped
+@param dst destination for the swapped values, may be equal to src (in place) but must not overlap otherwise
+@param count number of values
+*/
+inline void SwapArray16(const boost::uint16_t* src, boost::uint16_t* dst, size_t count)
+{
+	size_t i = Implementation::SwapBytesSimd(reinterpret_cast<const unsigned char*>(src), reinterpret_cast<unsigned char*>(dst), count*sizeof(boost::uint16_t), sizeof(boost::uint16_t)) / sizeof(boost::uint16_t);
+	for (; i<count; ++i)
+	{
+		dst[i] = Swap16(src[i]);
+	}
+}
+
+/**
+Swaps the 4 bytes of each of count 32bit values. Uses SIMD byte shuffles if the compiler targets SSSE3 or better
+or the CPU supports AVX2.
+@param src values to be swapped
+@param dst destination for the swapped values, may be equal to src (in place) but must not overlap otherwise
+@param count number of values
+*/
+inline void SwapArray32(const boost::uint32_t* src, boost::uint32_t* dst, size_t count)
+{
+	size_t i = Implementation::SwapBytesSimd(reinterpret_cast<const unsigned char*>(src), reinterpret_cast<unsigned char*>(dst), count*sizeof(boost::uint32_t), sizeof(boost::uint32_t)) / sizeof(boost::uint32_t);
+	for (; i<count; ++i)
+	{
+		dst[i] = Swap32(src[i]);
+	}
+}
+
+/**
+Swaps the 8 bytes of each of count 64bit values. Uses SIMD byte shuffles if the compiler targets SSSE3 or better
+or the CPU supports AVX2.
+@param src values to be swapped
+@param dst destination for the swapped values, may be equal to src (in place) but must not overlap otherwise
+@param count number of values
+*/
+inline void SwapArray64(const boost::uint64_t* src, boost::uint64_t* dst, size_t count)
+{
+	size_t i = Implementation::SwapBytesSimd(reinterpret_cast<const unsigned char*>(src), reinterpret_cast<unsigned char*>(dst), count*sizeof(boost::uint64_t), sizeof(boost::uint64_t)) / sizeof(boost::uint64_t);
+	for (; i<count; ++i)
+	{
+		dst[i] = Swap64(src[i]);
+	}
+}
+
+/**
+Swaps the bytes of count 16bit values in place. See \ref SwapArray16(const boost::uint16_t*, boost::uint16_t*, size_t).
+*/
+inline void SwapArray16(boost::uint16_t* values, size_t count) { SwapArray16(values, values, count); }
+
+/**
+Swaps the bytes of count 32bit values in place. See \ref SwapArray32(const boost::uint32_t*, boost::uint32_t*, size_t).
+*/
+inline void SwapArray32(boost::uint32_t* values, size_t count) { SwapArray32(values, values, count); }
+
+/**
+Swaps the bytes of count 64bit values in place. See \ref SwapArray64(const boost::uint64_t*, boost::uint64_t*, size_t).
+*/
+inline void SwapArray64(boost::uint64_t* values, size_t count) { SwapArray64(values, values, count); }
+
+/**
+Aggregates of a field over many records, see \ref DataHandler::Aggregate.
+*/
+struct FieldAggregate
+{
+	size_t count; //number of values
+	size_t nonZero; //number of values that are not 0
+	double min;
+	double max;
+	double sum;
+
+	FieldAggregate()
+		: count(0)
+		, nonZero(0)
+		, min(std::numeric_limits<double>::infinity())
+		, max(-std::numeric_limits<double>::infinity())
+		, sum(0)
+	{}
+
+	/**
+	@return average of the values, NaN if there are none
+	*/
+	double Mean() const { return count > 0 ? sum / count : std::numeric_limits<double>::quiet_NaN(); }
+
+	/**
+	Adds a single value.
+	*/
+	void Add(double value)
+	{
+		++count;
+		nonZero += value != 0;
+		min = value < min ? value : min;
+		max = value > max ? value : max;
+		sum += value;
+	}
+
+	/**
+	Adds the values of another aggregate, e.g. of a different range of records.
+	*/
+	void Merge(const FieldAggregate& other)
+	{
+		count += other.count;
+		nonZero += other.nonZero;
+		min = other.min < min ? other.min : min;
+		max = other.max > max ? other.max : max;
+		sum += other.sum;
+	}
+};
+
 /**
 Interface class to read & write from a buffer at a specific location. The specific location is defined at creation
 time, the buffer can be changed for each read/write. The specification consists of data type, position and size of
@@ -122,49 +462,49 @@ public:
 	@param buffer buffer to be written to.
 	@param bufferSize size of the buffer to be written to.
 	*/
-	virtual void WriteUI64(boost::uint64_t value, unsigned char* buffer, size_t bufferSize) const = 0 { throw std::logic_error("not implemented"); }
+	virtual void WriteUI64(boost::uint64_t value, unsigned char* buffer, size_t bufferSize) const = 0;
 	/**
 	Writes a 64bit integer to the slot specified at creation using \ref CreateBufferHandler.
 	@param value value to be written.
 	@param buffer buffer to be written to.
 	@param bufferSize size of the buffer to be written to.
 	*/
-	virtual void WriteI64(boost::int64_t value, unsigned char* buffer, size_t bufferSize) const = 0 { throw std::logic_error("not implemented"); }
+	virtual void WriteI64(boost::int64_t value, unsigned char* buffer, size_t bufferSize) const = 0;
 	/**
 	Writes a 32bit unsigned integer to the slot specified at creation using \ref CreateBufferHandler.
 	@param value value to be written.
 	@param buffer buffer to be written to.
 	@param bufferSize size of the buffer to be written to.
 	*/
-	virtual void WriteUI32(boost::uint32_t , unsigned char* buffer, size_t bufferSize) const = 0 { throw std::logic_error("not implemented"); }
+	virtual void WriteUI32(boost::uint32_t , unsigned char* buffer, size_t bufferSize) const = 0;
 	/**
 	Writes a 32bit integer to the slot specified at creation using \ref CreateBufferHandler.
 	@param value value to be written.
 	@param buffer buffer to be written to.
 	@param bufferSize size of the buffer to be written to.
 	*/
-	virtual void WriteI32(boost::int32_t , unsigned char* buffer, size_t bufferSize) const = 0 { throw std::logic_error("not implemented"); }
+	virtual void WriteI32(boost::int32_t , unsigned char* buffer, size_t bufferSize) const = 0;
 	/**
 	Writes a 32bit float to the slot specified at creation using \ref CreateBufferHandler.
 	@param value value to be written.
 	@param buffer buffer to be written to.
 	@param bufferSize size of the buffer to be written to.
 	*/
-	virtual void WriteF(float , unsigned char* buffer, size_t bufferSize) const = 0 { throw std::logic_error("not implemented"); }
+	virtual void WriteF(float , unsigned char* buffer, size_t bufferSize) const = 0;
 	/**
 	Writes a 64bit double to the slot specified at creation using \ref CreateBufferHandler.
 	@param value value to be written.
 	@param buffer buffer to be written to.
 	@param bufferSize size of the buffer to be written to.
 	*/
-	virtual void WriteD(double , unsigned char* buffer, size_t bufferSize) const = 0 { throw std::logic_error("not implemented"); }
+	virtual void WriteD(double , unsigned char* buffer, size_t bufferSize) const = 0;
 	/**
 	Writes a 1bit boolean to the slot specified at creation using \ref CreateBufferHandler.
 	@param value value to be written.
 	@param buffer buffer to be written to.
 	@param bufferSize size of the buffer to be written to.
 	*/
-	virtual void WriteB(bool , unsigned char* buffer, size_t bufferSize) const = 0 { throw std::logic_error("not implemented"); }
+	virtual void WriteB(bool , unsigned char* buffer, size_t bufferSize) const = 0;
 	
 
 	/**
@@ -174,7 +514,7 @@ public:
 	@param bufferSize size of the buffer
 	@return converted value from the buffer
 	*/
-	virtual boost::uint64_t ReadUI64(const unsigned char* buffer, size_t bufferSize) const = 0 { throw std::logic_error("not implemented"); }
+	virtual boost::uint64_t ReadUI64(const unsigned char* buffer, size_t bufferSize) const = 0;
 	/**
 	Reads the value at the slot specified during creation using \ref CreateBufferHandler and converts it to a 64bit 
 	integer.
@@ -182,7 +522,7 @@ public:
 	@param bufferSize size of the buffer
 	@return converted value from the buffer
 	*/
-	virtual boost::int64_t ReadI64(const unsigned char* buffer, size_t bufferSize) const = 0 { throw std::logic_error("not implemented"); }
+	virtual boost::int64_t ReadI64(const unsigned char* buffer, size_t bufferSize) const = 0;
 	/**
 	Reads the value at the slot specified during creation using \ref CreateBufferHandler and converts it to a 32bit unsigned
 	integer.
@@ -190,7 +530,7 @@ public:
 	@param bufferSize size of the buffer
 	@return converted value from the buffer
 	*/
-	virtual boost::uint32_t ReadUI32(const unsigned char* buffer, size_t bufferSize) const = 0 { throw std::logic_error("not implemented"); }
+	virtual boost::uint32_t ReadUI32(const unsigned char* buffer, size_t bufferSize) const = 0;
 	/**
 	Reads the value at the slot specified during creation using \ref CreateBufferHandler and converts it to a 32bit 
 	integer.
@@ -198,30 +538,148 @@ public:
 	@param bufferSize size of the buffer
 	@return converted value from the buffer
 	*/
-	virtual boost::int32_t ReadI32(const unsigned char* buffer, size_t bufferSize) const = 0 { throw std::logic_error("not implemented"); }
+	virtual boost::int32_t ReadI32(const unsigned char* buffer, size_t bufferSize) const = 0;
 	/**
 	Reads the value at the slot specified during creation using \ref CreateBufferHandler and converts it to a 32bit float
 	@param buffer buffer to be read from
 	@param bufferSize size of the buffer
 	@return converted value from the buffer
 	*/
-	virtual float ReadF(const unsigned char* buffer, size_t bufferSize) const = 0 { throw std::logic_error("not implemented"); }
+	virtual float ReadF(const unsigned char* buffer, size_t bufferSize) const = 0;
 	/**
 	Reads the value at the slot specified during creation using \ref CreateBufferHandler and converts it to a 64bit double
 	@param buffer buffer to be read from
 	@param bufferSize size of the buffer
 	@return converted value from the buffer
 	*/
-	virtual double ReadD(const unsigned char* buffer, size_t bufferSize) const = 0 { throw std::logic_error("not implemented"); }
+	virtual double ReadD(const unsigned char* buffer, size_t bufferSize) const = 0;
 	/**
 	Reads the value at the slot specified during creation using \ref CreateBufferHandler and converts it to a 1bit bool
 	@param buffer buffer to be read from
 	@param bufferSize size of the buffer
 	@return converted value from the buffer
 	*/
-	virtual bool ReadB(const unsigned char* buffer, size_t bufferSize) const = 0 { throw std::logic_error("not implemented"); }	
+	virtual bool ReadB(const unsigned char* buffer, size_t bufferSize) const = 0;
+
+	/**
+	@return number of bytes from the start of a buffer the handler accesses, a buffer must be at least this large. A
+	handler that doesn't know its extent returns the maximum of size_t, so the validation of every buffer fails
+	instead of letting the handler read beyond the end.
+	*/
+	virtual size_t Extent() const { return std::numeric_limits<size_t>::max(); }
+
+	/**
+	Reads the value at the slot specified during creation using \ref CreateBufferHandler from count records and converts
+	each to a 64bit unsigned integer. The records are laid out one after the other, recordSize bytes apart. The virtual
+	dispatch is paid once per batch, the specialized handlers override this with a tight loop.
+	@param records first record to be read from
+	@param recordSize size of one record in bytes (distance between two consecutive records)
+	@param count number of records to read
+	@param values output array, must be able to hold count values
+	*/
+	virtual void ReadUI64Batch(const unsigned char* records, size_t recordSize, size_t count, boost::uint64_t* values) const
+	{
+		for (size_t i=0; i<count; ++i) { values[i] = ReadUI64(records + i*recordSize, recordSize); }
+	}
+	/**
+	Reads the value from count records and converts each to a 64bit integer. See \ref ReadUI64Batch.
+	@param records first record to be read from
+	@param recordSize size of one record in bytes (distance between two consecutive records)
+	@param count number of records to read
+	@param values output array, must be able to hold count values
+	*/
+	virtual void ReadI64Batch(const unsigned char* records, size_t recordSize, size_t count, boost::int64_t* values) const
+	{
+		for (size_t i=0; i<count; ++i) { values[i] = ReadI64(records + i*recordSize, recordSize); }
+	}
+	/**
+	Reads the value from count records and converts each to a 32bit unsigned integer. See \ref ReadUI64Batch.
+	@param records first record to be read from
+	@param recordSize size of one record in bytes (distance between two consecutive records)
+	@param count number of records to read
+	@param values output array, must be able to hold count values
+	*/
+	virtual void ReadUI32Batch(const unsigned char* records, size_t recordSize, size_t count, boost::uint32_t* values) const
+	{
+		for (size_t i=0; i<count; ++i) { values[i] = ReadUI32(records + i*recordSize, recordSize); }
+	}
+	/**
+	Reads the value from count records and converts each to a 32bit integer. See \ref ReadUI64Batch.
+	@param records first record to be read from
+	@param recordSize size of one record in bytes (distance between two consecutive records)
+	@param count number of records to read
+	@param values output array, must be able to hold count values
+	*/
+	virtual void ReadI32Batch(const unsigned char* records, size_t recordSize, size_t count, boost::int32_t* values) const
+	{
+		for (size_t i=0; i<count; ++i) { values[i] = ReadI32(records + i*recordSize, recordSize); }
+	}
+	/**
+	Reads the value from count records and converts each to a 32bit float. See \ref ReadUI64Batch.
+	@param records first record to be read from
+	@param recordSize size of one record in bytes (distance between two consecutive records)
+	@param count number of records to read
+	@param values output array, must be able to hold count values
+	*/
+	virtual void ReadFBatch(const unsigned char* records, size_t recordSize, size_t count, float* values) const
+	{
+		for (size_t i=0; i<count; ++i) { values[i] = ReadF(records + i*recordSize, recordSize); }
+	}
+	/**
+	Reads the value from count records and converts each to a 64bit double. See \ref ReadUI64Batch.
+	@param records first record to be read from
+	@param recordSize size of one record in bytes (distance between two consecutive records)
+	@param count number of records to read
+	@param values output array, must be able to hold count values
+	*/
+	virtual void ReadDBatch(const unsigned char* records, size_t recordSize, size_t count, double* values) const
+	{
+		for (size_t i=0; i<count; ++i) { values[i] = ReadD(records + i*recordSize, recordSize); }
+	}
+	/**
+	Reads the value from count records and converts each to a 1bit bool. See \ref ReadUI64Batch.
+	@param records first record to be read from
+	@param recordSize size of one record in bytes (distance between two consecutive records)
+	@param count number of records to read
+	@param values output array, must be able to hold count values
+	*/
+	virtual void ReadBBatch(const unsigned char* records, size_t recordSize, size_t count, bool* values) const
+	{
+		for (size_t i=0; i<count; ++i) { values[i] = ReadB(records + i*recordSize, recordSize); }
+	}
+
+	/**
+	Computes min, max, sum and the number of non zero values of the field over count records without materializing
+	the values. The accumulators stay in registers, the aligned handlers work on vectorized blocks.
+	@param records first record to be read from
+	@param recordSize size of one record in bytes (distance between two consecutive records)
+	@param count number of records to aggregate
+	@return aggregates of the values converted to double
+	*/
+	virtual FieldAggregate Aggregate(const unsigned char* records, size_t recordSize, size_t count) const
+	{
+		FieldAggregate result;
+		for (size_t i=0; i<count; ++i) { result.Add(ReadD(records + i*recordSize, recordSize)); }
+		return result;
+	}
 };
 
+//default implementations of the pure virtual methods, defined outside of the class to be standard conforming
+inline void DataHandler::WriteUI64(boost::uint64_t value, unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
+inline void DataHandler::WriteI64(boost::int64_t value, unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
+inline void DataHandler::WriteUI32(boost::uint32_t , unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
+inline void DataHandler::WriteI32(boost::int32_t , unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
+inline void DataHandler::WriteF(float , unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
+inline void DataHandler::WriteD(double , unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
+inline void DataHandler::WriteB(bool , unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
+inline boost::uint64_t DataHandler::ReadUI64(const unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
+inline boost::int64_t DataHandler::ReadI64(const unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
+inline boost::uint32_t DataHandler::ReadUI32(const unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
+inline boost::int32_t DataHandler::ReadI32(const unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
+inline float DataHandler::ReadF(const unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
+inline double DataHandler::ReadD(const unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
+inline bool DataHandler::ReadB(const unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
+
 /**
 Factory method to create the appropriate reader/writer class. The fastest implementation for the given combination of
 startbit, sizeInBits and DataType is chosen.
@@ -233,52 +691,262 @@ startbit, sizeInBits and DataType is chosen.
 */
 boost::shared_ptr<DataHandler> CreateBufferHandler(unsigned int startbit, unsigned int sizeInBits, DataType type);
 
+/**
+Contract between the caller and the handlers about the memory around the fields.
+*/
+enum BufferPadding
+{
+	/** only the bytes covering a field are accessed */
+	ExactBuffer,
+	/** the caller guarantees that 8 bytes starting at the first byte of any field can be read and written, e.g. by
+	over-allocating every buffer by 8 bytes. Reads and writes of the generic handlers become a single fixed size load
+	and store instead of a variable length memcpy. The buffer size passed to the handlers includes the padding, the
+	bounds checks cover the whole load. */
+	PaddedBuffer
+};
+
+/**
+Factory method to create the appropriate reader/writer class for the given buffer contract. See
+\ref CreateBufferHandler(unsigned int, unsigned int, DataType).
+
+@param startbit first bit of the data inside of the buffer
+@param sizeInBits number of bits for the data
+@param DataType determines how the data is interpreted (Integer / Float, Little or Big Endian)
+@param padding guarantee of the caller about the memory behind the fields
+@return reader/writer for this field in the buffer
+*/
+boost::shared_ptr<DataHandler> CreateBufferHandler(unsigned int startbit, unsigned int sizeInBits, DataType type, BufferPadding padding);
+
+/**
+Validates whole batches of buffers against a set of handlers before they are read or written. The largest extent of
+the handlers is computed once at construction, a batch is then checked with a single pass over the buffer sizes. This
+is the up front validation for \ref BoundsCheckPerBatch (the default) and \ref BoundsCheckNone, where the single reads and
+writes of the handlers don't check the buffer size.
+*/
+class BufferBatchValidator
+{
+	size_t m_extent;
+
+public:
+	/**
+	@param handlers handlers that will access the buffers
+	*/
+	template<typename Handlers>
+	explicit BufferBatchValidator(const Handlers& handlers)
+		: m_extent(0)
+	{
+		for (auto it = handlers.begin(); it != handlers.end(); ++it)
+		{
+			m_extent = std::max(m_extent, (*it)->Extent());
+		}
+	}
+
+	/**
+	@return the minimum size of a buffer
+	*/
+	size_t Extent() const { return m_extent; }
+
+	/**
+	Checks count records that are recordSize bytes apart.
+	@throw std::out_of_range if the records are too small
+	*/
+	void Check(size_t recordSize, size_t count) const
+	{
+		if (count != 0 && recordSize < m_extent)
+		{
+			throw std::out_of_range("records are too small for the fields");
+		}
+	}
+
+	/**
+	Checks a batch of individual buffers. The sizes are reduced to their minimum without branches, only a failing
+	batch is searched for the offending buffer.
+	@param bufferSizes sizes of the buffers
+	@param count number of buffers
+	@throw std::out_of_range naming the first buffer that is too small
+	*/
+	void Check(const size_t* bufferSizes, size_t count) const
+	{
+		size_t smallest = ~static_cast<size_t>(0);
+		for (size_t i=0; i<count; ++i)
+		{
+			smallest = bufferSizes[i] < smallest ? bufferSizes[i] : smallest;
+		}
+		if (smallest >= m_extent)
+		{
+			return;
+		}
+		for (size_t i=0; i<count; ++i)
+		{
+			if (bufferSizes[i] < m_extent)
+			{
+				throw std::out_of_range("buffer " + std::to_string(i) + " is too small for the fields");
+			}
+		}
+	}
+};
+
 namespace Implementation
 {
 	#pragma warning( push )
 #pragma warning( disable : 4800) //disable warning "forcing value to bool 'true' or 'false' (performance warning)
 
+/**
+No bounds checking, the caller guarantees that every buffer is large enough (e.g. with \ref BufferBatchValidator).
+*/
+struct BoundsCheckNone
+{
+	static void CheckCall(size_t , size_t ) {}
+	static void CheckBatch(size_t , size_t , size_t ) {}
+};
+
+/**
+Every read and write checks the buffer size, the batch reads check every record.
+*/
+struct BoundsCheckPerCall
+{
+	static void CheckCall(size_t extent, size_t bufferSize)
+	{
+		if (extent > bufferSize)
+		{
+			throw std::out_of_range("buffer is too small for the field");
+		}
+	}
+	static void CheckBatch(size_t extent, size_t recordSize, size_t count)
+	{
+		if (count != 0)
+		{
+			CheckCall(extent, recordSize);
+		}
+	}
+};
+
+/**
+The batch reads check the record size once before the loop, single reads and writes are not checked. The loops stay
+free of branches and are still safe, single values are validated by the caller for a whole batch of buffers up front
+with \ref BufferBatchValidator.
+*/
+struct BoundsCheckPerBatch
+{
+	static void CheckCall(size_t extent, size_t bufferSize)
+	{
+		assert(extent <= bufferSize);
+		(void)extent;
+		(void)bufferSize;
+	}
+	static void CheckBatch(size_t extent, size_t recordSize, size_t count) { BoundsCheckPerCall::CheckBatch(extent, recordSize, count); }
+};
+
+#if BUFFERHANDLER_BOUNDS_CHECK == BUFFERHANDLER_UNCHECKED
+typedef BoundsCheckNone DefaultBoundsCheck;
+#elif BUFFERHANDLER_BOUNDS_CHECK == BUFFERHANDLER_CHECK_PER_CALL
+typedef BoundsCheckPerCall DefaultBoundsCheck;
+#else
+typedef BoundsCheckPerBatch DefaultBoundsCheck;
+#endif
+
 
 template<typename SwapSize>
 struct SwapPolicyNone
 {
 	inline static SwapSize Swap(SwapSize src) { return src; }
+	inline static void SwapArray(const SwapSize* src, SwapSize* dst, size_t count) { if (src != dst) { memcpy(dst, src, count*sizeof(SwapSize)); } }
 };
 
 template<typename SwapSize>
 struct SwapPolicySwap
 {
 	inline static SwapSize Swap(SwapSize src) { throw std::logic_error("swaping not implemented"); }
+	inline static void SwapArray(const SwapSize* , SwapSize* , size_t ) { throw std::logic_error("swaping not implemented"); }
 };
 
 template<>
 struct SwapPolicySwap<boost::uint16_t>
 {
 	inline static boost::uint16_t Swap(boost::uint16_t src) { return BufferHandler::Swap16(src); }
+	inline static void SwapArray(const boost::uint16_t* src, boost::uint16_t* dst, size_t count) { BufferHandler::SwapArray16(src, dst, count); }
 };
 
 template<>
 struct SwapPolicySwap<boost::uint32_t>
 {
 	inline static boost::uint32_t Swap(boost::uint32_t src) { return BufferHandler::Swap32(src); }
+	inline static void SwapArray(const boost::uint32_t* src, boost::uint32_t* dst, size_t count) { BufferHandler::SwapArray32(src, dst, count); }
 };
 
 template<>
 struct SwapPolicySwap<boost::uint64_t>
 {
 	inline static boost::uint64_t Swap(boost::uint64_t src) { return BufferHandler::Swap64(src); }
+	inline static void SwapArray(const boost::uint64_t* src, boost::uint64_t* dst, size_t count) { BufferHandler::SwapArray64(src, dst, count); }
 };
 
 template<>
 struct SwapPolicySwap<boost::uint8_t>
 {
 	inline static boost::uint8_t Swap(boost::uint8_t src) { return src; }
+	inline static void SwapArray(const boost::uint8_t* src, boost::uint8_t* dst, size_t count) { if (src != dst) { memcpy(dst, src, count); } }
 };
 
 
 
+/**
+Accumulator type for the sum of a block: small integers are summed exactly in 64bit (a block is too short to
+overflow), everything else in double.
+*/
+template<typename T>
+struct AggregateSum
+{
+	typedef typename std::conditional<std::is_integral<T>::value && sizeof(T) < 8,
+		typename std::conditional<std::is_signed<T>::value, boost::int64_t, boost::uint64_t>::type,
+		double>::type type;
+};
+
+/**
+Aggregates a block of values into result. The loop is unrolled into four independent lanes without any branches, so
+the compiler keeps the accumulators in (vector) registers.
+*/
+template<typename T>
+inline void AggregateBlock(const T* values, size_t n, FieldAggregate& result)
+{
+	typedef typename AggregateSum<T>::type Sum;
+	const T initialMin = std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+	const T initialMax = std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest();
+	T mins[4] = { initialMin, initialMin, initialMin, initialMin };
+	T maxs[4] = { initialMax, initialMax, initialMax, initialMax };
+	Sum sums[4] = { 0, 0, 0, 0 };
+	size_t nonZeros[4] = { 0, 0, 0, 0 };
+	size_t i = 0;
+	for (; i+4<=n; i+=4)
+	{
+		for (size_t l=0; l<4; ++l)
+		{
+			const T v = values[i+l];
+			mins[l] = v < mins[l] ? v : mins[l];
+			maxs[l] = v > maxs[l] ? v : maxs[l];
+			sums[l] += static_cast<Sum>(v);
+			nonZeros[l] += v != 0;
+		}
+	}
+	for (; i<n; ++i)
+	{
+		const T v = values[i];
+		mins[0] = v < mins[0] ? v : mins[0];
+		maxs[0] = v > maxs[0] ? v : maxs[0];
+		sums[0] += static_cast<Sum>(v);
+		nonZeros[0] += v != 0;
+	}
+	for (size_t l=0; l<4; ++l)
+	{
+		result.min = static_cast<double>(mins[l]) < result.min ? static_cast<double>(mins[l]) : result.min;
+		result.max = static_cast<double>(maxs[l]) > result.max ? static_cast<double>(maxs[l]) : result.max;
+		result.sum += static_cast<double>(sums[l]);
+		result.nonZero += nonZeros[l];
+	}
+	result.count += n;
+}
 
-template <typename T, typename intermediateType, typename swapPolicy>
+template <typename T, typename intermediateType, typename swapPolicy, typename boundsCheck = DefaultBoundsCheck>
 class AlignedDataHandler : public BufferHandler::DataHandler
 {
 	BOOST_STATIC_ASSERT(sizeof(T)==sizeof(intermediateType));
@@ -287,13 +955,20 @@ class AlignedDataHandler : public BufferHandler::DataHandler
 
 	T ReadData(const unsigned char* buffer, size_t bufferSize) const;
 	void WriteData(T value, unsigned char* buffer, size_t bufferSize) const;
+	template<typename BlockFunction>
+	void ForEachBlock(const unsigned char* records, size_t recordSize, size_t count, BlockFunction function) const;
+	template<typename Out>
+	void ReadDataBatch(const unsigned char* records, size_t recordSize, size_t count, Out* values) const;
 public:
 	AlignedDataHandler(unsigned int startBit) : m_startByteOffset(startBit / 8) 
 	{
 		assert(startBit % 8 == 0);
+		BUFFERHANDLER_COUNT_CREATE(AlignedHandlerKind);
 	}
 	virtual ~AlignedDataHandler(){}
 
+	virtual size_t Extent() const { return m_startByteOffset + sizeof(T); }
+
 	virtual void WriteUI64(boost::uint64_t value, unsigned char* buffer, size_t bufferSize) const { WriteData(static_cast<T>(value), buffer, bufferSize); }
 	virtual void WriteI64(boost::int64_t value, unsigned char* buffer, size_t bufferSize) const { WriteData(static_cast<T>(value), buffer, bufferSize); }
 	virtual void WriteUI32(boost::uint32_t value, unsigned char* buffer, size_t bufferSize) const { WriteData(static_cast<T>(value), buffer, bufferSize); }
@@ -309,14 +984,31 @@ public:
 	virtual float ReadF(const unsigned char* buffer, size_t bufferSize) const { return static_cast<float>(ReadData(buffer, bufferSize)); }
 	virtual double ReadD(const unsigned char* buffer, size_t bufferSize) const { return static_cast<double>(ReadData(buffer, bufferSize)); }
 	virtual bool ReadB(const unsigned char* buffer, size_t bufferSize) const { return static_cast<bool>(ReadData(buffer, bufferSize)); }
+
+	virtual void ReadUI64Batch(const unsigned char* records, size_t recordSize, size_t count, boost::uint64_t* values) const { ReadDataBatch(records, recordSize, count, values); }
+	virtual void ReadI64Batch(const unsigned char* records, size_t recordSize, size_t count, boost::int64_t* values) const { ReadDataBatch(records, recordSize, count, values); }
+	virtual void ReadUI32Batch(const unsigned char* records, size_t recordSize, size_t count, boost::uint32_t* values) const { ReadDataBatch(records, recordSize, count, values); }
+	virtual void ReadI32Batch(const unsigned char* records, size_t recordSize, size_t count, boost::int32_t* values) const { ReadDataBatch(records, recordSize, count, values); }
+	virtual void ReadFBatch(const unsigned char* records, size_t recordSize, size_t count, float* values) const { ReadDataBatch(records, recordSize, count, values); }
+	virtual void ReadDBatch(const unsigned char* records, size_t recordSize, size_t count, double* values) const { ReadDataBatch(records, recordSize, count, values); }
+	virtual void ReadBBatch(const unsigned char* records, size_t recordSize, size_t count, bool* values) const { ReadDataBatch(records, recordSize, count, values); }
+
+	virtual FieldAggregate Aggregate(const unsigned char* records, size_t recordSize, size_t count) const
+	{
+		FieldAggregate result;
+		ForEachBlock(records, recordSize, count, [&result](const T* values, size_t, size_t n) { AggregateBlock(values, n, result); });
+		return result;
+	}
 };
 
 class ZeroDataHandler : public BufferHandler::DataHandler
 {
 public:
-	ZeroDataHandler() {}
+	ZeroDataHandler() { BUFFERHANDLER_COUNT_CREATE(ZeroHandlerKind); }
 	~ZeroDataHandler() {}
 
+	virtual size_t Extent() const { return 0; }
+
 	virtual void WriteUI64(boost::uint64_t , unsigned char* , size_t ) const { }
 	virtual void WriteI64(boost::int64_t , unsigned char* , size_t ) const  { }
 	virtual void WriteUI32(boost::uint32_t , unsigned char* , size_t ) const  { }
@@ -332,6 +1024,26 @@ public:
 	virtual float ReadF(const unsigned char* , size_t ) const { return static_cast<float>(0); }
 	virtual double ReadD(const unsigned char* , size_t ) const { return static_cast<double>(0); }
 	virtual bool ReadB(const unsigned char* , size_t ) const { return static_cast<bool>(0); }
+
+	virtual void ReadUI64Batch(const unsigned char* , size_t , size_t count, boost::uint64_t* values) const { std::fill(values, values+count, static_cast<boost::uint64_t>(0)); }
+	virtual void ReadI64Batch(const unsigned char* , size_t , size_t count, boost::int64_t* values) const { std::fill(values, values+count, static_cast<boost::int64_t>(0)); }
+	virtual void ReadUI32Batch(const unsigned char* , size_t , size_t count, boost::uint32_t* values) const { std::fill(values, values+count, static_cast<boost::uint32_t>(0)); }
+	virtual void ReadI32Batch(const unsigned char* , size_t , size_t count, boost::int32_t* values) const { std::fill(values, values+count, static_cast<boost::int32_t>(0)); }
+	virtual void ReadFBatch(const unsigned char* , size_t , size_t count, float* values) const { std::fill(values, values+count, static_cast<float>(0)); }
+	virtual void ReadDBatch(const unsigned char* , size_t , size_t count, double* values) const { std::fill(values, values+count, static_cast<double>(0)); }
+	virtual void ReadBBatch(const unsigned char* , size_t , size_t count, bool* values) const { std::fill(values, values+count, false); }
+
+	virtual FieldAggregate Aggregate(const unsigned char* , size_t , size_t count) const
+	{
+		FieldAggregate result;
+		result.count = count;
+		if (count > 0)
+		{
+			result.min = 0;
+			result.max = 0;
+		}
+		return result;
+	}
 };
 
 struct SignPolicyUnsigned
@@ -350,7 +1062,7 @@ struct SignPolicySigned
 	}
 };
 
-template <typename SignPolicy>
+template <typename SignPolicy, typename boundsCheck = DefaultBoundsCheck>
 class BitDataHandler : public BufferHandler::DataHandler
 {
 	unsigned int m_startByteOffset;
@@ -358,13 +1070,28 @@ class BitDataHandler : public BufferHandler::DataHandler
 	unsigned char m_readMask;
 	unsigned char m_writeMask;
 
-	int ReadBit(const unsigned char* buffer, size_t ) const
+	int ReadBit(const unsigned char* buffer, size_t bufferSize) const
 	{
+		boundsCheck::CheckCall(m_startByteOffset + 1, bufferSize);
+		BUFFERHANDLER_COUNT_CALL(BitHandlerKind, ReadOperation, 1, 1);
 		bool result = ((*reinterpret_cast<const unsigned char*>(buffer+m_startByteOffset)) & m_readMask);
 		return  SignPolicy::IntValue(result);
 	}
-	void WriteBit(bool value, unsigned char* buffer, size_t ) const
+	template<typename Out>
+	void ReadBitBatch(const unsigned char* records, size_t recordSize, size_t count, Out* values) const
 	{
+		boundsCheck::CheckBatch(m_startByteOffset + 1, recordSize, count);
+		BUFFERHANDLER_COUNT_CALL(BitHandlerKind, BatchOperation, count, count);
+		const unsigned char* current = records + m_startByteOffset;
+		for (size_t i=0; i<count; ++i, current+=recordSize)
+		{
+			values[i] = static_cast<Out>(SignPolicy::IntValue((*current & m_readMask) != 0));
+		}
+	}
+	void WriteBit(bool value, unsigned char* buffer, size_t bufferSize) const
+	{
+		boundsCheck::CheckCall(m_startByteOffset + 1, bufferSize);
+		BUFFERHANDLER_COUNT_CALL(BitHandlerKind, WriteOperation, 1, 1);
 		if (value)
 		{
 			*reinterpret_cast<unsigned char*>(buffer+m_startByteOffset) |= m_readMask;
@@ -381,10 +1108,14 @@ public:
 		, m_bitOffsetInsideByte(startBit % 8)
 		, m_readMask(1<<m_bitOffsetInsideByte)
 		, m_writeMask(~m_readMask)
-	{}
+	{
+		BUFFERHANDLER_COUNT_CREATE(BitHandlerKind);
+	}
 
 	virtual ~BitDataHandler(){}
 
+	virtual size_t Extent() const { return m_startByteOffset + 1; }
+
 	virtual void WriteUI64(boost::uint64_t value, unsigned char* buffer, size_t bufferSize) const { WriteBit(static_cast<bool>(value), buffer, bufferSize); }
 	virtual void WriteI64(boost::int64_t value, unsigned char* buffer, size_t bufferSize) const { WriteBit(static_cast<bool>(value), buffer, bufferSize); }
 	virtual void WriteUI32(boost::uint32_t value, unsigned char* buffer, size_t bufferSize) const { WriteBit(static_cast<bool>(value), buffer, bufferSize); }
@@ -400,6 +1131,28 @@ public:
 	virtual float ReadF(const unsigned char* buffer, size_t bufferSize) const { return static_cast<float>(ReadBit(buffer, bufferSize)); }
 	virtual double ReadD(const unsigned char* buffer, size_t bufferSize) const { return static_cast<double>(ReadBit(buffer, bufferSize)); }
 	virtual bool ReadB(const unsigned char* buffer, size_t bufferSize) const { return static_cast<bool>(ReadBit(buffer, bufferSize)); }
+
+	virtual void ReadUI64Batch(const unsigned char* records, size_t recordSize, size_t count, boost::uint64_t* values) const { ReadBitBatch(records, recordSize, count, values); }
+	virtual void ReadI64Batch(const unsigned char* records, size_t recordSize, size_t count, boost::int64_t* values) const { ReadBitBatch(records, recordSize, count, values); }
+	virtual void ReadUI32Batch(const unsigned char* records, size_t recordSize, size_t count, boost::uint32_t* values) const { ReadBitBatch(records, recordSize, count, values); }
+	virtual void ReadI32Batch(const unsigned char* records, size_t recordSize, size_t count, boost::int32_t* values) const { ReadBitBatch(records, recordSize, count, values); }
+	virtual void ReadFBatch(const unsigned char* records, size_t recordSize, size_t count, float* values) const { ReadBitBatch(records, recordSize, count, values); }
+	virtual void ReadDBatch(const unsigned char* records, size_t recordSize, size_t count, double* values) const { ReadBitBatch(records, recordSize, count, values); }
+	virtual void ReadBBatch(const unsigned char* records, size_t recordSize, size_t count, bool* values) const { ReadBitBatch(records, recordSize, count, values); }
+	virtual FieldAggregate Aggregate(const unsigned char* records, size_t recordSize, size_t count) const
+	{
+		//extract a block of bits, then aggregate it with the unrolled kernel
+		const size_t blockSize = 256;
+		boost::int8_t values[blockSize];
+		FieldAggregate result;
+		for (size_t first=0; first<count; first+=blockSize)
+		{
+			const size_t n = std::min(blockSize, count-first);
+			ReadBitBatch(records + first*recordSize, recordSize, n, values);
+			AggregateBlock(values, n, result);
+		}
+		return result;
+	}
 };
 
 template<typename T>
@@ -436,13 +1189,18 @@ struct EndianessPolicyNoSwap
 		, mask( 0 )
 	{
 		mask = ~static_cast<T>(0);
-		mask <<= bitSize;
-		mask = ~mask;
+		if (bitSize < sizeof(T)*8) //shifting by the full width is undefined
+		{
+			mask <<= bitSize;
+			mask = ~mask;
+		}
 	}
 	T Align(T value) const{ return value >> shift; }
 	T InverseAlign(T value) const { return value << shift; }
 	T ApplyMask(T value) const { return value & mask; }
 	T Swap(T value) const { return value; }
+	T Extract(T value) const { return ApplyMask(Align(value)); }
+	T Insert(T value) const { return InverseAlign(ApplyMask(value)); }
 };
 
 template<typename T>
@@ -452,12 +1210,15 @@ struct EndianessPolicySwap
 	T mask;
 
 	EndianessPolicySwap(unsigned int startBit, unsigned int bitSize) 
-		: shift( (sizeof(T) - (bitSize+startBit + 7)/8)*8 + startBit%8)
+		: shift( (sizeof(T) - (bitSize+startBit%8 + 7)/8)*8 + startBit%8)
 		, mask( 0 )
 	{
 		mask = ~static_cast<T>(0);
-		mask <<= bitSize;
-		mask = ~mask;
+		if (bitSize < sizeof(T)*8) //shifting by the full width is undefined
+		{
+			mask <<= bitSize;
+			mask = ~mask;
+		}
 	}
 	T Align(T value) const
 	{ 
@@ -466,6 +1227,8 @@ struct EndianessPolicySwap
 	T InverseAlign(T value) const { return value << shift; }
 	T ApplyMask(T value) const { return value & mask; }
 	T Swap(T value) const;
+	T Extract(T value) const { return ApplyMask(Align(value)); }
+	T Insert(T value) const { return InverseAlign(ApplyMask(value)); }
 };
 
 template<>
@@ -499,130 +1262,319 @@ inline T EndianessPolicySwap<T>::Swap(T value) const
 }
 
 /**
-	This is the slowest possible implementation for reading. Reads using memcopy - this should always work. Should be taken as seldom as possible.
+Default bit extraction: shift and mask as implemented by the endianess policy.
+*/
+template<typename endianessPolicy>
+struct BitExtractionScalar : endianessPolicy
+{
+	BitExtractionScalar(unsigned int startBit, unsigned int bitSize) : endianessPolicy(startBit, bitSize) {}
+};
+
+#if defined(BUFFERHANDLER_BMI2_BACKEND)
+/**
+Bit extraction with the BMI2 instructions: PEXT gathers the field bits and PDEP scatters them back, each replacing a
+shift and a mask. Must only be used if \ref CpuSupportsBmi2 returns true.
+*/
+template<typename endianessPolicy>
+struct BitExtractionBmi2 : endianessPolicy
+{
+	typedef decltype(endianessPolicy::mask) T;
+	T fieldBits; //mask of the field at its position inside of the (swapped) value
+
+	BitExtractionBmi2(unsigned int startBit, unsigned int bitSize)
+		: endianessPolicy(startBit, bitSize)
+		, fieldBits(endianessPolicy::InverseAlign(endianessPolicy::mask))
+	{}
+	T Extract(T value) const { return BufferHandler::Implementation::Pext(value, fieldBits); }
+	T Insert(T value) const { return BufferHandler::Implementation::Pdep(value, fieldBits); }
+};
+#endif
+
+/**
+Copies exactly the bytes covering the field. This never touches memory outside of the field.
+*/
+struct CopyPolicyExact
+{
+	static const HandlerKind kind = GenericExactHandlerKind;
+	template<typename T>
+	static unsigned int BytesTouched(unsigned int bytes) { return bytes; }
+	template<typename T>
+	static void Load(T& value, const unsigned char* src, unsigned int bytes) { value = 0; memcpy(&value, src, bytes); }
+	template<typename T>
+	static void Store(unsigned char* dst, const T& value, unsigned int bytes) { memcpy(dst, &value, bytes); }
+};
+
+/**
+Always copies sizeof(T) bytes, which compiles to a single unaligned load / store instead of a variable length memcpy.
+Requires the \ref PaddedBuffer contract. Bytes outside of the field are loaded as well but masked out, a store writes
+them back unchanged.
 */
-template<typename internalBufferType, typename reinterpretType, typename endianessPolicy, typename signPolicy>
+struct CopyPolicyPadded
+{
+	static const HandlerKind kind = GenericPaddedHandlerKind;
+	template<typename T>
+	static unsigned int BytesTouched(unsigned int ) { return sizeof(T); }
+	template<typename T>
+	static void Load(T& value, const unsigned char* src, unsigned int ) { memcpy(&value, src, sizeof(T)); }
+	template<typename T>
+	static void Store(unsigned char* dst, const T& value, unsigned int ) { memcpy(dst, &value, sizeof(T)); }
+};
+
+/**
+	This is the slowest possible implementation for reading and writing. Reads using memcopy - this should always work. Should be taken as seldom as possible.
+	Writes are a read-modify-write of the bytes covering the field, the surrounding bits are preserved.
+*/
+template<typename internalBufferType, typename reinterpretType, typename endianessPolicy, typename signPolicy, typename copyPolicy = CopyPolicyExact, typename boundsCheck = DefaultBoundsCheck>
 class GenericHandler : public BufferHandler::DataHandler, private endianessPolicy, private signPolicy
 {
 private:
 	unsigned int m_byteOffset;
 	unsigned int m_bitOffset;
 	unsigned int m_bytesToCopy;
+	internalBufferType m_fieldMask; //bits of the field inside of the internal buffer, in buffer byte order
 
 	internalBufferType Read(const unsigned char* buffer, size_t bufferSize) const;
+	internalBufferType ReadValue(const unsigned char* buffer, size_t bufferSize) const;
 	void Write(internalBufferType value, unsigned char* buffer, size_t bufferSize) const;
+	template<typename V>
+	void WriteValue(V value, unsigned char* buffer, size_t bufferSize) const;
+	template<typename Out>
+	void ReadBatch(const unsigned char* records, size_t recordSize, size_t count, Out* values) const;
 
 public:
 	GenericHandler(unsigned int startBit, unsigned int bitSize);
 	virtual ~GenericHandler() {}
 
-	virtual void WriteUI64(boost::uint64_t value, unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
-	virtual void WriteI64(boost::int64_t value, unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
-	virtual void WriteUI32(boost::uint32_t value, unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
-	virtual void WriteI32(boost::int32_t value, unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
-	virtual void WriteF(float value, unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
-	virtual void WriteD(double value, unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
-	virtual void WriteB(bool value, unsigned char* buffer, size_t bufferSize) const { throw std::logic_error("not implemented"); }
+	virtual size_t Extent() const { return m_byteOffset + copyPolicy::template BytesTouched<internalBufferType>(m_bytesToCopy); }
+
+	virtual void WriteUI64(boost::uint64_t value, unsigned char* buffer, size_t bufferSize) const { WriteValue(value, buffer, bufferSize); }
+	virtual void WriteI64(boost::int64_t value, unsigned char* buffer, size_t bufferSize) const { WriteValue(value, buffer, bufferSize); }
+	virtual void WriteUI32(boost::uint32_t value, unsigned char* buffer, size_t bufferSize) const { WriteValue(value, buffer, bufferSize); }
+	virtual void WriteI32(boost::int32_t value, unsigned char* buffer, size_t bufferSize) const { WriteValue(value, buffer, bufferSize); }
+	virtual void WriteF(float value, unsigned char* buffer, size_t bufferSize) const { WriteValue(value, buffer, bufferSize); }
+	virtual void WriteD(double value, unsigned char* buffer, size_t bufferSize) const { WriteValue(value, buffer, bufferSize); }
+	virtual void WriteB(bool value, unsigned char* buffer, size_t bufferSize) const { WriteValue(value, buffer, bufferSize); }
 	
 	virtual boost::uint64_t ReadUI64(const unsigned char* buffer, size_t bufferSize) const 
 	{ 
 		internalBufferType result = Read(buffer,bufferSize);
-		return static_cast<unsigned long long>(*reinterpret_cast<reinterpretType*>(&result)); 
+		return static_cast<unsigned long long>(BitCast<reinterpretType>(result)); 
 	}
 	virtual boost::int64_t ReadI64(const unsigned char* buffer, size_t bufferSize) const 
 	{ 
 		internalBufferType result = Read(buffer,bufferSize);
-		return static_cast<long long>(*reinterpret_cast<reinterpretType*>(&result)); 
+		return static_cast<long long>(BitCast<reinterpretType>(result)); 
 	}
 	virtual boost::uint32_t ReadUI32(const unsigned char* buffer, size_t bufferSize) const 
 	{ 
 		internalBufferType result = Read(buffer,bufferSize);
-		return static_cast<unsigned long>(*reinterpret_cast<reinterpretType*>(&result)); 
+		return static_cast<unsigned long>(BitCast<reinterpretType>(result)); 
 	}
 	virtual boost::int32_t ReadI32(const unsigned char* buffer, size_t bufferSize) const
 	{ 
 		internalBufferType result = Read(buffer,bufferSize);
-		return static_cast<long>(*reinterpret_cast<reinterpretType*>(&result)); 
+		return static_cast<long>(BitCast<reinterpretType>(result)); 
 	}
 	virtual float ReadF(const unsigned char* buffer, size_t bufferSize) const
 	{ 
 		internalBufferType result = Read(buffer,bufferSize);
-		return static_cast<float>(*reinterpret_cast<reinterpretType*>(&result)); 
+		return static_cast<float>(BitCast<reinterpretType>(result)); 
 	}
 	virtual double ReadD(const unsigned char* buffer, size_t bufferSize) const
 	{ 
 		internalBufferType result = Read(buffer,bufferSize);
-		return static_cast<double>(*reinterpret_cast<reinterpretType*>(&result)); 
+		return static_cast<double>(BitCast<reinterpretType>(result)); 
 	}
 	virtual bool ReadB(const unsigned char* buffer, size_t bufferSize) const
 	{ 
 		internalBufferType result = Read(buffer,bufferSize);
-		return static_cast<bool>(*reinterpret_cast<reinterpretType*>(&result)); 
+		return static_cast<bool>(BitCast<reinterpretType>(result)); 
+	}
+	virtual void ReadUI64Batch(const unsigned char* records, size_t recordSize, size_t count, boost::uint64_t* values) const { ReadBatch(records, recordSize, count, values); }
+	virtual void ReadI64Batch(const unsigned char* records, size_t recordSize, size_t count, boost::int64_t* values) const { ReadBatch(records, recordSize, count, values); }
+	virtual void ReadUI32Batch(const unsigned char* records, size_t recordSize, size_t count, boost::uint32_t* values) const { ReadBatch(records, recordSize, count, values); }
+	virtual void ReadI32Batch(const unsigned char* records, size_t recordSize, size_t count, boost::int32_t* values) const { ReadBatch(records, recordSize, count, values); }
+	virtual void ReadFBatch(const unsigned char* records, size_t recordSize, size_t count, float* values) const { ReadBatch(records, recordSize, count, values); }
+	virtual void ReadDBatch(const unsigned char* records, size_t recordSize, size_t count, double* values) const { ReadBatch(records, recordSize, count, values); }
+	virtual void ReadBBatch(const unsigned char* records, size_t recordSize, size_t count, bool* values) const { ReadBatch(records, recordSize, count, values); }
+
+	virtual FieldAggregate Aggregate(const unsigned char* records, size_t recordSize, size_t count) const
+	{
+		//extract a block of values, then aggregate it with the unrolled kernel
+		const size_t blockSize = 256;
+		reinterpretType values[blockSize];
+		FieldAggregate result;
+		for (size_t first=0; first<count; first+=blockSize)
+		{
+			const size_t n = std::min(blockSize, count-first);
+			ReadBatch(records + first*recordSize, recordSize, n, values);
+			AggregateBlock(values, n, result);
+		}
+		return result;
 	}
 };
 
-template <typename T, typename intermediateType, typename swapPolicy>
-void AlignedDataHandler<T,intermediateType,swapPolicy>::WriteData(T value, unsigned char* buffer, size_t bufferSize) const
+template <typename T, typename intermediateType, typename swapPolicy, typename boundsCheck>
+void AlignedDataHandler<T,intermediateType,swapPolicy,boundsCheck>::WriteData(T value, unsigned char* buffer, size_t bufferSize) const
 {
-	assert(m_startByteOffset + sizeof(T) - 1 < bufferSize);
-	intermediateType tmp = *reinterpret_cast<intermediateType*>(&value);
+	boundsCheck::CheckCall(m_startByteOffset + sizeof(T), bufferSize);
+	BUFFERHANDLER_COUNT_CALL(AlignedHandlerKind, WriteOperation, 1, sizeof(T));
+	intermediateType tmp = BitCast<intermediateType>(value);
 	intermediateType swappedIfNeeded = swapPolicy::Swap(tmp);
 	//this works as long as the intermediateType has the same width as T because we just want the pattern at that location
-	*reinterpret_cast<intermediateType*>(buffer+m_startByteOffset)=swappedIfNeeded;
+	memcpy(buffer+m_startByteOffset, &swappedIfNeeded, sizeof(intermediateType));
 }
 
-template <typename T, typename intermediateType, typename swapPolicy>
-T AlignedDataHandler<T,intermediateType,swapPolicy>::ReadData(const unsigned char* buffer, size_t bufferSize) const
+template <typename T, typename intermediateType, typename swapPolicy, typename boundsCheck>
+T AlignedDataHandler<T,intermediateType,swapPolicy,boundsCheck>::ReadData(const unsigned char* buffer, size_t bufferSize) const
 {
-	assert(m_startByteOffset + sizeof(T) - 1 < bufferSize);
-	intermediateType tmp = *reinterpret_cast<const intermediateType*>(buffer+m_startByteOffset);
+	boundsCheck::CheckCall(m_startByteOffset + sizeof(T), bufferSize);
+	BUFFERHANDLER_COUNT_CALL(AlignedHandlerKind, ReadOperation, 1, sizeof(T));
+	intermediateType tmp;
+	memcpy(&tmp, buffer+m_startByteOffset, sizeof(intermediateType));
 	intermediateType result = swapPolicy::Swap(tmp);
-	return *reinterpret_cast<T*>(&result);
+	return BitCast<T>(result);
 }
 
-template<typename internalBufferType, typename reinterpretType, typename endianessPolicy, typename signPolicy>
-GenericHandler<internalBufferType,reinterpretType,endianessPolicy,signPolicy>::GenericHandler(unsigned int startBit, unsigned int bitSize)
-	: signPolicy(bitSize), endianessPolicy(startBit, bitSize)
+template <typename T, typename intermediateType, typename swapPolicy, typename boundsCheck>
+template <typename BlockFunction>
+void AlignedDataHandler<T,intermediateType,swapPolicy,boundsCheck>::ForEachBlock(const unsigned char* records, size_t recordSize, size_t count, BlockFunction function) const
+{
+	boundsCheck::CheckBatch(m_startByteOffset + sizeof(T), recordSize, count);
+	BUFFERHANDLER_COUNT_CALL(AlignedHandlerKind, BatchOperation, count, count*sizeof(T));
+	//gather the raw values of a block of records, swap the whole block at once (vectorized for big endian data)
+	//and hand the block over as values of type T
+	const size_t blockSize = 256;
+	intermediateType block[blockSize];
+	T values[blockSize];
+	for (size_t first=0; first<count; first+=blockSize)
+	{
+		const size_t n = std::min(blockSize, count-first);
+		const unsigned char* current = records + first*recordSize + m_startByteOffset;
+		if (recordSize == sizeof(intermediateType))
+		{
+			//densely packed values, swap straight from the buffer
+			swapPolicy::SwapArray(reinterpret_cast<const intermediateType*>(current), block, n);
+		}
+		else
+		{
+			for (size_t i=0; i<n; ++i)
+			{
+				memcpy(&block[i], current + i*recordSize, sizeof(intermediateType));
+			}
+			swapPolicy::SwapArray(block, block, n);
+		}
+		memcpy(values, block, n*sizeof(T));
+		function(values, first, n);
+	}
+}
+
+template <typename T, typename intermediateType, typename swapPolicy, typename boundsCheck>
+template <typename Out>
+void AlignedDataHandler<T,intermediateType,swapPolicy,boundsCheck>::ReadDataBatch(const unsigned char* records, size_t recordSize, size_t count, Out* values) const
+{
+	ForEachBlock(records, recordSize, count, [values](const T* block, size_t first, size_t n)
+	{
+		for (size_t i=0; i<n; ++i)
+		{
+			values[first+i] = static_cast<Out>(block[i]);
+		}
+	});
+}
+
+template<typename internalBufferType, typename reinterpretType, typename endianessPolicy, typename signPolicy, typename copyPolicy, typename boundsCheck>
+GenericHandler<internalBufferType,reinterpretType,endianessPolicy,signPolicy,copyPolicy,boundsCheck>::GenericHandler(unsigned int startBit, unsigned int bitSize)
+	: endianessPolicy(startBit, bitSize), signPolicy(bitSize)
 	, m_byteOffset(startBit / 8)
 	, m_bitOffset(startBit % 8)
 	, m_bytesToCopy( (bitSize+(startBit%8)+7)/8 )
+	, m_fieldMask( static_cast<internalBufferType>(this->Swap(this->InverseAlign(this->ApplyMask(~static_cast<internalBufferType>(0))))) )
 {
 	assert(m_bytesToCopy <= sizeof(internalBufferType));
+	BUFFERHANDLER_COUNT_CREATE(copyPolicy::kind);
 }
-template<typename internalBufferType, typename reinterpretType, typename endianessPolicy, typename signPolicy>
-internalBufferType GenericHandler<internalBufferType,reinterpretType,endianessPolicy,signPolicy>::Read(const unsigned char* buffer, size_t bufferSize) const
+template<typename internalBufferType, typename reinterpretType, typename endianessPolicy, typename signPolicy, typename copyPolicy, typename boundsCheck>
+internalBufferType GenericHandler<internalBufferType,reinterpretType,endianessPolicy,signPolicy,copyPolicy,boundsCheck>::Read(const unsigned char* buffer, size_t bufferSize) const
 {
+	BUFFERHANDLER_COUNT_CALL(copyPolicy::kind, ReadOperation, 1, copyPolicy::template BytesTouched<internalBufferType>(m_bytesToCopy));
+	return ReadValue(buffer, bufferSize);
+}
+
+template<typename internalBufferType, typename reinterpretType, typename endianessPolicy, typename signPolicy, typename copyPolicy, typename boundsCheck>
+internalBufferType GenericHandler<internalBufferType,reinterpretType,endianessPolicy,signPolicy,copyPolicy,boundsCheck>::ReadValue(const unsigned char* buffer, size_t bufferSize) const
+{
+	boundsCheck::CheckCall(GenericHandler::Extent(), bufferSize);
 	//coyp into internal buffer
-	internalBufferType result = 0;
-	memcpy(&result,buffer+m_byteOffset,m_bytesToCopy);
+	internalBufferType result;
+	copyPolicy::Load(result,buffer+m_byteOffset,m_bytesToCopy);
 	//swap if necessary
-	result = Swap(result);
-	//align (right, with correction for swapping)
-	result = Align(result);
-	//apply mask (depending on alignment)
-	result = ApplyMask(result);
+	result = this->Swap(result);
+	//align (right, with correction for swapping) and apply mask
+	result = this->Extract(result);
 	//sign extension if necessary
-	return Extend(result);
+	return this->Extend(result);
 }
 
-template<typename internalBufferType, typename reinterpretType, typename endianessPolicy, typename signPolicy>
-void GenericHandler<internalBufferType,reinterpretType,endianessPolicy,signPolicy>::Write(internalBufferType value, unsigned char* buffer, size_t bufferSize) const
+template<typename internalBufferType, typename reinterpretType, typename endianessPolicy, typename signPolicy, typename copyPolicy, typename boundsCheck>
+template<typename Out>
+void GenericHandler<internalBufferType,reinterpretType,endianessPolicy,signPolicy,copyPolicy,boundsCheck>::ReadBatch(const unsigned char* records, size_t recordSize, size_t count, Out* values) const
 {
-	
-	//mask
-	auto  tmp = ApplyMask(tmp);
-	//align
-	tmp = Align(tmp);
-	//swap if necessary
-	tmp = Swap(value);
-	//bytewise or into place
-	for (unsigned int i=0; i<m_bytesToCopy; ++i)
+	boundsCheck::CheckBatch(GenericHandler::Extent(), recordSize, count);
+	BUFFERHANDLER_COUNT_CALL(copyPolicy::kind, BatchOperation, count, count*copyPolicy::template BytesTouched<internalBufferType>(m_bytesToCopy));
+	for (size_t i=0; i<count; ++i)
 	{
-		buffer[m_byteOffset+i] |= (reinterpret_cast<unsigned char*>(&tmp))[i];
+		internalBufferType result = ReadValue(records + i*recordSize, recordSize);
+		values[i] = static_cast<Out>(BitCast<reinterpretType>(result));
 	}
 }
 
-static boost::shared_ptr<BufferHandler::DataHandler> CreateAlignedDataHandler(unsigned int startbit, unsigned int sizeInBits, BufferHandler::DataType type)
+template<typename internalBufferType, typename reinterpretType, typename endianessPolicy, typename signPolicy, typename copyPolicy, typename boundsCheck>
+void GenericHandler<internalBufferType,reinterpretType,endianessPolicy,signPolicy,copyPolicy,boundsCheck>::Write(internalBufferType value, unsigned char* buffer, size_t bufferSize) const
+{
+	boundsCheck::CheckCall(GenericHandler::Extent(), bufferSize);
+	BUFFERHANDLER_COUNT_CALL(copyPolicy::kind, WriteOperation, 1, copyPolicy::template BytesTouched<internalBufferType>(m_bytesToCopy));
+	//mask, move to the position inside of the internal buffer and swap into buffer byte order
+	internalBufferType bits = static_cast<internalBufferType>(this->Swap(this->Insert(value)));
+	//read-modify-write of the word covering the field, the bits around the field are preserved
+	internalBufferType current;
+	copyPolicy::Load(current, buffer+m_byteOffset, m_bytesToCopy);
+	current = (current & ~m_fieldMask) | bits;
+	copyPolicy::Store(buffer+m_byteOffset, current, m_bytesToCopy);
+}
+
+template<typename internalBufferType, typename reinterpretType, typename endianessPolicy, typename signPolicy, typename copyPolicy, typename boundsCheck>
+template<typename V>
+void GenericHandler<internalBufferType,reinterpretType,endianessPolicy,signPolicy,copyPolicy,boundsCheck>::WriteValue(V value, unsigned char* buffer, size_t bufferSize) const
+{
+	//convert to the type stored in the buffer and take over its bit pattern (the inverse of the BitCast in Read)
+	reinterpretType converted = static_cast<reinterpretType>(value);
+	internalBufferType raw = 0;
+	memcpy(&raw, &converted, sizeof(converted));
+	Write(raw, buffer, bufferSize);
+}
+
+/**
+Constructs the handlers chosen by the factory functions on the heap, each owned by its own shared_ptr. This is what
+\ref CreateBufferHandler returns, other factories place the same handlers somewhere else (see HandlerSet.h).
+*/
+struct SharedHandlerFactory
+{
+	typedef boost::shared_ptr<BufferHandler::DataHandler> Result;
+
+	template<typename Handler, typename... Args>
+	Result Create(Args... args)
+	{
+		return Result(new Handler(args...));
+	}
+
+	Result Empty()
+	{
+		return Result();
+	}
+};
+
+template<typename Factory>
+typename Factory::Result CreateAlignedDataHandler(Factory& factory, unsigned int startbit, unsigned int sizeInBits, BufferHandler::DataType type)
 {
 	assert(sizeInBits == 8 || sizeInBits == 16 || sizeInBits == 32 || sizeInBits ==64);
 	assert(startbit % 8 == 0);
@@ -632,13 +1584,13 @@ static boost::shared_ptr<BufferHandler::DataHandler> CreateAlignedDataHandler(un
 		switch(sizeInBits)
 		{
 		case 8:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<boost::uint8_t,boost::uint8_t,SwapPolicyNone<boost::uint8_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<boost::uint8_t,boost::uint8_t,SwapPolicyNone<boost::uint8_t>>>(startbit);
 		case 16:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<boost::uint16_t,boost::uint16_t,SwapPolicyNone<boost::uint16_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<boost::uint16_t,boost::uint16_t,SwapPolicyNone<boost::uint16_t>>>(startbit);
 		case 32:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<boost::uint32_t,boost::uint32_t,SwapPolicyNone<boost::uint32_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<boost::uint32_t,boost::uint32_t,SwapPolicyNone<boost::uint32_t>>>(startbit);
 		case 64:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<boost::uint64_t,boost::uint64_t,SwapPolicyNone<boost::uint64_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<boost::uint64_t,boost::uint64_t,SwapPolicyNone<boost::uint64_t>>>(startbit);
 		default:
 			throw std::logic_error("not valid");
 		}
@@ -646,13 +1598,13 @@ static boost::shared_ptr<BufferHandler::DataHandler> CreateAlignedDataHandler(un
 		switch(sizeInBits)
 		{
 		case 8:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<boost::int8_t,boost::uint8_t,SwapPolicyNone<boost::uint8_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<boost::int8_t,boost::uint8_t,SwapPolicyNone<boost::uint8_t>>>(startbit);
 		case 16:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<boost::int16_t,boost::uint16_t,SwapPolicyNone<boost::uint16_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<boost::int16_t,boost::uint16_t,SwapPolicyNone<boost::uint16_t>>>(startbit);
 		case 32:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<boost::int32_t,boost::uint32_t,SwapPolicyNone<boost::uint32_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<boost::int32_t,boost::uint32_t,SwapPolicyNone<boost::uint32_t>>>(startbit);
 		case 64:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<boost::int64_t,boost::uint64_t,SwapPolicyNone<boost::uint64_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<boost::int64_t,boost::uint64_t,SwapPolicyNone<boost::uint64_t>>>(startbit);
 		default:
 			throw std::logic_error("not valid");
 		}
@@ -660,9 +1612,9 @@ static boost::shared_ptr<BufferHandler::DataHandler> CreateAlignedDataHandler(un
 		switch(sizeInBits)
 		{
 		case 32:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<float,boost::uint32_t,SwapPolicyNone<boost::uint32_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<float,boost::uint32_t,SwapPolicyNone<boost::uint32_t>>>(startbit);
 		case 64:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<double,boost::uint64_t,SwapPolicyNone<boost::uint64_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<double,boost::uint64_t,SwapPolicyNone<boost::uint64_t>>>(startbit);
 		default:
 			throw std::logic_error("not valid");
 		}
@@ -670,13 +1622,13 @@ static boost::shared_ptr<BufferHandler::DataHandler> CreateAlignedDataHandler(un
 		switch(sizeInBits)
 		{
 		case 8:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<boost::uint8_t,boost::uint8_t,SwapPolicySwap<boost::uint8_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<boost::uint8_t,boost::uint8_t,SwapPolicySwap<boost::uint8_t>>>(startbit);
 		case 16:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<boost::uint16_t,boost::uint16_t,SwapPolicySwap<boost::uint16_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<boost::uint16_t,boost::uint16_t,SwapPolicySwap<boost::uint16_t>>>(startbit);
 		case 32:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<boost::uint32_t,boost::uint32_t,SwapPolicySwap<boost::uint32_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<boost::uint32_t,boost::uint32_t,SwapPolicySwap<boost::uint32_t>>>(startbit);
 		case 64:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<boost::uint64_t,boost::uint64_t,SwapPolicySwap<boost::uint64_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<boost::uint64_t,boost::uint64_t,SwapPolicySwap<boost::uint64_t>>>(startbit);
 		default:
 			throw std::logic_error("not valid");
 		}
@@ -684,13 +1636,13 @@ static boost::shared_ptr<BufferHandler::DataHandler> CreateAlignedDataHandler(un
 		switch(sizeInBits)
 		{
 		case 8:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<boost::int8_t,boost::uint8_t,SwapPolicySwap<boost::uint8_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<boost::int8_t,boost::uint8_t,SwapPolicySwap<boost::uint8_t>>>(startbit);
 		case 16:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<boost::int16_t,boost::uint16_t,SwapPolicySwap<boost::uint16_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<boost::int16_t,boost::uint16_t,SwapPolicySwap<boost::uint16_t>>>(startbit);
 		case 32:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<boost::int32_t,boost::uint32_t,SwapPolicySwap<boost::uint32_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<boost::int32_t,boost::uint32_t,SwapPolicySwap<boost::uint32_t>>>(startbit);
 		case 64:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<boost::int64_t,boost::uint64_t,SwapPolicySwap<boost::uint64_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<boost::int64_t,boost::uint64_t,SwapPolicySwap<boost::uint64_t>>>(startbit);
 		default:
 			throw std::logic_error("not valid");
 		}
@@ -698,9 +1650,9 @@ static boost::shared_ptr<BufferHandler::DataHandler> CreateAlignedDataHandler(un
 		switch(sizeInBits)
 		{
 		case 32:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<float,boost::uint32_t,SwapPolicySwap<boost::uint32_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<float,boost::uint32_t,SwapPolicySwap<boost::uint32_t>>>(startbit);
 		case 64:
-			return boost::shared_ptr<BufferHandler::DataHandler>(new AlignedDataHandler<double,boost::uint64_t,SwapPolicySwap<boost::uint64_t>>(startbit));
+			return factory.template Create<AlignedDataHandler<double,boost::uint64_t,SwapPolicySwap<boost::uint64_t>>>(startbit);
 		default:
 			throw std::logic_error("not valid");
 		}
@@ -710,17 +1662,132 @@ static boost::shared_ptr<BufferHandler::DataHandler> CreateAlignedDataHandler(un
 }
 
 
+template<typename copyPolicy, template<typename> class bitExtraction, typename Factory>
+typename Factory::Result CreateGenericDataHandler(Factory& factory, unsigned int startbit, unsigned int sizeInBits, BufferHandler::DataType type)
+{
+	switch (type)
+	{
+	case (BufferHandler::UnsignedIntegerLittleEndian):
+		{
+			if (sizeInBits+(startbit%8)<=32)
+			{
+				typedef Implementation::GenericHandler<boost::uint32_t,boost::uint32_t,bitExtraction<Implementation::EndianessPolicyNoSwap<boost::uint32_t>>,Implementation::SignExtensionPolicyNone<boost::uint32_t>,copyPolicy> Handler;
+				return factory.template Create<Handler>(startbit, sizeInBits);
+			}
+			else
+			{
+				typedef Implementation::GenericHandler<boost::uint64_t,boost::uint64_t,bitExtraction<Implementation::EndianessPolicyNoSwap<boost::uint64_t>>,Implementation::SignExtensionPolicyNone<boost::uint64_t>,copyPolicy> Handler;
+				return factory.template Create<Handler>(startbit, sizeInBits);
+			}
+		}
+	case (BufferHandler::UnsignedIntegerBigEndian):
+		{
+			if (sizeInBits+(startbit%8)<=32)
+			{
+				typedef Implementation::GenericHandler<boost::uint32_t,boost::uint32_t,bitExtraction<Implementation::EndianessPolicySwap<boost::uint32_t>>,Implementation::SignExtensionPolicyNone<boost::uint32_t>,copyPolicy> Handler;
+				return factory.template Create<Handler>(startbit, sizeInBits);
+			}
+			else
+			{
+				typedef Implementation::GenericHandler<boost::uint64_t,boost::uint64_t,bitExtraction<Implementation::EndianessPolicySwap<boost::uint64_t>>,Implementation::SignExtensionPolicyNone<boost::uint64_t>,copyPolicy> Handler;
+				return factory.template Create<Handler>(startbit, sizeInBits);
+			}
+		}
+	case (BufferHandler::SignedIntegerLittleEndian):
+		{
+			if (sizeInBits+(startbit%8)<=32)
+			{
+				typedef Implementation::GenericHandler<boost::int32_t,boost::int32_t,bitExtraction<Implementation::EndianessPolicyNoSwap<boost::uint32_t>>,Implementation::SignExtensionPolicyExtend<boost::uint32_t>,copyPolicy> Handler;
+				return factory.template Create<Handler>(startbit, sizeInBits);
+			}
+			else
+			{
+				typedef Implementation::GenericHandler<boost::int64_t,boost::int64_t,bitExtraction<Implementation::EndianessPolicyNoSwap<boost::uint64_t>>,Implementation::SignExtensionPolicyExtend<boost::uint64_t>,copyPolicy> Handler;
+				return factory.template Create<Handler>(startbit, sizeInBits);
+			}
+		}
+	case (BufferHandler::SignedIntegerBigEndian):
+		{
+			if (sizeInBits+(startbit%8)<=32)
+			{
+				typedef Implementation::GenericHandler<boost::int32_t,boost::int32_t,bitExtraction<Implementation::EndianessPolicySwap<boost::uint32_t>>,Implementation::SignExtensionPolicyExtend<boost::uint32_t>,copyPolicy> Handler;
+				return factory.template Create<Handler>(startbit, sizeInBits);
+			}
+			else
+			{
+				typedef Implementation::GenericHandler<boost::int64_t,boost::int64_t,bitExtraction<Implementation::EndianessPolicySwap<boost::uint64_t>>,Implementation::SignExtensionPolicyExtend<boost::uint64_t>,copyPolicy> Handler;
+				return factory.template Create<Handler>(startbit, sizeInBits);
+			}
+		}
+	case (BufferHandler::FloatLittleEndian):
+		{
+			//if (sizeInBits+(startbit%8)<=32) --> can't happen as floats are always 32 bits and startbit%8 == 0 is aligned
+			if (sizeInBits == 32)
+			{
+				typedef Implementation::GenericHandler<boost::int64_t,float,bitExtraction<Implementation::EndianessPolicyNoSwap<boost::uint64_t>>,Implementation::SignExtensionPolicyExtend<boost::uint64_t>,copyPolicy> Handler;
+				return factory.template Create<Handler>(startbit, sizeInBits);
+			}
+			else
+			{
+				typedef Implementation::GenericHandler<boost::int64_t,double,bitExtraction<Implementation::EndianessPolicyNoSwap<boost::uint64_t>>,Implementation::SignExtensionPolicyExtend<boost::uint64_t>,copyPolicy> Handler;
+				return factory.template Create<Handler>(startbit, sizeInBits);
+			}
+		}
+	case (BufferHandler::FloatBigEndian):
+		{
+			//if (sizeInBits+(startbit%8)<=32) --> can't happen as floats are always 32 bits and startbit%8 == 0 is aligned
+			if (sizeInBits == 32)
+			{
+				typedef Implementation::GenericHandler<boost::int64_t,float,bitExtraction<Implementation::EndianessPolicySwap<boost::uint64_t>>,Implementation::SignExtensionPolicyExtend<boost::uint64_t>,copyPolicy> Handler;
+				return factory.template Create<Handler>(startbit, sizeInBits);
+			}
+			else
+			{
+				typedef Implementation::GenericHandler<boost::int64_t,double,bitExtraction<Implementation::EndianessPolicySwap<boost::uint64_t>>,Implementation::SignExtensionPolicyExtend<boost::uint64_t>,copyPolicy> Handler;
+				return factory.template Create<Handler>(startbit, sizeInBits);
+			}
+		}
+	default:
+		return factory.Empty();
+	}
+}
 
-#pragma warning( pop )
+template<typename copyPolicy, template<typename> class bitExtraction>
+boost::shared_ptr<BufferHandler::DataHandler> CreateGenericDataHandler(unsigned int startbit, unsigned int sizeInBits, BufferHandler::DataType type)
+{
+	SharedHandlerFactory factory;
+	return CreateGenericDataHandler<copyPolicy, bitExtraction>(factory, startbit, sizeInBits, type);
+}
+
+/**
+Creates the generic handler used by \ref CreateBufferHandler. This is the scalar backend unless
+BUFFERHANDLER_GENERIC_BMI2 is defined: a single field pays a call per PEXT/PDEP because the target("bmi2") functions
+can't be inlined into the handler, and PEXT is microcoded on AMD CPUs before Zen 3. \ref DecodePlan compiles its
+whole loop for BMI2 instead and doesn't have this problem.
+*/
+template<typename copyPolicy, typename Factory>
+typename Factory::Result CreateGenericDataHandlerForCpu(Factory& factory, unsigned int startbit, unsigned int sizeInBits, BufferHandler::DataType type)
+{
+#if defined(BUFFERHANDLER_BMI2_BACKEND) && defined(BUFFERHANDLER_GENERIC_BMI2)
+	if (CpuSupportsBmi2())
+	{
+		return CreateGenericDataHandler<copyPolicy, BitExtractionBmi2>(factory, startbit, sizeInBits, type);
+	}
+#endif
+	return CreateGenericDataHandler<copyPolicy, BitExtractionScalar>(factory, startbit, sizeInBits, type);
 }
 
-static boost::shared_ptr<BufferHandler::DataHandler> CreateBufferHandler(unsigned int startbit, unsigned int sizeInBits, BufferHandler::DataType type)
+/**
+Selects the handler for a field, see \ref CreateBufferHandler. The handler is constructed by the factory, which
+returns its Result type for the handler and Empty() if the field can't be handled.
+*/
+template<typename Factory>
+typename Factory::Result CreateHandler(Factory& factory, unsigned int startbit, unsigned int sizeInBits, BufferHandler::DataType type, BufferHandler::BufferPadding padding)
 {
 	if (sizeInBits == 0)
 	{
-		//this could be done as SingleInstance for the ZeroDataHandler
-		//but the drawback would be that this isn't threadsafe anymore.
-		return boost::shared_ptr<Implementation::ZeroDataHandler>(new Implementation::ZeroDataHandler());
+		//use a HandlerCache (HandlerCache.h) to share a single ZeroDataHandler between all fields
+		return factory.template Create<ZeroDataHandler>();
 	}
 	else if (sizeInBits == 1)
 	{
@@ -728,10 +1795,12 @@ static boost::shared_ptr<BufferHandler::DataHandler> CreateBufferHandler(unsigne
 		{
 		case (BufferHandler::UnsignedIntegerBigEndian):
 		case (BufferHandler::UnsignedIntegerLittleEndian):
-			return boost::shared_ptr<Implementation::BitDataHandler<Implementation::SignPolicyUnsigned>>(new Implementation::BitDataHandler<Implementation::SignPolicyUnsigned>(startbit));
+		case (BufferHandler::FloatBigEndian): //a single bit float is a flag
+		case (BufferHandler::FloatLittleEndian):
+			return factory.template Create<BitDataHandler<SignPolicyUnsigned>>(startbit);
 		case (BufferHandler::SignedIntegerBigEndian):
 		case (BufferHandler::SignedIntegerLittleEndian):
-			return boost::shared_ptr<Implementation::BitDataHandler<Implementation::SignPolicySigned>>(new Implementation::BitDataHandler<Implementation::SignPolicySigned>(startbit));
+			return factory.template Create<BitDataHandler<SignPolicySigned>>(startbit);
 		}
 		
 	}
@@ -739,7 +1808,7 @@ static boost::shared_ptr<BufferHandler::DataHandler> CreateBufferHandler(unsigne
 	{
 		try
 		{
-			return Implementation::CreateAlignedDataHandler(startbit, sizeInBits, type);
+			return CreateAlignedDataHandler(factory, startbit, sizeInBits, type);
 		} 
 		catch(const std::logic_error&)
 		{
@@ -748,96 +1817,32 @@ static boost::shared_ptr<BufferHandler::DataHandler> CreateBufferHandler(unsigne
 	}
 	else
 	{
-		switch (type)
+		switch (padding)
 		{
-		case (BufferHandler::UnsignedIntegerLittleEndian):
-			{
-				if (sizeInBits+(startbit%8)<=32)
-				{
-					typedef Implementation::GenericHandler<boost::uint32_t,boost::uint32_t,Implementation::EndianessPolicyNoSwap<boost::uint32_t>,Implementation::SignExtensionPolicyNone<boost::uint32_t>> Handler;
-					return boost::shared_ptr<Handler>(new Handler(startbit,sizeInBits));
-				}
-				else
-				{
-					typedef Implementation::GenericHandler<boost::uint64_t,boost::uint64_t,Implementation::EndianessPolicyNoSwap<boost::uint64_t>,Implementation::SignExtensionPolicyNone<boost::uint64_t>> Handler;
-					return boost::shared_ptr<Handler>(new Handler(startbit,sizeInBits));
-				}
-			}
-		case (BufferHandler::UnsignedIntegerBigEndian):
-			{
-				if (sizeInBits+(startbit%8)<=32)
-				{
-					typedef Implementation::GenericHandler<boost::uint32_t,boost::uint32_t,Implementation::EndianessPolicySwap<boost::uint32_t>,Implementation::SignExtensionPolicyNone<boost::uint32_t>> Handler;
-					return boost::shared_ptr<Handler>(new Handler(startbit,sizeInBits));
-				}
-				else
-				{
-					typedef Implementation::GenericHandler<boost::uint64_t,boost::uint64_t,Implementation::EndianessPolicySwap<boost::uint64_t>,Implementation::SignExtensionPolicyNone<boost::uint64_t>> Handler;
-					return boost::shared_ptr<Handler>(new Handler(startbit,sizeInBits));
-				}
-			}
-		case (BufferHandler::SignedIntegerLittleEndian):
-			{
-				if (sizeInBits+(startbit%8)<=32)
-				{
-					typedef Implementation::GenericHandler<boost::int32_t,boost::int32_t,Implementation::EndianessPolicyNoSwap<boost::uint32_t>,Implementation::SignExtensionPolicyExtend<boost::uint32_t>> Handler;
-					return boost::shared_ptr<Handler>(new Handler(startbit,sizeInBits));
-				}
-				else
-				{
-					typedef Implementation::GenericHandler<boost::int64_t,boost::int64_t,Implementation::EndianessPolicyNoSwap<boost::uint64_t>,Implementation::SignExtensionPolicyExtend<boost::uint64_t>> Handler;
-					return boost::shared_ptr<Handler>(new Handler(startbit,sizeInBits));
-				}
-			}
-		case (BufferHandler::SignedIntegerBigEndian):
-			{
-				if (sizeInBits+(startbit%8)<=32)
-				{
-					typedef Implementation::GenericHandler<boost::int32_t,boost::int32_t,Implementation::EndianessPolicySwap<boost::uint32_t>,Implementation::SignExtensionPolicyExtend<boost::uint32_t>> Handler;
-					return boost::shared_ptr<Handler>(new Handler(startbit,sizeInBits));
-				}
-				else
-				{
-					typedef Implementation::GenericHandler<boost::int64_t,boost::int64_t,Implementation::EndianessPolicySwap<boost::uint64_t>,Implementation::SignExtensionPolicyExtend<boost::uint64_t>> Handler;
-					return boost::shared_ptr<Handler>(new Handler(startbit,sizeInBits));
-				}
-			}
-		case (BufferHandler::FloatLittleEndian):
-			{
-				//if (sizeInBits+(startbit%8)<=32) --> can't happen as floats are always 32 bits and startbit%8 == 0 is aligned
-				if (sizeInBits == 32)
-				{
-					typedef Implementation::GenericHandler<boost::int64_t,float,Implementation::EndianessPolicyNoSwap<boost::uint64_t>,Implementation::SignExtensionPolicyExtend<boost::uint64_t>> Handler;
-					return boost::shared_ptr<Handler>(new Handler(startbit,sizeInBits));
-				}
-				else
-				{
-					typedef Implementation::GenericHandler<boost::int64_t,double,Implementation::EndianessPolicyNoSwap<boost::uint64_t>,Implementation::SignExtensionPolicyExtend<boost::uint64_t>> Handler;
-					return boost::shared_ptr<Handler>(new Handler(startbit,sizeInBits));
-				}
-			}
-		case (BufferHandler::FloatBigEndian):
-			{
-				//if (sizeInBits+(startbit%8)<=32) --> can't happen as floats are always 32 bits and startbit%8 == 0 is aligned
-				if (sizeInBits == 32)
-				{
-					typedef Implementation::GenericHandler<boost::int64_t,float,Implementation::EndianessPolicySwap<boost::uint64_t>,Implementation::SignExtensionPolicyExtend<boost::uint64_t>> Handler;
-					return boost::shared_ptr<Handler>(new Handler(startbit,sizeInBits));
-				}
-				else
-				{
-					typedef Implementation::GenericHandler<boost::int64_t,double,Implementation::EndianessPolicySwap<boost::uint64_t>,Implementation::SignExtensionPolicyExtend<boost::uint64_t>> Handler;
-					return boost::shared_ptr<Handler>(new Handler(startbit,sizeInBits));
-				}
-			}
+		case BufferHandler::PaddedBuffer:
+			return CreateGenericDataHandlerForCpu<CopyPolicyPadded>(factory, startbit, sizeInBits, type);
 		default:
-			return boost::shared_ptr<BufferHandler::DataHandler>();
+			return CreateGenericDataHandlerForCpu<CopyPolicyExact>(factory, startbit, sizeInBits, type);
 		}
 	}
-	//nothing found, return empty pointer
-	return boost::shared_ptr<BufferHandler::DataHandler>();
+	//nothing found, return empty result
+	return factory.Empty();
 }
 
+#pragma warning( pop )
+}
+
+inline boost::shared_ptr<BufferHandler::DataHandler> CreateBufferHandler(unsigned int startbit, unsigned int sizeInBits, BufferHandler::DataType type, BufferHandler::BufferPadding padding)
+{
+	Implementation::SharedHandlerFactory factory;
+	return Implementation::CreateHandler(factory, startbit, sizeInBits, type, padding);
 }
 
-#endif
\ No newline at end of file
+inline boost::shared_ptr<BufferHandler::DataHandler> CreateBufferHandler(unsigned int startbit, unsigned int sizeInBits, BufferHandler::DataType type)
+{
+	return CreateBufferHandler(startbit, sizeInBits, type, BufferHandler::ExactBuffer);
+}
+
+}
+
+#endif
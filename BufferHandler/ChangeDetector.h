@@ -0,0 +1,245 @@
+#ifndef CHANGEDETECTOR_H
+#define CHANGEDETECTOR_H
+/*
+Copyright (c) 2012, Tobias Langner
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include "BufferHandler.h"
+#include "DecodePlan.h"
+
+namespace BufferHandler
+{
+
+namespace Implementation
+{
+
+/**
+Computes the bits of the buffer a field occupies, as a 64bit mask in buffer byte order (byte i of the mask is the byte
+startbit/8+i of the buffer). Big endian fields are laid out like \ref EndianessPolicySwap: the lowest value bit is bit
+startbit%8 of the last byte, 1bit fields are the same for both endianesses.
+@throw std::invalid_argument if the field spans more than 8 bytes
+*/
+inline boost::uint64_t FieldFootprint(const FieldDescriptor& field)
+{
+	const unsigned int bytes = (field.startbit % 8 + field.sizeInBits + 7) / 8;
+	if (bytes > sizeof(boost::uint64_t))
+	{
+		throw std::invalid_argument("field spans more than 8 bytes");
+	}
+	if (field.sizeInBits == 0)
+	{
+		return 0;
+	}
+	const boost::uint64_t mask = field.sizeInBits == 64 ? ~static_cast<boost::uint64_t>(0) : (static_cast<boost::uint64_t>(1) << field.sizeInBits) - 1;
+	const bool bigEndian = field.sizeInBits > 1 && (field.type == SignedIntegerBigEndian || field.type == UnsignedIntegerBigEndian || field.type == FloatBigEndian);
+	if (bigEndian)
+	{
+		return Swap64(mask << ((sizeof(boost::uint64_t) - bytes) * 8 + field.startbit % 8));
+	}
+	return mask << (field.startbit % 8);
+}
+
+/**
+Loads the 8 bytes starting at offset, offset+8 must not exceed the buffer.
+*/
+inline boost::uint64_t LoadFullWord(const unsigned char* buffer, size_t offset)
+{
+	boost::uint64_t word;
+	memcpy(&word, buffer + offset, sizeof(word));
+	return word;
+}
+
+/**
+Loads up to 8 bytes starting at offset, the bytes beyond the end of the buffer are 0.
+*/
+inline boost::uint64_t LoadWord(const unsigned char* buffer, size_t bufferSize, size_t offset)
+{
+	boost::uint64_t word = 0;
+	memcpy(&word, buffer + offset, std::min<size_t>(sizeof(word), bufferSize - offset));
+	return word;
+}
+
+/**
+A field inside of a word of the change detector.
+*/
+struct ChangeField
+{
+	unsigned int index;
+	boost::uint64_t footprint; //bits of the field inside of the word
+};
+
+/**
+One 64bit comparison of the change detector, covering the fields in [firstField, firstField+fieldCount).
+*/
+struct ChangeWord
+{
+	unsigned int byteOffset;
+	boost::uint64_t footprint; //bits of all fields of the word
+	unsigned int firstField;
+	unsigned int fieldCount;
+};
+
+}
+
+/**
+Finds the fields that differ between two buffers of the same layout without decoding them. The footprints of the
+fields (the bits they occupy) are merged into as few 64bit words as possible. Both buffers are XORed word by word in a
+single pass over blocks of up to 64 words. The XOR and AND of a block are free of branches, so the compiler unrolls and
+vectorizes them, and a block without differences is skipped as a whole. Only the fields of words with differing bits
+inside of their footprint are examined, each with a single AND.
+*/
+class ChangeDetector
+{
+	std::vector<Implementation::ChangeWord> m_words;
+	std::vector<Implementation::ChangeField> m_fields;
+	size_t m_fieldCount;
+	size_t m_extent;
+
+public:
+	/**
+	Creates the detector for the given fields.
+	@param fields layout of the buffers. The changed fields are reported by their index in this vector.
+	@throw std::invalid_argument if one of the fields spans more than 8 bytes
+	*/
+	explicit ChangeDetector(const std::vector<FieldDescriptor>& fields)
+		: m_fieldCount(fields.size())
+		, m_extent(0)
+	{
+		std::vector<std::pair<unsigned int, unsigned int>> order; //first byte, index
+		for (unsigned int i=0; i<fields.size(); ++i)
+		{
+			if (Implementation::FieldFootprint(fields[i]) != 0)
+			{
+				order.push_back(std::make_pair(fields[i].startbit / 8, i));
+			}
+		}
+		std::sort(order.begin(), order.end());
+		for (size_t i=0; i<order.size(); ++i)
+		{
+			const FieldDescriptor& field = fields[order[i].second];
+			const unsigned int firstByte = order[i].first;
+			const unsigned int lastByte = firstByte + (field.startbit % 8 + field.sizeInBits + 7) / 8 - 1;
+			m_extent = std::max<size_t>(m_extent, lastByte + 1);
+			if (m_words.empty() || lastByte >= m_words.back().byteOffset + sizeof(boost::uint64_t))
+			{
+				Implementation::ChangeWord word = { firstByte, 0, static_cast<unsigned int>(m_fields.size()), 0 };
+				m_words.push_back(word);
+			}
+			Implementation::ChangeWord& word = m_words.back();
+			Implementation::ChangeField changeField = { order[i].second, Implementation::FieldFootprint(field) << ((firstByte - word.byteOffset) * 8) };
+			word.footprint |= changeField.footprint;
+			++word.fieldCount;
+			m_fields.push_back(changeField);
+		}
+	}
+
+	/**
+	@return number of fields
+	*/
+	size_t FieldCount() const { return m_fieldCount; }
+
+	/**
+	@return number of 64bit comparisons per pair of buffers
+	*/
+	size_t WordCount() const { return m_words.size(); }
+
+	/**
+	@return minimum size of the compared buffers, one past the last byte of any field
+	*/
+	size_t Extent() const { return m_extent; }
+
+	/**
+	Compares two buffers.
+	@param previous first buffer
+	@param current second buffer
+	@param bufferSize size of both buffers
+	@param changed receives the indices of the fields that differ, in ascending order
+	@return number of changed fields
+	@throw std::out_of_range if the buffers are smaller than \ref Extent
+	*/
+	size_t ChangedFields(const unsigned char* previous, const unsigned char* current, size_t bufferSize, std::vector<unsigned int>& changed) const
+	{
+		if (bufferSize < m_extent)
+		{
+			throw std::out_of_range("buffer is smaller than the fields");
+		}
+		changed.clear();
+		//the words are sorted by their offset, only the last ones can reach beyond the end of the buffer
+		size_t fullWords = m_words.size();
+		while (fullWords > 0 && m_words[fullWords-1].byteOffset + sizeof(boost::uint64_t) > bufferSize)
+		{
+			--fullWords;
+		}
+		boost::uint64_t diffs[64];
+		for (size_t first=0; first<m_words.size(); first+=64)
+		{
+			const size_t n = std::min<size_t>(64, m_words.size() - first);
+			const size_t full = std::min(n, fullWords > first ? fullWords - first : 0);
+			const Implementation::ChangeWord* words = &m_words[first];
+			boost::uint64_t any = 0;
+			for (size_t i=0; i<full; ++i)
+			{
+				diffs[i] = (Implementation::LoadFullWord(previous, words[i].byteOffset) ^ Implementation::LoadFullWord(current, words[i].byteOffset)) & words[i].footprint;
+				any |= diffs[i];
+			}
+			for (size_t i=full; i<n; ++i)
+			{
+				assert(words[i].byteOffset < bufferSize);
+				diffs[i] = (Implementation::LoadWord(previous, bufferSize, words[i].byteOffset) ^ Implementation::LoadWord(current, bufferSize, words[i].byteOffset)) & words[i].footprint;
+				any |= diffs[i];
+			}
+			if (any == 0)
+			{
+				continue;
+			}
+			for (size_t i=0; i<n; ++i)
+			{
+				if (diffs[i] == 0)
+				{
+					continue;
+				}
+				const Implementation::ChangeField* field = &m_fields[words[i].firstField];
+				for (const Implementation::ChangeField* end = field + words[i].fieldCount; field != end; ++field)
+				{
+					if ((diffs[i] & field->footprint) != 0)
+					{
+						changed.push_back(field->index);
+					}
+				}
+			}
+		}
+		std::sort(changed.begin(), changed.end());
+		return changed.size();
+	}
+};
+
+}
+
+#endif
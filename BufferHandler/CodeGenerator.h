@@ -0,0 +1,328 @@
+#ifndef CODEGENERATOR_H
+#define CODEGENERATOR_H
+/*
+Copyright (c) 2012, Tobias Langner
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+#include <string>
+#include <vector>
+#include <set>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include "BufferHandler.h"
+#include "Schema.h"
+
+namespace BufferHandler
+{
+
+namespace Implementation
+{
+
+inline bool IsIdentifier(const std::string& name)
+{
+	if (name.empty() || (name[0] >= '0' && name[0] <= '9'))
+	{
+		return false;
+	}
+	for (size_t i=0; i<name.size(); ++i)
+	{
+		const char c = name[i];
+		if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+inline bool IsBigEndianType(DataType type)
+{
+	return type == SignedIntegerBigEndian || type == UnsignedIntegerBigEndian || type == FloatBigEndian;
+}
+
+inline bool IsFloatType(DataType type)
+{
+	return type == FloatLittleEndian || type == FloatBigEndian;
+}
+
+inline bool IsSignedType(DataType type)
+{
+	return type == SignedIntegerLittleEndian || type == SignedIntegerBigEndian;
+}
+
+/**
+@return the smallest C++ type that holds the decoded value of the field
+*/
+inline std::string GeneratedType(const FieldDescriptor& field)
+{
+	if (IsFloatType(field.type))
+	{
+		return field.sizeInBits == 32 ? "float" : "double";
+	}
+	const unsigned int bits = field.sizeInBits <= 8 ? 8 : field.sizeInBits <= 16 ? 16 : field.sizeInBits <= 32 ? 32 : 64;
+	std::ostringstream type;
+	type << (IsSignedType(field.type) ? "boost::int" : "boost::uint") << bits << "_t";
+	return type.str();
+}
+
+inline std::string HexLiteral(boost::uint64_t value)
+{
+	std::ostringstream literal;
+	literal << "0x" << std::hex << std::uppercase << value << "ULL";
+	return literal.str();
+}
+
+/**
+Describes where the bits of a field are. The bytes of the field are assembled into a 64bit word, in buffer order for
+little endian fields (\ref EndianessPolicyNoSwap) and in reverse order for big endian fields (\ref EndianessPolicySwap).
+In both cases the value starts at bit startbit%8 of the word.
+*/
+struct GeneratedField
+{
+	explicit GeneratedField(const FieldDescriptor& field)
+		: firstByte(field.startbit / 8)
+		, bytes((field.startbit % 8 + field.sizeInBits + 7) / 8)
+		, shift(field.startbit % 8)
+		, mask(field.sizeInBits == 64 ? ~static_cast<boost::uint64_t>(0) : (static_cast<boost::uint64_t>(1) << field.sizeInBits) - 1)
+		, bigEndian(field.sizeInBits > 1 && IsBigEndianType(field.type))
+	{}
+
+	/**
+	@return the buffer index of the byte that holds the bits 8*i to 8*i+7 of the word
+	*/
+	unsigned int ByteOfWord(unsigned int i) const { return firstByte + (bigEndian ? bytes - 1 - i : i); }
+
+	unsigned int firstByte;
+	unsigned int bytes;
+	unsigned int shift;
+	boost::uint64_t mask;
+	bool bigEndian;
+};
+
+inline void GenerateLoad(std::ostream& out, const GeneratedField& field)
+{
+	out << "\tword = ";
+	for (unsigned int i=0; i<field.bytes; ++i)
+	{
+		if (i == 0)
+		{
+			out << "static_cast<boost::uint64_t>(buffer[" << field.ByteOfWord(i) << "])";
+		}
+		else
+		{
+			out << " | (static_cast<boost::uint64_t>(buffer[" << field.ByteOfWord(i) << "]) << " << 8*i << ")";
+		}
+	}
+	out << ";\n";
+}
+
+inline void GenerateStore(std::ostream& out, const GeneratedField& field)
+{
+	for (unsigned int i=0; i<field.bytes; ++i)
+	{
+		out << "\tbuffer[" << field.ByteOfWord(i) << "] = static_cast<unsigned char>(word";
+		if (i != 0)
+		{
+			out << " >> " << 8*i;
+		}
+		out << ");\n";
+	}
+}
+
+inline void GenerateDecodeField(std::ostream& out, const SchemaSignal& signal)
+{
+	const FieldDescriptor& field = signal.field;
+	const std::string type = GeneratedType(field);
+	if (field.sizeInBits == 0)
+	{
+		out << "\tmessage." << signal.name << " = 0;\n";
+		return;
+	}
+	const GeneratedField location(field);
+	GenerateLoad(out, location);
+	out << "\traw = ";
+	if (location.shift != 0)
+	{
+		out << "(word >> " << location.shift << ")";
+	}
+	else
+	{
+		out << "word";
+	}
+	if (field.sizeInBits != 64)
+	{
+		out << " & " << HexLiteral(location.mask);
+	}
+	out << ";\n";
+	if (IsFloatType(field.type) && field.sizeInBits != 1)
+	{
+		out << "\t{\n\t\tboost::uint" << field.sizeInBits << "_t bits = static_cast<boost::uint" << field.sizeInBits << "_t>(raw);\n";
+		out << "\t\tmemcpy(&message." << signal.name << ", &bits, sizeof(bits));\n\t}\n";
+	}
+	else if (IsSignedType(field.type) && field.sizeInBits != 64)
+	{
+		const std::string sign = HexLiteral(static_cast<boost::uint64_t>(1) << (field.sizeInBits - 1));
+		out << "\tmessage." << signal.name << " = static_cast<" << type << ">(static_cast<boost::int64_t>((raw ^ " << sign << ") - " << sign << "));\n";
+	}
+	else
+	{
+		out << "\tmessage." << signal.name << " = static_cast<" << type << ">(raw);\n";
+	}
+}
+
+inline void GenerateEncodeField(std::ostream& out, const SchemaSignal& signal)
+{
+	const FieldDescriptor& field = signal.field;
+	if (field.sizeInBits == 0)
+	{
+		return;
+	}
+	const GeneratedField location(field);
+	if (field.sizeInBits == 1)
+	{
+		//a single bit is a flag, set by every value other than 0 like BitDataHandler
+		out << "\traw = message." << signal.name << " != 0 ? 1 : 0;\n";
+	}
+	else if (IsFloatType(field.type))
+	{
+		out << "\t{\n\t\tboost::uint" << field.sizeInBits << "_t bits;\n";
+		out << "\t\tmemcpy(&bits, &message." << signal.name << ", sizeof(bits));\n\t\traw = bits;\n\t}\n";
+	}
+	else
+	{
+		out << "\traw = static_cast<boost::uint64_t>(message." << signal.name << ")";
+		if (field.sizeInBits != 64)
+		{
+			out << " & " << HexLiteral(location.mask);
+		}
+		out << ";\n";
+	}
+	if (location.shift == 0 && field.sizeInBits == location.bytes * 8)
+	{
+		out << "\tword = raw;\n"; //the field covers all bits of its bytes
+	}
+	else
+	{
+		GenerateLoad(out, location);
+		out << "\tword = (word & ~" << HexLiteral(location.mask << location.shift) << ") | ";
+		if (location.shift != 0)
+		{
+			out << "(raw << " << location.shift << ");\n";
+		}
+		else
+		{
+			out << "raw;\n";
+		}
+	}
+	GenerateStore(out, location);
+}
+
+}
+
+/**
+Writes a C++ header with one struct, one decode and one encode function per message of the schema. The functions
+contain the shifts, masks and byte order of every signal as constants, without any call through a handler. The bits
+are extracted like \ref EndianessPolicyNoSwap / \ref EndianessPolicySwap and sign extended like
+\ref SignExtensionPolicyExtend, so the generated code reads and writes the same bits as the handlers created by
+\ref CreateBufferHandler. Multiplexed signals are decoded and encoded unconditionally.
+
+The generated header depends on boost/cstdint.hpp and cstring only.
+@param schema messages to generate the code for
+@param namespaceName namespace of the generated code
+@param guard include guard of the generated header
+@param out receives the header
+@throw std::invalid_argument if a name is not a valid C++ identifier or is used twice in a message, or a signal spans more than 8 bytes
+*/
+inline void GenerateCode(const Schema& schema, const std::string& namespaceName, const std::string& guard, std::ostream& out)
+{
+	if (!Implementation::IsIdentifier(namespaceName) || !Implementation::IsIdentifier(guard))
+	{
+		throw std::invalid_argument("invalid namespace or include guard");
+	}
+	out << "// generated by BufferHandlerGen, do not edit\n";
+	out << "#ifndef " << guard << "\n#define " << guard << "\n";
+	out << "#include <cstring>\n#include <boost/cstdint.hpp>\n\n";
+	out << "namespace " << namespaceName << "\n{\n";
+	std::set<std::string> messageNames;
+	for (size_t m=0; m<schema.Messages().size(); ++m)
+	{
+		const SchemaMessage& message = schema.Messages()[m];
+		std::set<std::string> names;
+		names.insert("MessageId");
+		names.insert("MessageSize");
+		if (!Implementation::IsIdentifier(message.name) || !messageNames.insert(message.name).second || !names.insert(message.name).second)
+		{
+			throw std::invalid_argument("invalid message name " + message.name);
+		}
+		for (size_t s=0; s<message.signals.size(); ++s)
+		{
+			const SchemaSignal& signal = message.signals[s];
+			if (!Implementation::IsIdentifier(signal.name) || !names.insert(signal.name).second)
+			{
+				throw std::invalid_argument("invalid signal name " + signal.name);
+			}
+			if ((signal.field.startbit % 8 + signal.field.sizeInBits + 7) / 8 > sizeof(boost::uint64_t) ||
+				(Implementation::IsFloatType(signal.field.type) && signal.field.sizeInBits != 32 && signal.field.sizeInBits != 64))
+			{
+				throw std::invalid_argument("signal " + signal.name + " can't be generated");
+			}
+		}
+
+		out << "\nstruct " << message.name << "\n{\n";
+		out << "\tstatic const unsigned int MessageId = " << message.id << "u;\n";
+		out << "\tstatic const unsigned int MessageSize = " << message.size << "u;\n\n";
+		for (size_t s=0; s<message.signals.size(); ++s)
+		{
+			out << "\t" << Implementation::GeneratedType(message.signals[s].field) << " " << message.signals[s].name << ";\n";
+		}
+		out << "};\n\n";
+
+		out << "/**\nDecodes all signals of " << message.name << ".\n@param buffer buffer with at least " << message.size << " bytes\n@param message receives the signals\n*/\n";
+		out << "inline void Decode(const unsigned char* buffer, " << message.name << "& message)\n{\n";
+		out << "\tboost::uint64_t word = 0, raw = 0;\n";
+		for (size_t s=0; s<message.signals.size(); ++s)
+		{
+			Implementation::GenerateDecodeField(out, message.signals[s]);
+		}
+		out << "\t(void)buffer; (void)word; (void)raw;\n}\n\n";
+
+		out << "/**\nEncodes all signals of " << message.name << ", the bits outside of the signals are not changed.\n@param message signals to be written\n@param buffer buffer with at least " << message.size << " bytes\n*/\n";
+		out << "inline void Encode(const " << message.name << "& message, unsigned char* buffer)\n{\n";
+		out << "\tboost::uint64_t word = 0, raw = 0;\n";
+		for (size_t s=0; s<message.signals.size(); ++s)
+		{
+			Implementation::GenerateEncodeField(out, message.signals[s]);
+		}
+		out << "\t(void)message; (void)buffer; (void)word; (void)raw;\n}\n";
+	}
+	out << "\n}\n\n#endif\n";
+}
+
+}
+
+#endif
@@ -0,0 +1,411 @@
+#ifndef DECODEPLAN_H
+#define DECODEPLAN_H
+
+/*
+Copyright (c) 2012, Tobias Langner
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+#include <vector>
+#include <algorithm>
+#include "BufferHandler.h"
+
+namespace BufferHandler
+{
+
+/**
+Describes the location and type of one field inside a buffer. These are the same parameters that are passed to
+\ref CreateBufferHandler.
+*/
+struct FieldDescriptor
+{
+	FieldDescriptor(unsigned int startbit_, unsigned int sizeInBits_, DataType type_)
+		: startbit(startbit_)
+		, sizeInBits(sizeInBits_)
+		, type(type_)
+	{}
+
+	unsigned int startbit;
+	unsigned int sizeInBits;
+	DataType type;
+};
+
+namespace Implementation
+{
+
+/**
+How the extracted bits of a field are interpreted.
+*/
+enum PlanFieldKind
+{
+	PlanUnsigned,
+	PlanSigned,
+	PlanFloat,
+	PlanDouble
+};
+
+/**
+A field that is extracted from a 64bit word of the plan using shift and mask.
+*/
+struct PlanField
+{
+	unsigned int outputIndex;
+	unsigned int bigEndian; //index into the (little endian, big endian) pair of the word
+	unsigned int shift;
+	boost::uint64_t mask;
+	boost::uint64_t fieldBits; //mask at the position of the field inside of the word, used with PEXT
+	boost::uint64_t signBit;
+	PlanFieldKind kind;
+};
+
+/**
+One 64bit load of the plan. All fields in [firstField, firstField+fieldCount) are extracted from this word.
+*/
+struct PlanWord
+{
+	unsigned int byteOffset;
+	bool needsSwap;
+	unsigned int firstField;
+	unsigned int fieldCount;
+};
+
+/**
+A field that can't be extracted from a word directly. It is read through its handler.
+*/
+struct PlanFallback
+{
+	unsigned int outputIndex;
+	boost::shared_ptr<BufferHandler::DataHandler> handler;
+};
+
+inline void ReadFallback(const BufferHandler::DataHandler& handler, const unsigned char* buffer, size_t bufferSize, double* value)
+{
+	*value = handler.ReadD(buffer, bufferSize);
+}
+
+inline void ReadFallback(const BufferHandler::DataHandler& handler, const unsigned char* buffer, size_t bufferSize, boost::int64_t* value)
+{
+	*value = handler.ReadI64(buffer, bufferSize);
+}
+
+/**
+Loads the (little endian, big endian) pair of a plan word from the buffer.
+*/
+inline void LoadPlanWord(const PlanWord& word, const unsigned char* buffer, size_t bufferSize, boost::uint64_t* source)
+{
+	assert(word.byteOffset < bufferSize);
+	source[0] = 0;
+	source[1] = 0;
+	if (word.byteOffset + sizeof(boost::uint64_t) <= bufferSize)
+	{
+		memcpy(&source[0], buffer+word.byteOffset, sizeof(boost::uint64_t));
+	}
+	else
+	{
+		//the last word of a short buffer, copy only what is available
+		memcpy(&source[0], buffer+word.byteOffset, bufferSize - word.byteOffset);
+	}
+	if (word.needsSwap)
+	{
+		source[1] = BufferHandler::Swap64(source[0]);
+	}
+}
+
+template<typename Out>
+inline Out ConvertPlanValue(const PlanField& field, boost::uint64_t bits)
+{
+	switch (field.kind)
+	{
+	case PlanSigned:
+		//branch free sign extension, works for all sizes from 1 to 64 bits
+		return static_cast<Out>(static_cast<boost::int64_t>((bits ^ field.signBit) - field.signBit));
+	case PlanFloat:
+		{
+			return static_cast<Out>(BitCast<float>(static_cast<boost::uint32_t>(bits)));
+		}
+	case PlanDouble:
+		return static_cast<Out>(BitCast<double>(bits));
+	default:
+		return static_cast<Out>(bits);
+	}
+}
+
+}
+
+/**
+Decodes all fields of a message layout in one pass. The fields are sorted by their byte offset and grouped into as few
+64bit words as possible. Each word is loaded once and byte swapped at most once, all fields inside of the word are
+then extracted using precomputed shifts and masks (or PEXT if the CPU supports BMI2). The few fields that don't map
+to a plain integer or float (e.g. a 16bit float) are read through the handler created by \ref CreateBufferHandler.
+
+The plan is immutable after construction and can be shared between threads.
+*/
+class DecodePlan
+{
+	std::vector<Implementation::PlanWord> m_words;
+	std::vector<Implementation::PlanField> m_fields;
+	std::vector<Implementation::PlanFallback> m_fallbacks;
+	std::vector<unsigned int> m_zeroFields;
+	size_t m_fieldCount;
+	size_t m_extent;
+	bool m_useBmi2;
+
+	template<typename Out>
+	void Decode(const unsigned char* buffer, size_t bufferSize, Out* values) const;
+	template<typename Out>
+	void DecodeWords(const unsigned char* buffer, size_t bufferSize, Out* values) const;
+#if defined(BUFFERHANDLER_BMI2_BACKEND)
+	template<typename Out>
+	BUFFERHANDLER_TARGET_BMI2 void DecodeWordsBmi2(const unsigned char* buffer, size_t bufferSize, Out* values) const;
+#endif
+
+public:
+	/**
+	Creates the plan for the given fields.
+	@param fields layout of the message. The decoded values are written in the same order.
+	@param allowBmi2 use PEXT for the extraction if the CPU supports it
+	@throw std::invalid_argument if one of the fields spans more than 8 bytes or can't be decoded by any handler
+	*/
+	explicit DecodePlan(const std::vector<FieldDescriptor>& fields, bool allowBmi2 = true);
+
+	/**
+	@return number of fields (and size of the output array)
+	*/
+	size_t FieldCount() const { return m_fieldCount; }
+
+	/**
+	@return number of 64bit words that are loaded per decoded buffer
+	*/
+	size_t WordCount() const { return m_words.size(); }
+
+	/**
+	@return minimum size of the decoded buffers, one past the last byte of any field
+	*/
+	size_t Extent() const { return m_extent; }
+
+	/**
+	@return true if the fields are extracted with the BMI2 instructions
+	*/
+	bool UsesBmi2() const { return m_useBmi2; }
+
+	/**
+	Decodes all fields and converts them to 64bit double.
+	@param buffer buffer to be read from
+	@param bufferSize size of the buffer
+	@param values output array with one entry per field, in the order the fields were passed at construction
+	@throw std::out_of_range if the buffer is smaller than \ref Extent
+	*/
+	void DecodeD(const unsigned char* buffer, size_t bufferSize, double* values) const { Decode(buffer, bufferSize, values); }
+
+	/**
+	Decodes all fields and converts them to 64bit integer.
+	@param buffer buffer to be read from
+	@param bufferSize size of the buffer
+	@param values output array with one entry per field, in the order the fields were passed at construction
+	@throw std::out_of_range if the buffer is smaller than \ref Extent
+	*/
+	void DecodeI64(const unsigned char* buffer, size_t bufferSize, boost::int64_t* values) const { Decode(buffer, bufferSize, values); }
+};
+
+namespace Implementation
+{
+
+struct PlanEntry
+{
+	unsigned int outputIndex;
+	unsigned int firstByte;
+	unsigned int lastByte;
+	FieldDescriptor descriptor;
+
+	bool operator<(const PlanEntry& other) const { return firstByte < other.firstByte; }
+};
+
+/**
+Builds the layout shared by \ref DecodePlan and \ref EncodePlan: the fields sorted by their first byte and packed
+into as few 64bit words as possible, plus the fields that have to go through their handler and the 0bit fields.
+@return minimum buffer size, one past the last byte of any field
+@throw std::invalid_argument if one of the fields spans more than 8 bytes or isn't supported by any handler
+*/
+inline size_t BuildPlanLayout(const std::vector<FieldDescriptor>& fields, std::vector<PlanWord>& words, std::vector<PlanField>& planFields,
+	std::vector<PlanFallback>& fallbacks, std::vector<unsigned int>& zeroFields)
+{
+	std::vector<PlanEntry> entries;
+	size_t extent = 0;
+	for (unsigned int i=0; i<fields.size(); ++i)
+	{
+		const FieldDescriptor& field = fields[i];
+		unsigned int bytesToCopy = (field.sizeInBits + field.startbit%8 + 7) / 8;
+		if (bytesToCopy > sizeof(boost::uint64_t))
+		{
+			throw std::invalid_argument("field spans more than 8 bytes");
+		}
+		auto handler = CreateBufferHandler(field.startbit, field.sizeInBits, field.type);
+		if (!handler)
+		{
+			throw std::invalid_argument("field is not supported by any handler");
+		}
+		if (field.sizeInBits == 0)
+		{
+			zeroFields.push_back(i);
+			continue;
+		}
+		extent = std::max<size_t>(extent, field.startbit/8 + bytesToCopy);
+		bool isFloat = field.type == FloatLittleEndian || field.type == FloatBigEndian;
+		if (isFloat && field.sizeInBits != 1 && field.sizeInBits != 32 && field.sizeInBits != 64)
+		{
+			//floats of other sizes are reinterpreted by the generic handler, keep its exact behavior
+			PlanFallback fallback = { i, handler };
+			fallbacks.push_back(fallback);
+			continue;
+		}
+		PlanEntry entry = { i, field.startbit/8, field.startbit/8 + bytesToCopy - 1, field };
+		entries.push_back(entry);
+	}
+	std::stable_sort(entries.begin(), entries.end());
+
+	for (size_t i=0; i<entries.size(); ++i)
+	{
+		const PlanEntry& entry = entries[i];
+		if (words.empty() || entry.lastByte >= words.back().byteOffset + sizeof(boost::uint64_t))
+		{
+			PlanWord word = { entry.firstByte, false, static_cast<unsigned int>(planFields.size()), 0 };
+			words.push_back(word);
+		}
+		PlanWord& word = words.back();
+		const FieldDescriptor& d = entry.descriptor;
+		bool bigEndian = d.type == SignedIntegerBigEndian || d.type == UnsignedIntegerBigEndian || d.type == FloatBigEndian;
+
+		PlanField field;
+		field.outputIndex = entry.outputIndex;
+		field.bigEndian = bigEndian ? 1 : 0;
+		if (bigEndian)
+		{
+			//same alignment as EndianessPolicySwap: the lowest value bit is bit startbit%8 of the last byte
+			field.shift = (sizeof(boost::uint64_t) - 1 - (entry.lastByte - word.byteOffset))*8 + d.startbit%8;
+		}
+		else
+		{
+			field.shift = d.startbit - word.byteOffset*8;
+		}
+		field.mask = d.sizeInBits == 64 ? ~static_cast<boost::uint64_t>(0) : (static_cast<boost::uint64_t>(1) << d.sizeInBits) - 1;
+		field.fieldBits = field.mask << field.shift;
+		field.signBit = 0;
+		if (d.sizeInBits == 1 || (d.type != FloatLittleEndian && d.type != FloatBigEndian))
+		{
+			field.kind = PlanUnsigned;
+			if (d.type == SignedIntegerLittleEndian || d.type == SignedIntegerBigEndian)
+			{
+				field.kind = PlanSigned;
+				field.signBit = static_cast<boost::uint64_t>(1) << (d.sizeInBits - 1);
+			}
+		}
+		else
+		{
+			field.kind = d.sizeInBits == 32 ? PlanFloat : PlanDouble;
+		}
+		word.needsSwap |= bigEndian;
+		++word.fieldCount;
+		planFields.push_back(field);
+	}
+	return extent;
+}
+
+}
+
+inline DecodePlan::DecodePlan(const std::vector<FieldDescriptor>& fields, bool allowBmi2)
+	: m_fieldCount(fields.size())
+	, m_extent(0)
+	, m_useBmi2(allowBmi2 && Implementation::CpuSupportsBmi2())
+{
+	m_extent = Implementation::BuildPlanLayout(fields, m_words, m_fields, m_fallbacks, m_zeroFields);
+}
+
+template<typename Out>
+void DecodePlan::DecodeWords(const unsigned char* buffer, size_t bufferSize, Out* values) const
+{
+	for (size_t w=0; w<m_words.size(); ++w)
+	{
+		const Implementation::PlanWord& word = m_words[w];
+		boost::uint64_t source[2];
+		Implementation::LoadPlanWord(word, buffer, bufferSize, source);
+		const Implementation::PlanField* field = &m_fields[word.firstField];
+		for (const Implementation::PlanField* end = field + word.fieldCount; field != end; ++field)
+		{
+			boost::uint64_t bits = (source[field->bigEndian] >> field->shift) & field->mask;
+			values[field->outputIndex] = Implementation::ConvertPlanValue<Out>(*field, bits);
+		}
+	}
+}
+
+#if defined(BUFFERHANDLER_BMI2_BACKEND)
+template<typename Out>
+void DecodePlan::DecodeWordsBmi2(const unsigned char* buffer, size_t bufferSize, Out* values) const
+{
+	for (size_t w=0; w<m_words.size(); ++w)
+	{
+		const Implementation::PlanWord& word = m_words[w];
+		boost::uint64_t source[2];
+		Implementation::LoadPlanWord(word, buffer, bufferSize, source);
+		const Implementation::PlanField* field = &m_fields[word.firstField];
+		for (const Implementation::PlanField* end = field + word.fieldCount; field != end; ++field)
+		{
+			boost::uint64_t bits = Implementation::Pext(source[field->bigEndian], field->fieldBits);
+			values[field->outputIndex] = Implementation::ConvertPlanValue<Out>(*field, bits);
+		}
+	}
+}
+#endif
+
+template<typename Out>
+void DecodePlan::Decode(const unsigned char* buffer, size_t bufferSize, Out* values) const
+{
+	if (bufferSize < m_extent)
+	{
+		throw std::out_of_range("buffer is smaller than the plan");
+	}
+#if defined(BUFFERHANDLER_BMI2_BACKEND)
+	if (m_useBmi2)
+	{
+		DecodeWordsBmi2(buffer, bufferSize, values);
+	}
+	else
+#endif
+	{
+		DecodeWords(buffer, bufferSize, values);
+	}
+	for (size_t i=0; i<m_fallbacks.size(); ++i)
+	{
+		Implementation::ReadFallback(*m_fallbacks[i].handler, buffer, bufferSize, &values[m_fallbacks[i].outputIndex]);
+	}
+	for (size_t i=0; i<m_zeroFields.size(); ++i)
+	{
+		values[m_zeroFields[i]] = 0;
+	}
+}
+
+}
+
+#endif
@@ -0,0 +1,226 @@
+#ifndef ENCODEPLAN_H
+#define ENCODEPLAN_H
+/*
+Copyright (c) 2012, Tobias Langner
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+#include <vector>
+#include <limits>
+#include "BufferHandler.h"
+#include "DecodePlan.h"
+
+namespace BufferHandler
+{
+
+namespace Implementation
+{
+
+/**
+Truncates value towards zero and saturates it to the range of a 64bit integer, the cast itself would be undefined
+for values out of range. NaN becomes 0. Negative values keep their two's complement pattern, so the signed and the
+unsigned fields share this conversion.
+*/
+inline boost::uint64_t SaturateToPlanBits(double value)
+{
+	if (value != value)
+	{
+		return 0;
+	}
+	if (value >= 18446744073709551616.0) //2^64
+	{
+		return ~static_cast<boost::uint64_t>(0);
+	}
+	if (value >= 9223372036854775808.0) //2^63, only representable unsigned
+	{
+		return static_cast<boost::uint64_t>(value);
+	}
+	if (value <= -9223372036854775808.0)
+	{
+		return static_cast<boost::uint64_t>(std::numeric_limits<boost::int64_t>::min());
+	}
+	return static_cast<boost::uint64_t>(static_cast<boost::int64_t>(value));
+}
+
+/**
+Converts an input value into the bits of a plan field, the inverse of \ref ConvertPlanValue. A single bit field is
+a flag that is set by every value other than 0, like \ref BitDataHandler.
+*/
+inline boost::uint64_t ConvertToPlanBits(const PlanField& field, double value)
+{
+	switch (field.kind)
+	{
+	case PlanFloat:
+		return BitCast<boost::uint32_t>(static_cast<float>(value));
+	case PlanDouble:
+		return BitCast<boost::uint64_t>(value);
+	default:
+		return field.mask == 1 ? (value != 0 ? 1 : 0) : SaturateToPlanBits(value);
+	}
+}
+
+inline boost::uint64_t ConvertToPlanBits(const PlanField& field, boost::int64_t value)
+{
+	switch (field.kind)
+	{
+	case PlanFloat:
+		return BitCast<boost::uint32_t>(static_cast<float>(value));
+	case PlanDouble:
+		return BitCast<boost::uint64_t>(static_cast<double>(value));
+	default:
+		return field.mask == 1 ? (value != 0 ? 1 : 0) : static_cast<boost::uint64_t>(value);
+	}
+}
+
+inline void WriteFallback(const BufferHandler::DataHandler& handler, double value, unsigned char* buffer, size_t bufferSize)
+{
+	handler.WriteD(value, buffer, bufferSize);
+}
+
+inline void WriteFallback(const BufferHandler::DataHandler& handler, boost::int64_t value, unsigned char* buffer, size_t bufferSize)
+{
+	handler.WriteI64(value, buffer, bufferSize);
+}
+
+}
+
+/**
+Encodes all fields of a message layout in one pass, the counterpart of \ref DecodePlan with the same layout of words.
+The fields of a word are shifted and masked into two registers (one for the little endian and one for the big endian
+fields), the big endian one is swapped once and the word is merged into the buffer with a single read-modify-write.
+Compared to one handler write per field this touches every byte once instead of once per field.
+
+Bits of the buffer that don't belong to any field are preserved. The plan is immutable after construction and can
+be shared between threads.
+*/
+class EncodePlan
+{
+	std::vector<Implementation::PlanWord> m_words;
+	std::vector<Implementation::PlanField> m_fields;
+	std::vector<Implementation::PlanFallback> m_fallbacks;
+	std::vector<unsigned int> m_zeroFields;
+	std::vector<boost::uint64_t> m_wordMasks; //bits of all fields of a word, in buffer byte order
+	size_t m_fieldCount;
+	size_t m_extent;
+
+	template<typename In>
+	void Encode(const In* values, unsigned char* buffer, size_t bufferSize) const;
+
+public:
+	/**
+	Creates the plan for the given fields.
+	@param fields layout of the message. The values are expected in the same order.
+	@throw std::invalid_argument if one of the fields spans more than 8 bytes or can't be encoded by any handler
+	*/
+	explicit EncodePlan(const std::vector<FieldDescriptor>& fields);
+
+	/**
+	@return number of fields (and size of the input array)
+	*/
+	size_t FieldCount() const { return m_fieldCount; }
+
+	/**
+	@return number of read-modify-writes per frame
+	*/
+	size_t WordCount() const { return m_words.size(); }
+
+	/**
+	@return minimum size of the encoded buffers, one past the last byte of any field
+	*/
+	size_t Extent() const { return m_extent; }
+
+	/**
+	Encodes all fields from 64bit doubles.
+	@param values input array with one entry per field, in the order the fields were passed at construction
+	@param buffer buffer to be written to
+	@param bufferSize size of the buffer
+	@throw std::out_of_range if the buffer is smaller than \ref Extent
+	*/
+	void EncodeD(const double* values, unsigned char* buffer, size_t bufferSize) const { Encode(values, buffer, bufferSize); }
+
+	/**
+	Encodes all fields from 64bit signed integers.
+	@param values input array with one entry per field, in the order the fields were passed at construction
+	@param buffer buffer to be written to
+	@param bufferSize size of the buffer
+	@throw std::out_of_range if the buffer is smaller than \ref Extent
+	*/
+	void EncodeI64(const boost::int64_t* values, unsigned char* buffer, size_t bufferSize) const { Encode(values, buffer, bufferSize); }
+};
+
+inline EncodePlan::EncodePlan(const std::vector<FieldDescriptor>& fields)
+	: m_fieldCount(fields.size())
+	, m_extent(0)
+{
+	m_extent = Implementation::BuildPlanLayout(fields, m_words, m_fields, m_fallbacks, m_zeroFields);
+	for (size_t w=0; w<m_words.size(); ++w)
+	{
+		const Implementation::PlanWord& word = m_words[w];
+		boost::uint64_t masks[2] = { 0, 0 };
+		for (unsigned int f=word.firstField; f<word.firstField+word.fieldCount; ++f)
+		{
+			masks[m_fields[f].bigEndian] |= m_fields[f].fieldBits;
+		}
+		m_wordMasks.push_back(masks[0] | Swap64(masks[1]));
+	}
+}
+
+template<typename In>
+void EncodePlan::Encode(const In* values, unsigned char* buffer, size_t bufferSize) const
+{
+	if (bufferSize < m_extent)
+	{
+		throw std::out_of_range("buffer is smaller than the plan");
+	}
+	for (size_t w=0; w<m_words.size(); ++w)
+	{
+		const Implementation::PlanWord& word = m_words[w];
+		assert(word.byteOffset < bufferSize);
+		//assemble the word in registers, little endian and big endian fields separately
+		boost::uint64_t bits[2] = { 0, 0 };
+		const Implementation::PlanField* field = &m_fields[word.firstField];
+		for (const Implementation::PlanField* end = field + word.fieldCount; field != end; ++field)
+		{
+			bits[field->bigEndian] |= (Implementation::ConvertToPlanBits(*field, values[field->outputIndex]) & field->mask) << field->shift;
+		}
+		const boost::uint64_t encoded = word.needsSwap ? bits[0] | Swap64(bits[1]) : bits[0];
+
+		//one read-modify-write, the last word of a short buffer only covers the available bytes
+		const size_t bytes = std::min<size_t>(sizeof(boost::uint64_t), bufferSize - word.byteOffset);
+		boost::uint64_t current = 0;
+		memcpy(&current, buffer + word.byteOffset, bytes);
+		current = (current & ~m_wordMasks[w]) | encoded;
+		memcpy(buffer + word.byteOffset, &current, bytes);
+	}
+	for (size_t i=0; i<m_fallbacks.size(); ++i)
+	{
+		Implementation::WriteFallback(*m_fallbacks[i].handler, values[m_fallbacks[i].outputIndex], buffer, bufferSize);
+	}
+}
+
+}
+
+#endif
@@ -0,0 +1,404 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+/*
+Copyright (c) 2012, Tobias Langner
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <stdexcept>
+#include <boost/noncopyable.hpp>
+#include "BufferHandler.h"
+#include "DecodePlan.h"
+
+namespace BufferHandler
+{
+
+/**
+Slot of a frame ring that is being written or read. The data stays inside of the ring, it is neither copied nor
+allocated per frame.
+*/
+struct FrameSlot
+{
+	FrameSlot() : data(0), size(0), position(0) {}
+
+	unsigned char* data; //first byte of the slot
+	size_t size; //size of the frame, set by the producer before \ref CommitWrite
+	size_t position; //position of the slot in the ring, used to commit / release it
+};
+
+namespace Implementation
+{
+
+const size_t CacheLineSize = 64;
+
+/**
+Preallocated, cache line aligned storage for the slots of a frame ring. Every slot is followed by at least 8 bytes of
+slack, so the frames fulfill the \ref PaddedBuffer contract.
+*/
+class FrameStorage
+{
+	std::vector<unsigned char> m_memory;
+	unsigned char* m_first;
+	size_t m_stride;
+	size_t m_mask;
+
+public:
+	FrameStorage(size_t capacity, size_t slotSize)
+		: m_first(0)
+		, m_stride((slotSize + sizeof(boost::uint64_t) + CacheLineSize - 1) / CacheLineSize * CacheLineSize)
+		, m_mask(capacity - 1)
+	{
+		if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+		{
+			throw std::invalid_argument("capacity must be a power of 2");
+		}
+		m_memory.resize(capacity * m_stride + CacheLineSize);
+		const size_t misalignment = reinterpret_cast<size_t>(&m_memory[0]) % CacheLineSize;
+		m_first = &m_memory[0] + (misalignment == 0 ? 0 : CacheLineSize - misalignment);
+	}
+
+	unsigned char* Slot(size_t position) const { return m_first + (position & m_mask) * m_stride; }
+	size_t Index(size_t position) const { return position & m_mask; }
+	size_t Capacity() const { return m_mask + 1; }
+};
+
+/**
+Cell of the MPMC ring: the sequence tells producers and consumers whose turn it is (see \ref MpmcFrameRing).
+*/
+struct MpmcCell
+{
+	std::atomic<size_t> sequence;
+	size_t size;
+};
+
+}
+
+/**
+Lock free ring of preallocated frame slots for exactly one producer and one consumer thread. The producer writes a
+frame directly into the slot returned by \ref TryBeginWrite and publishes it with \ref CommitWrite, the consumer reads
+it in place between \ref TryBeginRead and \ref EndRead. Each side has at most one slot open at a time. The frames are
+handed over in order.
+
+Both positions are on their own cache line, each side keeps a cached copy of the other position and only reloads it
+when the ring looks full / empty.
+*/
+class SpscFrameRing : boost::noncopyable
+{
+	Implementation::FrameStorage m_storage;
+	std::vector<size_t> m_sizes;
+	size_t m_slotSize;
+	char m_padding0[Implementation::CacheLineSize];
+	std::atomic<size_t> m_head; //next position to be written, owned by the producer
+	size_t m_cachedTail;
+	char m_padding1[Implementation::CacheLineSize - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+	std::atomic<size_t> m_tail; //next position to be read, owned by the consumer
+	size_t m_cachedHead;
+	char m_padding2[Implementation::CacheLineSize - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+
+public:
+	/**
+	@param capacity number of slots, must be a power of 2
+	@param slotSize maximum size of a frame
+	@throw std::invalid_argument if the capacity is not a power of 2
+	*/
+	SpscFrameRing(size_t capacity, size_t slotSize)
+		: m_storage(capacity, slotSize)
+		, m_sizes(capacity, 0)
+		, m_slotSize(slotSize)
+		, m_head(0)
+		, m_cachedTail(0)
+		, m_tail(0)
+		, m_cachedHead(0)
+	{
+	}
+
+	/**
+	@return number of slots
+	*/
+	size_t Capacity() const { return m_storage.Capacity(); }
+
+	/**
+	@return maximum size of a frame
+	*/
+	size_t SlotSize() const { return m_slotSize; }
+
+	/**
+	Producer: opens the next free slot.
+	@param slot receives the slot to write the frame into
+	@return false if the ring is full
+	*/
+	bool TryBeginWrite(FrameSlot& slot)
+	{
+		const size_t head = m_head.load(std::memory_order_relaxed);
+		if (head - m_cachedTail == Capacity())
+		{
+			m_cachedTail = m_tail.load(std::memory_order_acquire);
+			if (head - m_cachedTail == Capacity())
+			{
+				return false;
+			}
+		}
+		slot.data = m_storage.Slot(head);
+		slot.size = m_slotSize;
+		slot.position = head;
+		return true;
+	}
+
+	/**
+	Producer: publishes the slot opened by \ref TryBeginWrite.
+	@param slot the slot, with size set to the size of the frame
+	*/
+	void CommitWrite(const FrameSlot& slot)
+	{
+		assert(slot.size <= m_slotSize);
+		m_sizes[m_storage.Index(slot.position)] = slot.size;
+		m_head.store(slot.position + 1, std::memory_order_release);
+	}
+
+	/**
+	Consumer: opens the oldest frame.
+	@param slot receives the frame
+	@return false if the ring is empty
+	*/
+	bool TryBeginRead(FrameSlot& slot)
+	{
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail == m_cachedHead)
+		{
+			m_cachedHead = m_head.load(std::memory_order_acquire);
+			if (tail == m_cachedHead)
+			{
+				return false;
+			}
+		}
+		slot.data = m_storage.Slot(tail);
+		slot.size = m_sizes[m_storage.Index(tail)];
+		slot.position = tail;
+		return true;
+	}
+
+	/**
+	Consumer: releases the frame opened by \ref TryBeginRead, its slot can be reused by the producer.
+	*/
+	void EndRead(const FrameSlot& slot)
+	{
+		m_tail.store(slot.position + 1, std::memory_order_release);
+	}
+};
+
+/**
+Bounded lock free ring of preallocated frame slots for any number of producer and consumer threads. Every slot has a
+sequence number: a producer claims the slot at the enqueue position with one compare-and-swap if the sequence equals
+the position, a consumer claims the slot at the dequeue position if the sequence equals the position + 1. Publishing
+and releasing a slot is a single store of the next sequence. The frames are written and read in place, several slots
+may be open at the same time.
+*/
+class MpmcFrameRing : boost::noncopyable
+{
+	Implementation::FrameStorage m_storage;
+	std::vector<Implementation::MpmcCell> m_cells;
+	size_t m_slotSize;
+	char m_padding0[Implementation::CacheLineSize];
+	std::atomic<size_t> m_enqueuePosition;
+	char m_padding1[Implementation::CacheLineSize - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> m_dequeuePosition;
+	char m_padding2[Implementation::CacheLineSize - sizeof(std::atomic<size_t>)];
+
+public:
+	/**
+	@param capacity number of slots, must be a power of 2
+	@param slotSize maximum size of a frame
+	@throw std::invalid_argument if the capacity is not a power of 2
+	*/
+	MpmcFrameRing(size_t capacity, size_t slotSize)
+		: m_storage(capacity, slotSize)
+		, m_cells(capacity)
+		, m_slotSize(slotSize)
+		, m_enqueuePosition(0)
+		, m_dequeuePosition(0)
+	{
+		for (size_t i=0; i<capacity; ++i)
+		{
+			m_cells[i].sequence.store(i, std::memory_order_relaxed);
+			m_cells[i].size = 0;
+		}
+	}
+
+	/**
+	@return number of slots
+	*/
+	size_t Capacity() const { return m_storage.Capacity(); }
+
+	/**
+	@return maximum size of a frame
+	*/
+	size_t SlotSize() const { return m_slotSize; }
+
+	/**
+	Producer: claims a free slot.
+	@param slot receives the slot to write the frame into
+	@return false if the ring is full
+	*/
+	bool TryBeginWrite(FrameSlot& slot)
+	{
+		size_t position = m_enqueuePosition.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			const size_t sequence = m_cells[m_storage.Index(position)].sequence.load(std::memory_order_acquire);
+			const std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence - position);
+			if (difference == 0)
+			{
+				if (m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (difference < 0)
+			{
+				return false; //the slot still holds a frame from the previous round
+			}
+			else
+			{
+				position = m_enqueuePosition.load(std::memory_order_relaxed);
+			}
+		}
+		slot.data = m_storage.Slot(position);
+		slot.size = m_slotSize;
+		slot.position = position;
+		return true;
+	}
+
+	/**
+	Producer: publishes a slot claimed by \ref TryBeginWrite.
+	@param slot the slot, with size set to the size of the frame
+	*/
+	void CommitWrite(const FrameSlot& slot)
+	{
+		assert(slot.size <= m_slotSize);
+		Implementation::MpmcCell& cell = m_cells[m_storage.Index(slot.position)];
+		cell.size = slot.size;
+		cell.sequence.store(slot.position + 1, std::memory_order_release);
+	}
+
+	/**
+	Consumer: claims the oldest published frame.
+	@param slot receives the frame
+	@return false if there is no published frame
+	*/
+	bool TryBeginRead(FrameSlot& slot)
+	{
+		size_t position = m_dequeuePosition.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			const size_t sequence = m_cells[m_storage.Index(position)].sequence.load(std::memory_order_acquire);
+			const std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence - (position + 1));
+			if (difference == 0)
+			{
+				if (m_dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (difference < 0)
+			{
+				return false; //not published yet
+			}
+			else
+			{
+				position = m_dequeuePosition.load(std::memory_order_relaxed);
+			}
+		}
+		slot.data = m_storage.Slot(position);
+		slot.size = m_cells[m_storage.Index(position)].size;
+		slot.position = position;
+		return true;
+	}
+
+	/**
+	Consumer: releases a frame claimed by \ref TryBeginRead, its slot can be reused by the producers.
+	*/
+	void EndRead(const FrameSlot& slot)
+	{
+		m_cells[m_storage.Index(slot.position)].sequence.store(slot.position + Capacity(), std::memory_order_release);
+	}
+};
+
+/**
+Worker loop of a decode thread: takes the frames from the ring, decodes them in place with the plan and hands the
+values to the sink before the slot is released. Waits (yielding the CPU) while the ring is empty and returns once stop
+is set and no frame is left.
+@param ring \ref SpscFrameRing or \ref MpmcFrameRing
+@param plan layout of the frames
+@param values scratch array with plan.FieldCount() entries, receives the values of each frame
+@param sink called as sink(const FrameSlot& frame, const double* values) for every frame
+@param stop set by the producers after their last frame was committed
+@return number of decoded frames
+@throw std::out_of_range if a frame is smaller than the plan. The frame is released before this or any exception of
+the sink leaves the loop.
+*/
+template<typename Ring, typename Sink>
+size_t DecodeFrames(Ring& ring, const DecodePlan& plan, double* values, Sink sink, const std::atomic<bool>& stop)
+{
+	size_t frames = 0;
+	FrameSlot slot;
+	for (;;)
+	{
+		if (!ring.TryBeginRead(slot))
+		{
+			if (!stop.load(std::memory_order_acquire))
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			//the last frames may have been committed right before stop was set
+			if (!ring.TryBeginRead(slot))
+			{
+				return frames;
+			}
+		}
+		try
+		{
+			plan.DecodeD(slot.data, slot.size, values);
+			sink(static_cast<const FrameSlot&>(slot), static_cast<const double*>(values));
+		}
+		catch (...)
+		{
+			//release the slot, the ring would stall on it otherwise
+			ring.EndRead(slot);
+			throw;
+		}
+		ring.EndRead(slot);
+		++frames;
+	}
+}
+
+}
+
+#endif
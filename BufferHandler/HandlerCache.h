@@ -0,0 +1,143 @@
+#ifndef HANDLERCACHE_H
+#define HANDLERCACHE_H
+
+/*
+Copyright (c) 2012, Tobias Langner
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+#include <map>
+#include <mutex>
+#include "BufferHandler.h"
+
+namespace BufferHandler
+{
+
+/**
+Thread safe interning cache for the handlers created by \ref CreateBufferHandler. The handlers don't hold any state
+besides their (immutable) location and type, so one instance can be shared by every field with the same descriptor.
+For large schemas with many repeated (startbit, sizeInBits, type) triples this saves one allocation per field and
+keeps the handlers that are in use close together.
+
+Descriptors that result in the same handler are mapped to the same key: all fields with 0 bits share one
+ZeroDataHandler and 1bit fields share their handler regardless of the endianess.
+*/
+class HandlerCache
+{
+	struct Key
+	{
+		unsigned int startbit;
+		unsigned int sizeInBits;
+		DataType type;
+
+		bool operator<(const Key& other) const
+		{
+			if (startbit != other.startbit) return startbit < other.startbit;
+			if (sizeInBits != other.sizeInBits) return sizeInBits < other.sizeInBits;
+			return type < other.type;
+		}
+	};
+
+	mutable std::mutex m_mutex;
+	std::map<Key, boost::shared_ptr<DataHandler>> m_handlers;
+
+	static Key Normalize(unsigned int startbit, unsigned int sizeInBits, DataType type)
+	{
+		Key key = { startbit, sizeInBits, type };
+		if (sizeInBits == 0)
+		{
+			key.startbit = 0;
+			key.type = SignedIntegerLittleEndian;
+		}
+		else if (sizeInBits == 1)
+		{
+			switch (type)
+			{
+			case UnsignedIntegerBigEndian: key.type = UnsignedIntegerLittleEndian; break;
+			case SignedIntegerBigEndian: key.type = SignedIntegerLittleEndian; break;
+			case FloatBigEndian: key.type = FloatLittleEndian; break;
+			default: break;
+			}
+		}
+		return key;
+	}
+
+public:
+	/**
+	Returns the shared handler for the given field, creating it on first use. Same parameters and return value as
+	\ref CreateBufferHandler, including the empty pointer for fields that can't be handled.
+	*/
+	boost::shared_ptr<DataHandler> Get(unsigned int startbit, unsigned int sizeInBits, DataType type)
+	{
+		Key key = Normalize(startbit, sizeInBits, type);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto found = m_handlers.find(key);
+		if (found != m_handlers.end())
+		{
+			return found->second;
+		}
+		auto handler = CreateBufferHandler(key.startbit, key.sizeInBits, key.type);
+		m_handlers.insert(std::make_pair(key, handler));
+		return handler;
+	}
+
+	/**
+	@return number of distinct handlers in the cache
+	*/
+	size_t Size() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_handlers.size();
+	}
+
+	/**
+	Drops the references of the cache. Handlers that are still in use stay alive until their last user releases them.
+	*/
+	void Clear()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_handlers.clear();
+	}
+};
+
+/**
+Same as \ref CreateBufferHandler, but returns the shared handler from the cache if a field with the same descriptor
+was created before.
+
+@param startbit first bit of the data inside of the buffer
+@param sizeInBits number of bits for the data
+@param DataType determines how the data is interpreted (Integer / Float, Little or Big Endian)
+@param cache cache that holds the handlers created so far
+@return reader/writer for this field in the buffer
+*/
+inline boost::shared_ptr<DataHandler> CreateBufferHandler(unsigned int startbit, unsigned int sizeInBits, DataType type, HandlerCache& cache)
+{
+	return cache.Get(startbit, sizeInBits, type);
+}
+
+}
+
+#endif
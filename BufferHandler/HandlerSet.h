@@ -0,0 +1,265 @@
+#ifndef HANDLERSET_H
+#define HANDLERSET_H
+/*
+Copyright (c) 2012, Tobias Langner
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <stdexcept>
+#include <boost/noncopyable.hpp>
+#include "BufferHandler.h"
+#include "DecodePlan.h"
+
+namespace BufferHandler
+{
+
+namespace Implementation
+{
+
+/**
+Bump allocator for the handlers of a \ref HandlerSet. The handlers are placed one after the other into large blocks
+and destroyed together when the arena is cleared.
+*/
+class HandlerArena : boost::noncopyable
+{
+	struct Entry
+	{
+		const DataHandler* handler;
+		void (*destroy)(const DataHandler*);
+	};
+
+	std::vector<char*> m_blocks;
+	std::vector<Entry> m_entries;
+	size_t m_blockSize;
+	size_t m_used; //bytes used in the last block
+	size_t m_reserved;
+
+	template<typename Handler>
+	static void Destroy(const DataHandler* handler)
+	{
+		static_cast<const Handler*>(handler)->~Handler();
+	}
+
+	void* Allocate(size_t size, size_t alignment)
+	{
+		size_t offset = (m_used + alignment - 1) / alignment * alignment;
+		if (m_blocks.empty() || offset + size > m_blockSize)
+		{
+			m_blockSize = std::max(m_blockSize, size);
+			m_blocks.reserve(m_blocks.size() + 1);
+			m_blocks.push_back(new char[m_blockSize]); //aligned for every fundamental type
+			m_reserved += m_blockSize;
+			offset = 0;
+		}
+		m_used = offset + size;
+		return m_blocks.back() + offset;
+	}
+
+public:
+	/**
+	@param blockSize bytes per block, a handler takes between 16 and 64 bytes
+	*/
+	explicit HandlerArena(size_t blockSize)
+		: m_blockSize(blockSize), m_used(0), m_reserved(0)
+	{}
+
+	~HandlerArena()
+	{
+		Clear();
+	}
+
+	/**
+	Constructs a handler inside of the arena, the arena owns it until \ref Clear is called.
+	*/
+	template<typename Handler, typename... Args>
+	const DataHandler* Create(Args... args)
+	{
+		static_assert(alignof(Handler) <= alignof(std::max_align_t), "the blocks aren't aligned for this handler");
+		m_entries.reserve(m_entries.size() + 1); //can't fail after the handler is constructed
+		const Handler* handler = new (Allocate(sizeof(Handler), alignof(Handler))) Handler(args...);
+		Entry entry = { handler, &Destroy<Handler> };
+		m_entries.push_back(entry);
+		return handler;
+	}
+
+	/**
+	Destroys all handlers and frees the blocks at once.
+	*/
+	void Clear()
+	{
+		for (size_t i=m_entries.size(); i>0; --i)
+		{
+			m_entries[i-1].destroy(m_entries[i-1].handler);
+		}
+		m_entries.clear();
+		for (size_t i=0; i<m_blocks.size(); ++i)
+		{
+			delete[] m_blocks[i];
+		}
+		m_blocks.clear();
+		m_used = 0;
+		m_reserved = 0;
+	}
+
+	/**
+	@return number of bytes held by the blocks
+	*/
+	size_t BytesReserved() const
+	{
+		return m_reserved;
+	}
+};
+
+/**
+Factory for \ref CreateHandler that places the handlers into a \ref HandlerArena.
+*/
+struct ArenaHandlerFactory
+{
+	typedef const DataHandler* Result;
+
+	HandlerArena& arena;
+
+	explicit ArenaHandlerFactory(HandlerArena& arena_) : arena(arena_) {}
+
+	template<typename Handler, typename... Args>
+	Result Create(Args... args)
+	{
+		return arena.Create<Handler>(args...);
+	}
+
+	Result Empty()
+	{
+		return 0;
+	}
+};
+
+}
+
+/**
+Owns the handlers of a whole schema (or message) in one arena instead of one heap object and shared_ptr per field.
+The handlers are the same \ref CreateBufferHandler would return, placed one after the other in the order they were
+added, so iterating over the fields walks through memory linearly. The set hands out plain references that stay valid
+until the set is cleared or destroyed, copying them between threads doesn't touch any reference count.
+
+Adding handlers is not thread safe. Once the set is filled it is immutable and the handlers can be used by any number
+of threads.
+*/
+class HandlerSet : boost::noncopyable
+{
+	Implementation::HandlerArena m_arena;
+	std::vector<const DataHandler*> m_handlers;
+
+public:
+	/**
+	Creates an empty set.
+	@param blockSize bytes allocated at once for the handlers
+	*/
+	explicit HandlerSet(size_t blockSize = 4096)
+		: m_arena(blockSize)
+	{}
+
+	/**
+	Creates the handlers for all fields, in the same order.
+	@param fields layout of the buffer
+	@param padding guarantee of the caller about the memory behind the fields, see \ref BufferPadding
+	@throw std::invalid_argument if one of the fields can't be handled by any handler
+	*/
+	explicit HandlerSet(const std::vector<FieldDescriptor>& fields, BufferPadding padding = ExactBuffer)
+		: m_arena(std::max<size_t>(4096, fields.size() * 64)) //usually a single block
+	{
+		m_handlers.reserve(fields.size());
+		for (size_t i=0; i<fields.size(); ++i)
+		{
+			Add(fields[i].startbit, fields[i].sizeInBits, fields[i].type, padding);
+		}
+	}
+
+	/**
+	Creates the handler for a field and appends it to the set. Same parameters as \ref CreateBufferHandler.
+	@return the new handler, valid until the set is cleared or destroyed
+	@throw std::invalid_argument if the field can't be handled by any handler
+	*/
+	const DataHandler& Add(unsigned int startbit, unsigned int sizeInBits, DataType type, BufferPadding padding = ExactBuffer)
+	{
+		Implementation::ArenaHandlerFactory factory(m_arena);
+		const DataHandler* handler = Implementation::CreateHandler(factory, startbit, sizeInBits, type, padding);
+		if (!handler)
+		{
+			throw std::invalid_argument("field is not supported by any handler");
+		}
+		m_handlers.push_back(handler);
+		return *handler;
+	}
+
+	/**
+	@return handler of the field at index, in the order the fields were added
+	*/
+	const DataHandler& operator[](size_t index) const
+	{
+		assert(index < m_handlers.size());
+		return *m_handlers[index];
+	}
+
+	/**
+	@return number of handlers in the set
+	*/
+	size_t Size() const
+	{
+		return m_handlers.size();
+	}
+
+	/**
+	@return the handlers in the order they were added, e.g. to pass them to a loop without the set
+	*/
+	const std::vector<const DataHandler*>& Handlers() const
+	{
+		return m_handlers;
+	}
+
+	/**
+	Destroys all handlers at once. All references handed out before become invalid.
+	*/
+	void Clear()
+	{
+		m_handlers.clear();
+		m_arena.Clear();
+	}
+
+	/**
+	@return number of bytes allocated for the handlers
+	*/
+	size_t BytesReserved() const
+	{
+		return m_arena.BytesReserved();
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,234 @@
+#ifndef INCREMENTALDECODER_H
+#define INCREMENTALDECODER_H
+/*
+Copyright (c) 2012, Tobias Langner
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+#include <vector>
+#include <stdexcept>
+#include "BufferHandler.h"
+#include "ChangeDetector.h"
+
+namespace BufferHandler
+{
+
+/**
+Stateful decoder for buffers that change only in a few bytes between two decodes (e.g. the same frame sent
+cyclically). It keeps the last decoded value of every field, a copy of the last buffer and an index from every byte of
+the buffer to the fields that occupy it. Only the fields whose bits changed are decoded again, either found by
+comparing the new buffer with the copy (see \ref ChangeDetector) or given as dirty byte ranges by the caller.
+*/
+class IncrementalDecoder
+{
+	std::vector<boost::shared_ptr<DataHandler>> m_handlers;
+	std::vector<double> m_values;
+	std::vector<unsigned char> m_buffer;
+	std::vector<unsigned int> m_byteBegin; //fields of byte i are m_byteFields[m_byteBegin[i], m_byteBegin[i+1])
+	std::vector<unsigned int> m_byteFields;
+	std::vector<unsigned int> m_changed;
+	std::vector<unsigned int> m_lastDecode; //decode generation of every field, to skip duplicates of a range
+	unsigned int m_generation;
+	ChangeDetector m_detector;
+	bool m_valid;
+
+	void DecodeField(unsigned int index, const unsigned char* buffer)
+	{
+		m_values[index] = m_handlers[index]->ReadD(buffer, m_buffer.size());
+		m_changed.push_back(index);
+	}
+
+public:
+	/**
+	Creates the decoder, no value is decoded before the first call of \ref Update.
+	@param fields layout of the buffers. The values are stored in the same order.
+	@param bufferSize size of the buffers that will be decoded
+	@throw std::invalid_argument if one of the fields spans more than 8 bytes, exceeds the buffer or can't be decoded by any handler
+	*/
+	IncrementalDecoder(const std::vector<FieldDescriptor>& fields, size_t bufferSize)
+		: m_values(fields.size(), 0.0), m_buffer(bufferSize, 0), m_byteBegin(bufferSize + 1, 0),
+		m_lastDecode(fields.size(), 0), m_generation(0), m_detector(fields), m_valid(false)
+	{
+		for (size_t i=0; i<fields.size(); ++i)
+		{
+			const FieldDescriptor& field = fields[i];
+			if (field.startbit / 8 + (field.startbit % 8 + field.sizeInBits + 7) / 8 > bufferSize)
+			{
+				throw std::invalid_argument("field exceeds the buffer");
+			}
+			auto handler = CreateBufferHandler(field.startbit, field.sizeInBits, field.type);
+			if (!handler)
+			{
+				throw std::invalid_argument("field is not supported by any handler");
+			}
+			m_handlers.push_back(handler);
+		}
+		//counting sort of the (byte, field) pairs into the index
+		for (int pass=0; pass<2; ++pass)
+		{
+			std::vector<unsigned int> fill(m_byteBegin.begin(), m_byteBegin.end() - 1);
+			for (unsigned int i=0; i<fields.size(); ++i)
+			{
+				if (fields[i].sizeInBits == 0)
+				{
+					continue;
+				}
+				const unsigned int firstByte = fields[i].startbit / 8;
+				const unsigned int lastByte = firstByte + (fields[i].startbit % 8 + fields[i].sizeInBits + 7) / 8 - 1;
+				for (unsigned int b=firstByte; b<=lastByte; ++b)
+				{
+					if (pass == 0)
+					{
+						++m_byteBegin[b + 1];
+					}
+					else
+					{
+						m_byteFields[fill[b]++] = i;
+					}
+				}
+			}
+			if (pass == 0)
+			{
+				for (size_t b=0; b<bufferSize; ++b)
+				{
+					m_byteBegin[b + 1] += m_byteBegin[b];
+				}
+				m_byteFields.resize(m_byteBegin.back());
+			}
+		}
+	}
+
+	/**
+	@return number of fields
+	*/
+	size_t FieldCount() const { return m_values.size(); }
+
+	/**
+	@return size of the decoded buffers
+	*/
+	size_t BufferSize() const { return m_buffer.size(); }
+
+	/**
+	@param index index of the field in the descriptor vector passed at construction
+	@return last decoded value of the field (0 before the first update)
+	*/
+	double Value(size_t index) const { return m_values[index]; }
+
+	/**
+	@return last decoded values, one entry per field
+	*/
+	const std::vector<double>& Values() const { return m_values; }
+
+	/**
+	@return indices of the fields that were decoded by the last update, in ascending order for \ref Update
+	*/
+	const std::vector<unsigned int>& LastChanged() const { return m_changed; }
+
+	/**
+	Forgets the cached buffer, the next \ref Update decodes every field.
+	*/
+	void Invalidate() { m_valid = false; }
+
+	/**
+	Decodes the fields that differ from the previous buffer. The first call (and the first call after \ref Invalidate)
+	decodes every field.
+	@param buffer new buffer, \ref BufferSize bytes
+	@return number of fields that were decoded
+	*/
+	size_t Update(const unsigned char* buffer)
+	{
+		m_changed.clear();
+		if (!m_valid)
+		{
+			for (unsigned int i=0; i<m_handlers.size(); ++i)
+			{
+				DecodeField(i, buffer);
+			}
+			m_valid = true;
+		}
+		else
+		{
+			m_detector.ChangedFields(m_buffer.data(), buffer, m_buffer.size(), m_changed);
+			for (size_t i=0; i<m_changed.size(); ++i)
+			{
+				m_values[m_changed[i]] = m_handlers[m_changed[i]]->ReadD(buffer, m_buffer.size());
+			}
+		}
+		if (!m_buffer.empty())
+		{
+			memcpy(m_buffer.data(), buffer, m_buffer.size());
+		}
+		return m_changed.size();
+	}
+
+	/**
+	Decodes the fields that occupy the given bytes, without comparing the rest of the buffer. The caller guarantees
+	that all other bytes are the same as in the previous buffer. Falls back to \ref Update if nothing was decoded yet.
+	@param buffer new buffer, \ref BufferSize bytes
+	@param firstByte first byte that may have changed
+	@param byteCount number of bytes that may have changed
+	@return number of fields that were decoded
+	@throw std::out_of_range if the range exceeds the buffer
+	*/
+	size_t UpdateRange(const unsigned char* buffer, size_t firstByte, size_t byteCount)
+	{
+		if (firstByte > m_buffer.size() || byteCount > m_buffer.size() - firstByte)
+		{
+			throw std::out_of_range("dirty range exceeds the buffer");
+		}
+		if (!m_valid)
+		{
+			return Update(buffer);
+		}
+		m_changed.clear();
+		if (++m_generation == 0)
+		{
+			std::fill(m_lastDecode.begin(), m_lastDecode.end(), 0);
+			m_generation = 1;
+		}
+		for (size_t b=firstByte; b<firstByte+byteCount; ++b)
+		{
+			for (unsigned int f=m_byteBegin[b]; f<m_byteBegin[b + 1]; ++f)
+			{
+				const unsigned int index = m_byteFields[f];
+				if (m_lastDecode[index] != m_generation)
+				{
+					m_lastDecode[index] = m_generation;
+					DecodeField(index, buffer);
+				}
+			}
+		}
+		if (byteCount != 0)
+		{
+			memcpy(m_buffer.data() + firstByte, buffer + firstByte, byteCount);
+		}
+		return m_changed.size();
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,374 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+/*
+Copyright (c) 2012, Tobias Langner
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+#include <boost/cstdint.hpp>
+
+//counting of the handler calls, see HandlerStatistics. Define BUFFERHANDLER_INSTRUMENTATION to 1 to enable it, when it
+//is 0 (the default) the counting macros expand to nothing and the statistics stay empty. Like
+//BUFFERHANDLER_BOUNDS_CHECK it changes the handlers and must be the same in every translation unit.
+#if !defined(BUFFERHANDLER_INSTRUMENTATION)
+#define BUFFERHANDLER_INSTRUMENTATION 0
+#endif
+
+#if BUFFERHANDLER_INSTRUMENTATION
+#define BUFFERHANDLER_COUNT_CALL(kind, operation, values, bytes) ::BufferHandler::Implementation::CountCall(kind, operation, values, bytes)
+#define BUFFERHANDLER_COUNT_CREATE(kind) ::BufferHandler::Implementation::CountCreate(kind)
+#else
+#define BUFFERHANDLER_COUNT_CALL(kind, operation, values, bytes) ((void)0)
+#define BUFFERHANDLER_COUNT_CREATE(kind) ((void)0)
+#endif
+
+namespace BufferHandler
+{
+
+/**
+Implementations chosen by \ref CreateBufferHandler. The statistics are kept per implementation kind, not per handler
+object: all handlers of the same kind add to the same counters, no matter which field they decode.
+*/
+enum HandlerKind
+{
+	/** ZeroDataHandler, only the creation is counted */
+	ZeroHandlerKind,
+	/** BitDataHandler for single bit fields */
+	BitHandlerKind,
+	/** AlignedDataHandler for byte aligned 8/16/32/64bit fields */
+	AlignedHandlerKind,
+	/** GenericHandler that copies exactly the bytes of the field (memcpy) */
+	GenericExactHandlerKind,
+	/** GenericHandler with a fixed size copy on a \ref PaddedBuffer */
+	GenericPaddedHandlerKind,
+	HandlerKindCount
+};
+
+/**
+Counted operations. The batch operations (ReadXBatch and Aggregate) count one call for the whole batch.
+*/
+enum HandlerOperation
+{
+	ReadOperation,
+	WriteOperation,
+	BatchOperation,
+	HandlerOperationCount
+};
+
+/**
+@return name of the handler implementation as used in the dumps
+*/
+inline const char* HandlerKindName(HandlerKind kind)
+{
+	static const char* const names[HandlerKindCount] = { "zero", "bit", "aligned", "generic_exact", "generic_padded" };
+	return names[kind];
+}
+
+/**
+@return name of the operation as used in the dumps
+*/
+inline const char* HandlerOperationName(HandlerOperation operation)
+{
+	static const char* const names[HandlerOperationCount] = { "read", "write", "batch" };
+	return names[operation];
+}
+
+/**
+Counters of one operation of one handler implementation.
+*/
+struct HandlerCounter
+{
+	HandlerCounter() : calls(0), values(0), bytes(0) {}
+
+	/** number of calls */
+	boost::uint64_t calls;
+	/** number of values read or written, equal to calls except for the batches */
+	boost::uint64_t values;
+	/** number of buffer bytes loaded or stored */
+	boost::uint64_t bytes;
+};
+
+/**
+Call counts of all handlers of the process per \ref HandlerKind, see \ref CollectHandlerStatistics. Only filled if the
+library is compiled with BUFFERHANDLER_INSTRUMENTATION set to 1.
+*/
+struct HandlerStatistics
+{
+	HandlerStatistics()
+	{
+		std::fill(created, created + HandlerKindCount, 0);
+	}
+
+	/** counters of every operation of every handler implementation */
+	HandlerCounter counters[HandlerKindCount][HandlerOperationCount];
+	/** number of handlers created per implementation */
+	boost::uint64_t created[HandlerKindCount];
+
+	/**
+	@return counter of the operation for the handler implementation
+	*/
+	const HandlerCounter& Counter(HandlerKind kind, HandlerOperation operation) const
+	{
+		return counters[kind][operation];
+	}
+
+	/**
+	Writes one line per handler implementation and operation that was used.
+	@param out stream to write to
+	*/
+	void WriteText(std::ostream& out) const
+	{
+		for (int k=0; k<HandlerKindCount; ++k)
+		{
+			if (created[k] == 0 && counters[k][ReadOperation].calls == 0 && counters[k][WriteOperation].calls == 0 && counters[k][BatchOperation].calls == 0)
+			{
+				continue;
+			}
+			out << HandlerKindName(static_cast<HandlerKind>(k)) << ": created " << created[k] << "\n";
+			for (int o=0; o<HandlerOperationCount; ++o)
+			{
+				const HandlerCounter& counter = counters[k][o];
+				if (counter.calls != 0)
+				{
+					out << "  " << HandlerOperationName(static_cast<HandlerOperation>(o)) << ": calls " << counter.calls
+						<< ", values " << counter.values << ", bytes " << counter.bytes << "\n";
+				}
+			}
+		}
+	}
+
+	/**
+	Writes all counters as a JSON object with one member per handler implementation.
+	@param out stream to write to
+	*/
+	void WriteJson(std::ostream& out) const
+	{
+		out << "{";
+		for (int k=0; k<HandlerKindCount; ++k)
+		{
+			out << (k == 0 ? "\n" : ",\n") << "  \"" << HandlerKindName(static_cast<HandlerKind>(k)) << "\": {\"created\": " << created[k];
+			for (int o=0; o<HandlerOperationCount; ++o)
+			{
+				const HandlerCounter& counter = counters[k][o];
+				out << ", \"" << HandlerOperationName(static_cast<HandlerOperation>(o)) << "\": {\"calls\": " << counter.calls
+					<< ", \"values\": " << counter.values << ", \"bytes\": " << counter.bytes << "}";
+			}
+			out << "}";
+		}
+		out << "\n}\n";
+	}
+};
+
+namespace Implementation
+{
+
+/**
+Counters of one thread. Only the owning thread writes them, so a relaxed load and store is enough and no locked
+instruction is needed on the hot path. Other threads read them when the statistics are collected.
+*/
+class ThreadCounters
+{
+	std::atomic<boost::uint64_t> m_counters[HandlerKindCount][HandlerOperationCount][3]; //calls, values, bytes
+	std::atomic<boost::uint64_t> m_created[HandlerKindCount];
+
+	static void Bump(std::atomic<boost::uint64_t>& counter, boost::uint64_t n)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+public:
+	ThreadCounters();
+	~ThreadCounters();
+
+	void Count(HandlerKind kind, HandlerOperation operation, boost::uint64_t values, boost::uint64_t bytes)
+	{
+		std::atomic<boost::uint64_t>* counter = m_counters[kind][operation];
+		Bump(counter[0], 1);
+		Bump(counter[1], values);
+		Bump(counter[2], bytes);
+	}
+
+	void Create(HandlerKind kind)
+	{
+		Bump(m_created[kind], 1);
+	}
+
+	/**
+	Adds the current values of the counters to statistics.
+	*/
+	void AddTo(HandlerStatistics& statistics) const
+	{
+		for (int k=0; k<HandlerKindCount; ++k)
+		{
+			for (int o=0; o<HandlerOperationCount; ++o)
+			{
+				statistics.counters[k][o].calls += m_counters[k][o][0].load(std::memory_order_relaxed);
+				statistics.counters[k][o].values += m_counters[k][o][1].load(std::memory_order_relaxed);
+				statistics.counters[k][o].bytes += m_counters[k][o][2].load(std::memory_order_relaxed);
+			}
+			statistics.created[k] += m_created[k].load(std::memory_order_relaxed);
+		}
+	}
+};
+
+/**
+Process wide list of the thread counters. The counts of finished threads are kept in a total, a reset is a snapshot
+that is subtracted later, so the counters of running threads are never written by another thread.
+*/
+class InstrumentationRegistry
+{
+	std::mutex m_mutex;
+	std::vector<const ThreadCounters*> m_threads;
+	HandlerStatistics m_finished;
+	HandlerStatistics m_baseline;
+
+	HandlerStatistics Total() const
+	{
+		HandlerStatistics total = m_finished;
+		for (size_t i=0; i<m_threads.size(); ++i)
+		{
+			m_threads[i]->AddTo(total);
+		}
+		return total;
+	}
+
+public:
+	static InstrumentationRegistry& Instance()
+	{
+		static InstrumentationRegistry registry;
+		return registry;
+	}
+
+	void Register(const ThreadCounters* counters)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_threads.push_back(counters);
+	}
+
+	void Unregister(const ThreadCounters* counters)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		counters->AddTo(m_finished);
+		m_threads.erase(std::remove(m_threads.begin(), m_threads.end(), counters), m_threads.end());
+	}
+
+	HandlerStatistics Collect()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		HandlerStatistics result = Total();
+		for (int k=0; k<HandlerKindCount; ++k)
+		{
+			for (int o=0; o<HandlerOperationCount; ++o)
+			{
+				result.counters[k][o].calls -= m_baseline.counters[k][o].calls;
+				result.counters[k][o].values -= m_baseline.counters[k][o].values;
+				result.counters[k][o].bytes -= m_baseline.counters[k][o].bytes;
+			}
+			result.created[k] -= m_baseline.created[k];
+		}
+		return result;
+	}
+
+	void Reset()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_baseline = Total();
+	}
+};
+
+inline ThreadCounters::ThreadCounters()
+{
+	for (int k=0; k<HandlerKindCount; ++k)
+	{
+		for (int o=0; o<HandlerOperationCount; ++o)
+		{
+			for (int c=0; c<3; ++c)
+			{
+				m_counters[k][o][c].store(0, std::memory_order_relaxed);
+			}
+		}
+		m_created[k].store(0, std::memory_order_relaxed);
+	}
+	InstrumentationRegistry::Instance().Register(this);
+}
+
+inline ThreadCounters::~ThreadCounters()
+{
+	InstrumentationRegistry::Instance().Unregister(this);
+}
+
+inline ThreadCounters& LocalCounters()
+{
+	static thread_local ThreadCounters counters;
+	return counters;
+}
+
+inline void CountCall(HandlerKind kind, HandlerOperation operation, boost::uint64_t values, boost::uint64_t bytes)
+{
+	LocalCounters().Count(kind, operation, values, bytes);
+}
+
+inline void CountCreate(HandlerKind kind)
+{
+	LocalCounters().Create(kind);
+}
+
+}
+
+/**
+Sums up the counters of all threads, including the threads that have finished, since the last
+\ref ResetHandlerStatistics. The counts of threads that are still running may be a few calls behind.
+@return calls, values and bytes per handler implementation and operation
+*/
+inline HandlerStatistics CollectHandlerStatistics()
+{
+	return Implementation::InstrumentationRegistry::Instance().Collect();
+}
+
+/**
+Starts counting from zero for the following calls of \ref CollectHandlerStatistics.
+*/
+inline void ResetHandlerStatistics()
+{
+	Implementation::InstrumentationRegistry::Instance().Reset();
+}
+
+/**
+@return true if the handlers were compiled with the counting enabled
+*/
+inline bool HandlerStatisticsEnabled()
+{
+	return BUFFERHANDLER_INSTRUMENTATION != 0;
+}
+
+}
+
+#endif
@@ -0,0 +1,426 @@
+#ifndef LAYOUTREPORT_H
+#define LAYOUTREPORT_H
+/*
+Copyright (c) 2012, Tobias Langner
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+#include <vector>
+#include <string>
+#include <sstream>
+#include <ostream>
+#include "BufferHandler.h"
+#include "DecodePlan.h"
+#include "Schema.h"
+
+namespace BufferHandler
+{
+
+namespace Implementation
+{
+
+/**
+Maps the handler classes of the factory to their \ref HandlerKind.
+*/
+template<typename Handler>
+struct HandlerKindOf;
+
+template<>
+struct HandlerKindOf<ZeroDataHandler>
+{
+	static const HandlerKind value = ZeroHandlerKind;
+};
+
+template<typename SignPolicy, typename boundsCheck>
+struct HandlerKindOf<BitDataHandler<SignPolicy,boundsCheck>>
+{
+	static const HandlerKind value = BitHandlerKind;
+};
+
+template<typename T, typename intermediateType, typename swapPolicy, typename boundsCheck>
+struct HandlerKindOf<AlignedDataHandler<T,intermediateType,swapPolicy,boundsCheck>>
+{
+	static const HandlerKind value = AlignedHandlerKind;
+};
+
+template<typename internalBufferType, typename reinterpretType, typename endianessPolicy, typename signPolicy, typename copyPolicy, typename boundsCheck>
+struct HandlerKindOf<GenericHandler<internalBufferType,reinterpretType,endianessPolicy,signPolicy,copyPolicy,boundsCheck>>
+{
+	static const HandlerKind value = copyPolicy::kind;
+};
+
+/**
+Factory for \ref CreateHandler that only reports which handler would be created, without creating it.
+*/
+struct HandlerKindFactory
+{
+	typedef int Result; //HandlerKind or -1
+
+	template<typename Handler, typename... Args>
+	Result Create(Args...)
+	{
+		return HandlerKindOf<Handler>::value;
+	}
+
+	Result Empty()
+	{
+		return -1;
+	}
+};
+
+inline const char* DataTypeName(DataType type)
+{
+	switch (type)
+	{
+	case SignedIntegerLittleEndian: return "SignedIntegerLittleEndian";
+	case UnsignedIntegerLittleEndian: return "UnsignedIntegerLittleEndian";
+	case SignedIntegerBigEndian: return "SignedIntegerBigEndian";
+	case UnsignedIntegerBigEndian: return "UnsignedIntegerBigEndian";
+	case FloatLittleEndian: return "FloatLittleEndian";
+	case FloatBigEndian: return "FloatBigEndian";
+	default: return "unknown";
+	}
+}
+
+inline void WriteJsonString(std::ostream& out, const std::string& text)
+{
+	out << '"';
+	for (size_t i=0; i<text.size(); ++i)
+	{
+		const unsigned char c = static_cast<unsigned char>(text[i]);
+		if (c == '"' || c == '\\')
+		{
+			out << '\\' << text[i];
+		}
+		else if (c < 0x20)
+		{
+			const char* hex = "0123456789abcdef";
+			out << "\\u00" << hex[c >> 4] << hex[c & 15];
+		}
+		else
+		{
+			out << text[i];
+		}
+	}
+	out << '"';
+}
+
+/**
+Rough cost of a single read relative to the aligned handler, taken from the benchmark: the bit and aligned handlers
+are a load (and a swap), the padded generic handler adds shift, mask and sign extension and the exact generic handler
+a variable length copy on top.
+*/
+inline double EstimatedReadCost(HandlerKind kind)
+{
+	static const double costs[HandlerKindCount] = { 0.0, 1.0, 1.0, 4.0, 2.0 };
+	return costs[kind];
+}
+
+}
+
+/**
+Result of the analysis of a single field, see \ref AnalyzeLayout.
+*/
+struct FieldReport
+{
+	FieldReport(const FieldDescriptor& field_)
+		: field(field_), decodable(false), kind(GenericExactHandlerKind), cost(0.0)
+	{}
+
+	/** name of the signal, empty if the layout was given as plain descriptors */
+	std::string name;
+	/** location and type of the field */
+	FieldDescriptor field;
+	/** false if no handler can decode the field, kind and cost are meaningless then */
+	bool decodable;
+	/** implementation \ref CreateBufferHandler chooses for the field */
+	HandlerKind kind;
+	/** estimated cost of a single read, relative to an aligned field */
+	double cost;
+	/** why the field is on a slow path or can't be decoded, empty for the fast paths */
+	std::string reason;
+	/** how the field could be moved to a faster path, empty if there is no better one */
+	std::string suggestion;
+};
+
+/**
+Result of the analysis of a message layout, see \ref AnalyzeLayout.
+*/
+struct LayoutReport
+{
+	LayoutReport() : size(0), totalCost(0.0)
+	{
+		std::fill(kindCount, kindCount + HandlerKindCount, static_cast<size_t>(0));
+	}
+
+	/** name of the message, empty if the layout was given as plain descriptors */
+	std::string name;
+	/** size of the message in bytes, 0 if unknown */
+	size_t size;
+	/** one report per field, in the order of the layout */
+	std::vector<FieldReport> fields;
+	/** number of decodable fields per implementation */
+	size_t kindCount[HandlerKindCount];
+	/** sum of the estimated costs of all decodable fields, i.e. of decoding the message field by field */
+	double totalCost;
+
+	/**
+	@return indices of the fields that are decoded by a generic handler
+	*/
+	std::vector<size_t> GenericFields() const
+	{
+		std::vector<size_t> result;
+		for (size_t i=0; i<fields.size(); ++i)
+		{
+			if (fields[i].decodable && (fields[i].kind == GenericExactHandlerKind || fields[i].kind == GenericPaddedHandlerKind))
+			{
+				result.push_back(i);
+			}
+		}
+		return result;
+	}
+
+	/**
+	@return indices of the fields that can't be decoded at all
+	*/
+	std::vector<size_t> UndecodableFields() const
+	{
+		std::vector<size_t> result;
+		for (size_t i=0; i<fields.size(); ++i)
+		{
+			if (!fields[i].decodable)
+			{
+				result.push_back(i);
+			}
+		}
+		return result;
+	}
+
+	/**
+	Writes a summary line and one line per field that is on a slow path or can't be decoded.
+	@param out stream to write to
+	*/
+	void WriteText(std::ostream& out) const
+	{
+		out << (name.empty() ? "layout" : name) << ": " << fields.size() << " fields, cost " << totalCost;
+		for (int k=0; k<HandlerKindCount; ++k)
+		{
+			if (kindCount[k] != 0)
+			{
+				out << ", " << HandlerKindName(static_cast<HandlerKind>(k)) << " " << kindCount[k];
+			}
+		}
+		const size_t undecodable = UndecodableFields().size();
+		if (undecodable != 0)
+		{
+			out << ", undecodable " << undecodable;
+		}
+		out << "\n";
+		for (size_t i=0; i<fields.size(); ++i)
+		{
+			const FieldReport& report = fields[i];
+			if (report.reason.empty())
+			{
+				continue;
+			}
+			out << "  " << (report.name.empty() ? "field" : report.name) << " #" << i << " (startbit " << report.field.startbit
+				<< ", " << report.field.sizeInBits << " bits, " << Implementation::DataTypeName(report.field.type) << "): "
+				<< (report.decodable ? HandlerKindName(report.kind) : "undecodable") << ", " << report.reason;
+			if (!report.suggestion.empty())
+			{
+				out << "; " << report.suggestion;
+			}
+			out << "\n";
+		}
+	}
+
+	/**
+	Writes the whole report as a JSON object.
+	@param out stream to write to
+	*/
+	void WriteJson(std::ostream& out) const
+	{
+		out << "{\"name\": ";
+		Implementation::WriteJsonString(out, name);
+		out << ", \"size\": " << size << ", \"cost\": " << totalCost << ", \"fields\": [";
+		for (size_t i=0; i<fields.size(); ++i)
+		{
+			const FieldReport& report = fields[i];
+			out << (i == 0 ? "\n" : ",\n") << "  {\"name\": ";
+			Implementation::WriteJsonString(out, report.name);
+			out << ", \"startbit\": " << report.field.startbit << ", \"size\": " << report.field.sizeInBits
+				<< ", \"type\": \"" << Implementation::DataTypeName(report.field.type) << "\", \"handler\": \""
+				<< (report.decodable ? HandlerKindName(report.kind) : "none") << "\", \"cost\": " << report.cost << ", \"reason\": ";
+			Implementation::WriteJsonString(out, report.reason);
+			out << ", \"suggestion\": ";
+			Implementation::WriteJsonString(out, report.suggestion);
+			out << "}";
+		}
+		out << "\n]}\n";
+	}
+};
+
+namespace Implementation
+{
+
+inline unsigned int NativeWidth(unsigned int sizeInBits)
+{
+	return sizeInBits <= 8 ? 8 : sizeInBits <= 16 ? 16 : sizeInBits <= 32 ? 32 : 64;
+}
+
+inline FieldReport AnalyzeField(const FieldDescriptor& field, BufferPadding padding, size_t bufferSize)
+{
+	FieldReport report(field);
+	const bool isFloat = field.type == FloatLittleEndian || field.type == FloatBigEndian;
+	const size_t extent = field.startbit / 8 + (field.startbit % 8 + field.sizeInBits + 7) / 8;
+	if (static_cast<unsigned int>(field.type) > FloatBigEndian)
+	{
+		report.reason = "unknown data type";
+		return report;
+	}
+	if (field.sizeInBits > 64 || field.startbit % 8 + field.sizeInBits > 64)
+	{
+		report.reason = "spans more than 8 bytes";
+		report.suggestion = field.sizeInBits <= 64 ? "move it to a byte boundary" : "split it into fields of at most 64 bits";
+		return report;
+	}
+	if (isFloat && field.sizeInBits > 1 && field.sizeInBits != 32 && field.sizeInBits != 64)
+	{
+		report.reason = "floats must have 32 or 64 bits";
+		report.suggestion = "store it as an integer and scale it";
+		return report;
+	}
+	if (bufferSize != 0 && extent > bufferSize)
+	{
+		report.reason = "exceeds the message";
+		return report;
+	}
+
+	HandlerKindFactory factory;
+	const int kind = CreateHandler(factory, field.startbit, field.sizeInBits, field.type, padding);
+	if (kind < 0)
+	{
+		report.reason = "not supported by any handler";
+		return report;
+	}
+	report.decodable = true;
+	report.kind = static_cast<HandlerKind>(kind);
+	report.cost = EstimatedReadCost(report.kind);
+	if (report.kind != GenericExactHandlerKind && report.kind != GenericPaddedHandlerKind)
+	{
+		return report;
+	}
+
+	std::ostringstream reason;
+	std::ostringstream suggestion;
+	const unsigned int width = NativeWidth(field.sizeInBits);
+	if (width == field.sizeInBits)
+	{
+		const unsigned int below = field.startbit - field.startbit % 8;
+		reason << "not byte aligned";
+		suggestion << "move it to startbit " << below << " or " << below + 8 << " to use the aligned handler";
+	}
+	else
+	{
+		reason << field.sizeInBits << " bits is not a native width";
+		suggestion << "widen it to " << width << " bits at a byte boundary to use the aligned handler";
+	}
+	if (report.kind == GenericExactHandlerKind)
+	{
+		reason << ", variable length copy";
+		suggestion << ", a PaddedBuffer avoids the copy";
+	}
+	report.reason = reason.str();
+	report.suggestion = suggestion.str();
+	return report;
+}
+
+}
+
+/**
+Analyzes a message layout the way \ref CreateBufferHandler would handle it, without creating any handler. For every
+field the report contains the chosen implementation, its estimated cost, and for the fields on the generic (slow) path
+or without any handler the reason and a suggestion how to move the field onto a faster path.
+
+@param fields layout of the message
+@param padding guarantee of the caller about the memory behind the fields, see \ref BufferPadding
+@param bufferSize size of the message in bytes to check the fields against, 0 if unknown
+@return report of the layout
+*/
+inline LayoutReport AnalyzeLayout(const std::vector<FieldDescriptor>& fields, BufferPadding padding = ExactBuffer, size_t bufferSize = 0)
+{
+	LayoutReport report;
+	report.size = bufferSize;
+	for (size_t i=0; i<fields.size(); ++i)
+	{
+		report.fields.push_back(Implementation::AnalyzeField(fields[i], padding, bufferSize));
+		const FieldReport& field = report.fields.back();
+		if (field.decodable)
+		{
+			++report.kindCount[field.kind];
+			report.totalCost += field.cost;
+		}
+	}
+	return report;
+}
+
+/**
+Analyzes the signals of a message, see \ref AnalyzeLayout. The fields are checked against the size of the message and
+named like the signals.
+@param message message of a \ref Schema
+@param padding guarantee of the caller about the memory behind the fields, see \ref BufferPadding
+@return report of the message
+*/
+inline LayoutReport AnalyzeLayout(const SchemaMessage& message, BufferPadding padding = ExactBuffer)
+{
+	LayoutReport report = AnalyzeLayout(message.Fields(), padding, message.size);
+	report.name = message.name;
+	for (size_t i=0; i<message.signals.size(); ++i)
+	{
+		report.fields[i].name = message.signals[i].name;
+	}
+	return report;
+}
+
+/**
+Analyzes every message of a schema, see \ref AnalyzeLayout.
+@param schema the schema
+@param padding guarantee of the caller about the memory behind the fields, see \ref BufferPadding
+@return one report per message, in the order of \ref Schema::Messages
+*/
+inline std::vector<LayoutReport> AnalyzeSchema(const Schema& schema, BufferPadding padding = ExactBuffer)
+{
+	std::vector<LayoutReport> reports;
+	for (size_t i=0; i<schema.Messages().size(); ++i)
+	{
+		reports.push_back(AnalyzeLayout(schema.Messages()[i], padding));
+	}
+	return reports;
+}
+
+}
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef MULTIPLEXEDPLAN_H
+#define MULTIPLEXEDPLAN_H
+/*
+Copyright (c) 2012, Tobias Langner
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include "BufferHandler.h"
+#include "DecodePlan.h"
+
+namespace BufferHandler
+{
+
+/**
+Decodes multiplexed messages: a selector field (the mux id) decides which set of fields is present in the buffer. Every
+selector value has its own precompiled \ref DecodePlan, the plans are stored in a dense table indexed by the selector.
+Decoding costs the extraction of the selector and one table load on top of the plan of the selected layout. Fields
+that are present in every layout are simply part of each plan.
+
+The selector must be an unsigned integer of at most 16 bits, so the table stays small. The object is immutable after
+the layouts were added and can then be shared between threads.
+*/
+class MultiplexedPlan
+{
+	unsigned int m_selectorOffset; //first byte of the selector
+	unsigned int m_selectorBytes; //bytes covering the selector, 1 to 3
+	unsigned int m_selectorShift; //position of the lowest selector bit after the load (and swap)
+	boost::uint32_t m_selectorMask;
+	bool m_selectorSwap;
+	std::vector<boost::shared_ptr<DecodePlan>> m_layouts;
+	std::vector<const DecodePlan*> m_table; //indexed by the selector value, 0 if there is no layout
+	size_t m_maxFieldCount;
+
+	static const FieldDescriptor& CheckSelector(const FieldDescriptor& selector)
+	{
+		if (selector.sizeInBits == 0 || selector.sizeInBits > 16 ||
+			(selector.type != UnsignedIntegerLittleEndian && selector.type != UnsignedIntegerBigEndian))
+		{
+			throw std::invalid_argument("selector must be an unsigned integer with 1 to 16 bits");
+		}
+		return selector;
+	}
+
+public:
+	/**
+	Creates the plan without any layout.
+	@param selector field that holds the mux id
+	@throw std::invalid_argument if the selector isn't an unsigned integer with 1 to 16 bits
+	*/
+	explicit MultiplexedPlan(const FieldDescriptor& selector)
+		: m_selectorOffset(CheckSelector(selector).startbit / 8)
+		, m_selectorBytes((selector.startbit % 8 + selector.sizeInBits + 7) / 8)
+		, m_selectorMask((1u << selector.sizeInBits) - 1)
+		//1bit fields are read the same for both endianesses, see CreateBufferHandler
+		, m_selectorSwap(selector.sizeInBits > 1 && selector.type == UnsignedIntegerBigEndian)
+		, m_maxFieldCount(0)
+	{
+		//big endian: the lowest value bit is bit startbit%8 of the last byte, like EndianessPolicySwap
+		m_selectorShift = (m_selectorSwap ? (sizeof(boost::uint32_t) - m_selectorBytes) * 8 : 0) + selector.startbit % 8;
+	}
+
+	/**
+	Adds the layout for a selector value.
+	@param selectorValue value of the selector that marks the layout
+	@param fields fields of the layout, including the ones common to all layouts
+	@throw std::invalid_argument if the selector can't hold the value, there already is a layout for it or the plan can't be created
+	*/
+	void AddLayout(unsigned int selectorValue, const std::vector<FieldDescriptor>& fields)
+	{
+		if (selectorValue > m_selectorMask || (selectorValue < m_table.size() && m_table[selectorValue] != 0))
+		{
+			throw std::invalid_argument("invalid or duplicate selector value");
+		}
+		boost::shared_ptr<DecodePlan> plan(new DecodePlan(fields));
+		if (selectorValue >= m_table.size())
+		{
+			m_table.resize(selectorValue + 1, 0);
+		}
+		m_layouts.push_back(plan);
+		m_table[selectorValue] = plan.get();
+		m_maxFieldCount = std::max(m_maxFieldCount, plan->FieldCount());
+	}
+
+	/**
+	@return number of layouts
+	*/
+	size_t LayoutCount() const { return m_layouts.size(); }
+
+	/**
+	@return field count of the largest layout, an output array of this size fits every layout
+	*/
+	size_t MaxFieldCount() const { return m_maxFieldCount; }
+
+	/**
+	@param selectorValue value of the selector
+	@return plan of the layout, 0 if there is none for this value
+	*/
+	const DecodePlan* Layout(boost::uint64_t selectorValue) const
+	{
+		return selectorValue < m_table.size() ? m_table[static_cast<size_t>(selectorValue)] : 0;
+	}
+
+	/**
+	Reads the selector of a buffer.
+	@param buffer buffer to be read from
+	@param bufferSize size of the buffer
+	@return value of the selector field
+	@throw std::out_of_range if the buffer ends before the selector
+	*/
+	boost::uint64_t Selector(const unsigned char* buffer, size_t bufferSize) const
+	{
+		if (m_selectorOffset + m_selectorBytes > bufferSize)
+		{
+			throw std::out_of_range("buffer ends before the selector");
+		}
+		boost::uint32_t word = 0;
+		memcpy(&word, buffer + m_selectorOffset, m_selectorBytes);
+		if (m_selectorSwap)
+		{
+			word = Swap32(word);
+		}
+		return (word >> m_selectorShift) & m_selectorMask;
+	}
+
+	/**
+	Decodes the layout selected by the buffer and converts the fields to 64bit double.
+	@param buffer buffer to be read from
+	@param bufferSize size of the buffer
+	@param values output array with \ref MaxFieldCount entries, receives the fields of the selected layout in the order they were added
+	@param selector receives the value of the selector
+	@return number of decoded fields, 0 if there is no layout for the selector
+	@throw std::out_of_range if the buffer is smaller than the selector or the selected layout
+	*/
+	size_t DecodeD(const unsigned char* buffer, size_t bufferSize, double* values, boost::uint64_t& selector) const
+	{
+		selector = Selector(buffer, bufferSize);
+		const DecodePlan* plan = Layout(selector);
+		if (plan == 0)
+		{
+			return 0;
+		}
+		plan->DecodeD(buffer, bufferSize, values);
+		return plan->FieldCount();
+	}
+
+	/**
+	Decodes the layout selected by the buffer and converts the fields to 64bit integer.
+	@param buffer buffer to be read from
+	@param bufferSize size of the buffer
+	@param values output array with \ref MaxFieldCount entries, receives the fields of the selected layout in the order they were added
+	@param selector receives the value of the selector
+	@return number of decoded fields, 0 if there is no layout for the selector
+	@throw std::out_of_range if the buffer is smaller than the selector or the selected layout
+	*/
+	size_t DecodeI64(const unsigned char* buffer, size_t bufferSize, boost::int64_t* values, boost::uint64_t& selector) const
+	{
+		selector = Selector(buffer, bufferSize);
+		const DecodePlan* plan = Layout(selector);
+		if (plan == 0)
+		{
+			return 0;
+		}
+		plan->DecodeI64(buffer, bufferSize, values);
+		return plan->FieldCount();
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,317 @@
+#ifndef PARALLELDECODE_H
+#define PARALLELDECODE_H
+/*
+Copyright (c) 2012, Tobias Langner
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <exception>
+#include <boost/noncopyable.hpp>
+#include "BufferHandler.h"
+#include "RecordFile.h"
+
+namespace BufferHandler
+{
+
+/**
+Result of a parallel decode.
+*/
+struct ParallelDecodeStats
+{
+	size_t records; //number of records decoded
+	size_t bytes; //number of record bytes scanned
+	unsigned int threads; //number of threads that took part
+	size_t chunks; //number of chunks the records were split into
+	size_t stolenChunks; //chunks decoded by another thread than the owner
+	double seconds; //wall clock time of the decode
+
+	double RecordsPerSecond() const { return seconds > 0 ? records / seconds : 0; }
+	double GigabytesPerSecond() const { return seconds > 0 ? bytes / seconds * 1e-9 : 0; }
+};
+
+namespace Implementation
+{
+
+/**
+Range of chunks owned by one worker. The owner and the thieves take chunks from the front with an atomic increment,
+so a chunk is never decoded twice. Padded to the size of a cache line to avoid false sharing between the cursors.
+*/
+struct ChunkRange
+{
+	std::atomic<size_t> next;
+	size_t end;
+	char padding[64 - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+};
+
+}
+
+/**
+Decodes large record arrays with all cores. The record range is split into chunks, the chunks are distributed
+evenly over the workers and a worker that runs out of work steals chunks from the others. Every chunk covers a
+multiple of 64 records, so as long as the output columns are aligned to 64 bytes no two threads ever write to the same
+cache line of a column.
+
+The worker threads are started once and reused for every decode. The thread calling \ref Decode works as well, so a
+decoder with one thread runs everything in the caller. A decoder runs one decode at a time, concurrent calls are
+serialized.
+*/
+class ParallelDecoder : boost::noncopyable
+{
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	std::function<void(unsigned int)> m_job;
+	std::exception_ptr m_error; //first exception thrown by a job of the current run
+	size_t m_generation;
+	unsigned int m_running;
+	bool m_stop;
+	std::mutex m_decodeMutex;
+
+	void WorkerLoop(unsigned int worker)
+	{
+		size_t seen = 0;
+		for (;;)
+		{
+			std::function<void(unsigned int)> job;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wake.wait(lock, [&]() { return m_stop || m_generation != seen; });
+				if (m_stop)
+				{
+					return;
+				}
+				seen = m_generation;
+				job = m_job;
+			}
+			RunJob(job, worker);
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (--m_running == 0)
+			{
+				m_done.notify_one();
+			}
+		}
+	}
+
+	/**
+	Runs job as worker and keeps the first exception of the run, an exception must neither terminate a worker thread
+	nor leave the caller before the workers are done with the job.
+	*/
+	void RunJob(const std::function<void(unsigned int)>& job, unsigned int worker)
+	{
+		try
+		{
+			job(worker);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_error)
+			{
+				m_error = std::current_exception();
+			}
+		}
+	}
+
+	/**
+	Runs job on all workers (including the calling thread as worker 0) and waits until all have finished.
+	@throw the first exception thrown by one of the workers, after all of them have finished
+	*/
+	void RunOnAll(const std::function<void(unsigned int)>& job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_job = job;
+			m_error = std::exception_ptr();
+			m_running = static_cast<unsigned int>(m_threads.size());
+			++m_generation;
+		}
+		m_wake.notify_all();
+		RunJob(job, 0);
+		std::exception_ptr error;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_done.wait(lock, [&]() { return m_running == 0; });
+			m_job = std::function<void(unsigned int)>();
+			std::swap(error, m_error);
+		}
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+	}
+
+public:
+	/**
+	Starts the worker threads.
+	@param threadCount number of threads taking part in a decode, including the caller. 0 uses all hardware threads.
+	*/
+	explicit ParallelDecoder(unsigned int threadCount = 0)
+		: m_generation(0)
+		, m_running(0)
+		, m_stop(false)
+	{
+		if (threadCount == 0)
+		{
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+		}
+		for (unsigned int i=1; i<threadCount; ++i)
+		{
+			m_threads.push_back(std::thread(&ParallelDecoder::WorkerLoop, this, i));
+		}
+	}
+
+	~ParallelDecoder()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_wake.notify_all();
+		for (size_t i=0; i<m_threads.size(); ++i)
+		{
+			m_threads[i].join();
+		}
+	}
+
+	/**
+	@return number of threads taking part in a decode, including the caller
+	*/
+	unsigned int ThreadCount() const { return static_cast<unsigned int>(m_threads.size()) + 1; }
+
+	/**
+	Decodes several fields of count records, each into its own column.
+	@param records first record
+	@param recordSize size of each record in bytes
+	@param count number of records
+	@param handlers one handler per field
+	@param columns one output array per handler, each must be able to hold count values. Should be aligned to 64
+	bytes. Supported are double, float and the 32/64bit integer types.
+	@param chunkRecords number of records per chunk, rounded up to a multiple of 64. 0 chooses a chunk of about
+	256kB of records.
+	@return statistics and throughput of the decode
+	@throw std::out_of_range if the records are too small for the handlers, checked before any record is decoded
+	@throw the first exception thrown by a handler. The other workers stop taking chunks, the columns are partially
+	written.
+	*/
+	template<typename T>
+	ParallelDecodeStats Decode(const unsigned char* records, size_t recordSize, size_t count,
+		const std::vector<boost::shared_ptr<DataHandler>>& handlers, T* const* columns, size_t chunkRecords = 0)
+	{
+		BufferBatchValidator(handlers).Check(recordSize, count);
+		std::lock_guard<std::mutex> decodeLock(m_decodeMutex);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (chunkRecords == 0)
+		{
+			chunkRecords = std::max<size_t>(1, 256*1024 / std::max<size_t>(1, recordSize));
+		}
+		chunkRecords = (chunkRecords + 63) / 64 * 64;
+		const size_t chunkCount = (count + chunkRecords - 1) / chunkRecords;
+		const unsigned int workers = ThreadCount();
+
+		//contiguous chunk ranges per worker, the remainder goes to the first workers
+		std::vector<Implementation::ChunkRange> ranges(workers);
+		size_t first = 0;
+		for (unsigned int w=0; w<workers; ++w)
+		{
+			size_t n = chunkCount / workers + (w < chunkCount % workers ? 1 : 0);
+			ranges[w].next = first;
+			ranges[w].end = first + n;
+			first += n;
+		}
+		std::atomic<size_t> stolen(0);
+		std::atomic<bool> failed(false);
+
+		auto decodeChunk = [&](size_t chunk)
+		{
+			const size_t begin = chunk * chunkRecords;
+			const size_t n = std::min(chunkRecords, count - begin);
+			for (size_t f=0; f<handlers.size(); ++f)
+			{
+				Implementation::ReadColumn(*handlers[f], records + begin*recordSize, recordSize, n, columns[f] + begin);
+			}
+		};
+		RunOnAll([&](unsigned int worker)
+		{
+			//own chunks first, then steal from the others
+			for (unsigned int i=0; i<workers; ++i)
+			{
+				Implementation::ChunkRange& range = ranges[(worker + i) % workers];
+				for (size_t chunk = range.next++; chunk < range.end && !failed; chunk = range.next++)
+				{
+					try
+					{
+						decodeChunk(chunk);
+					}
+					catch (...)
+					{
+						failed = true;
+						throw;
+					}
+					if (i != 0)
+					{
+						++stolen;
+					}
+				}
+			}
+		});
+
+		ParallelDecodeStats stats;
+		stats.records = count;
+		stats.bytes = count * recordSize;
+		stats.threads = workers;
+		stats.chunks = chunkCount;
+		stats.stolenChunks = stolen;
+		stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return stats;
+	}
+
+	/**
+	Decodes several fields of count records of a \ref RecordFile starting at firstRecord, see above.
+	*/
+	template<typename T>
+	ParallelDecodeStats Decode(const RecordFile& file, size_t firstRecord, size_t count,
+		const std::vector<boost::shared_ptr<DataHandler>>& handlers, T* const* columns, size_t chunkRecords = 0)
+	{
+		assert(firstRecord + count <= file.RecordCount());
+		if (count == 0)
+		{
+			return Decode<T>(NULL, file.RecordSize(), 0, handlers, columns, chunkRecords);
+		}
+		return Decode(file.Record(firstRecord), file.RecordSize(), count, handlers, columns, chunkRecords);
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,306 @@
+#ifndef RECORDFILE_H
+#define RECORDFILE_H
+/*
+Copyright (c) 2012, Tobias Langner
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <boost/noncopyable.hpp>
+#include "BufferHandler.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace BufferHandler
+{
+
+namespace Implementation
+{
+
+inline void ReadColumn(const DataHandler& handler, const unsigned char* records, size_t recordSize, size_t count, double* values)
+{
+	handler.ReadDBatch(records, recordSize, count, values);
+}
+
+inline void ReadColumn(const DataHandler& handler, const unsigned char* records, size_t recordSize, size_t count, float* values)
+{
+	handler.ReadFBatch(records, recordSize, count, values);
+}
+
+inline void ReadColumn(const DataHandler& handler, const unsigned char* records, size_t recordSize, size_t count, boost::int64_t* values)
+{
+	handler.ReadI64Batch(records, recordSize, count, values);
+}
+
+inline void ReadColumn(const DataHandler& handler, const unsigned char* records, size_t recordSize, size_t count, boost::uint64_t* values)
+{
+	handler.ReadUI64Batch(records, recordSize, count, values);
+}
+
+inline void ReadColumn(const DataHandler& handler, const unsigned char* records, size_t recordSize, size_t count, boost::int32_t* values)
+{
+	handler.ReadI32Batch(records, recordSize, count, values);
+}
+
+inline void ReadColumn(const DataHandler& handler, const unsigned char* records, size_t recordSize, size_t count, boost::uint32_t* values)
+{
+	handler.ReadUI32Batch(records, recordSize, count, values);
+}
+
+}
+
+/**
+Read only, memory mapped file of fixed size binary records. The handlers run directly over the mapped pages, there is
+no copy into a scratch buffer. The operating system is told that the file is read sequentially, so it reads ahead and
+drops pages behind the reader, a capture larger than the memory decodes at page cache speed.
+
+A trailing partial record (file size not a multiple of the record size) is ignored. The mapping ends with the last
+byte of the file, so only handlers created with \ref ExactBuffer must be used.
+
+The file is immutable while mapped, the reader can be shared between threads.
+*/
+class RecordFile : boost::noncopyable
+{
+	const unsigned char* m_data;
+	size_t m_size;
+	size_t m_recordSize;
+#ifdef _WIN32
+	HANDLE m_file;
+	HANDLE m_mapping;
+#else
+	int m_file;
+#endif
+
+	void Close();
+
+public:
+	/**
+	Maps the file.
+	@param path file to be mapped
+	@param recordSize size of each record in bytes
+	@throw std::invalid_argument if recordSize is 0
+	@throw std::runtime_error if the file can't be opened or mapped
+	*/
+	RecordFile(const std::string& path, size_t recordSize);
+	~RecordFile() { Close(); }
+
+	/**
+	@return number of complete records in the file
+	*/
+	size_t RecordCount() const { return m_size / m_recordSize; }
+
+	/**
+	@return size of each record in bytes
+	*/
+	size_t RecordSize() const { return m_recordSize; }
+
+	/**
+	@param index index of the record, must be smaller than \ref RecordCount
+	@return first byte of the record, valid as long as the file is mapped
+	*/
+	const unsigned char* Record(size_t index) const
+	{
+		assert(index < RecordCount());
+		return m_data + index * m_recordSize;
+	}
+
+	/**
+	Decodes one field of count records starting at firstRecord into a column.
+	@param handler handler for the field, see \ref CreateBufferHandler
+	@param firstRecord index of the first record to be decoded
+	@param count number of records to be decoded
+	@param column output array, must be able to hold count values. Supported are double, float and the 32/64bit
+	integer types.
+	*/
+	template<typename T>
+	void DecodeColumn(const DataHandler& handler, size_t firstRecord, size_t count, T* column) const
+	{
+		assert(firstRecord + count <= RecordCount());
+		if (count > 0)
+		{
+			Implementation::ReadColumn(handler, Record(firstRecord), m_recordSize, count, column);
+		}
+	}
+
+	/**
+	Decodes several fields of count records starting at firstRecord, each into its own column. The records are
+	processed in blocks and all fields of a block are decoded while it is still in the cache, so each page of the file
+	is touched once instead of once per field.
+	@param handlers one handler per field
+	@param firstRecord index of the first record to be decoded
+	@param count number of records to be decoded
+	@param columns one output array per handler, each must be able to hold count values
+	*/
+	template<typename T>
+	void DecodeColumns(const std::vector<boost::shared_ptr<DataHandler>>& handlers, size_t firstRecord, size_t count, T* const* columns) const
+	{
+		assert(firstRecord + count <= RecordCount());
+		//keep a block small enough to stay in the L1/L2 cache for all fields
+		const size_t blockBytes = 64*1024;
+		const size_t blockRecords = m_recordSize < blockBytes ? blockBytes / m_recordSize : 1;
+		for (size_t done = 0; done < count; done += blockRecords)
+		{
+			const size_t n = std::min(blockRecords, count - done);
+			for (size_t f=0; f<handlers.size(); ++f)
+			{
+				Implementation::ReadColumn(*handlers[f], Record(firstRecord + done), m_recordSize, n, columns[f] + done);
+			}
+		}
+	}
+};
+
+#ifdef _WIN32
+
+inline RecordFile::RecordFile(const std::string& path, size_t recordSize)
+	: m_data(NULL)
+	, m_size(0)
+	, m_recordSize(recordSize)
+	, m_file(INVALID_HANDLE_VALUE)
+	, m_mapping(NULL)
+{
+	if (recordSize == 0)
+	{
+		throw std::invalid_argument("record size must not be 0");
+	}
+	m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error("can't open " + path);
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size))
+	{
+		Close();
+		throw std::runtime_error("can't get the size of " + path);
+	}
+	m_size = static_cast<size_t>(size.QuadPart);
+	if (m_size == 0)
+	{
+		return; //empty files can't be mapped
+	}
+	m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_mapping != NULL)
+	{
+		m_data = static_cast<const unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+	if (m_data == NULL)
+	{
+		Close();
+		throw std::runtime_error("can't map " + path);
+	}
+}
+
+inline void RecordFile::Close()
+{
+	if (m_data != NULL)
+	{
+		UnmapViewOfFile(m_data);
+		m_data = NULL;
+	}
+	if (m_mapping != NULL)
+	{
+		CloseHandle(m_mapping);
+		m_mapping = NULL;
+	}
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+		m_file = INVALID_HANDLE_VALUE;
+	}
+	m_size = 0;
+}
+
+#else
+
+inline RecordFile::RecordFile(const std::string& path, size_t recordSize)
+	: m_data(NULL)
+	, m_size(0)
+	, m_recordSize(recordSize)
+	, m_file(-1)
+{
+	if (recordSize == 0)
+	{
+		throw std::invalid_argument("record size must not be 0");
+	}
+	m_file = open(path.c_str(), O_RDONLY);
+	if (m_file < 0)
+	{
+		throw std::runtime_error("can't open " + path);
+	}
+	struct stat info;
+	if (fstat(m_file, &info) != 0)
+	{
+		Close();
+		throw std::runtime_error("can't get the size of " + path);
+	}
+	m_size = static_cast<size_t>(info.st_size);
+	if (m_size == 0)
+	{
+		return; //empty files can't be mapped
+	}
+	void* data = mmap(NULL, m_size, PROT_READ, MAP_SHARED, m_file, 0);
+	if (data == MAP_FAILED)
+	{
+		Close();
+		throw std::runtime_error("can't map " + path);
+	}
+	m_data = static_cast<const unsigned char*>(data);
+	//only a hint, failing is harmless
+	madvise(data, m_size, MADV_SEQUENTIAL);
+}
+
+inline void RecordFile::Close()
+{
+	if (m_data != NULL)
+	{
+		munmap(const_cast<unsigned char*>(m_data), m_size);
+		m_data = NULL;
+	}
+	if (m_file >= 0)
+	{
+		close(m_file);
+		m_file = -1;
+	}
+	m_size = 0;
+}
+
+#endif
+
+}
+
+#endif
@@ -0,0 +1,427 @@
+#ifndef RECORDFILTER_H
+#define RECORDFILTER_H
+/*
+Copyright (c) 2012, Tobias Langner
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+#include <vector>
+#include <limits>
+#include <stdexcept>
+#include "BufferHandler.h"
+#include "DecodePlan.h"
+#include "RecordFile.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace BufferHandler
+{
+
+/**
+Condition on the value of one integer field: low <= value <= high. The bounds are interpreted according to the
+signedness of the field, bounds outside of the range of the field are clamped.
+*/
+struct FieldPredicate
+{
+	FieldPredicate(const FieldDescriptor& field_, boost::int64_t low_, boost::int64_t high_)
+		: field(field_)
+		, low(low_)
+		, high(high_)
+	{}
+
+	/**
+	@return predicate matching records where the field is equal to value
+	*/
+	static FieldPredicate Equal(const FieldDescriptor& field, boost::int64_t value) { return FieldPredicate(field, value, value); }
+
+	/**
+	@return predicate matching records where low <= field <= high
+	*/
+	static FieldPredicate Between(const FieldDescriptor& field, boost::int64_t low, boost::int64_t high) { return FieldPredicate(field, low, high); }
+
+	FieldDescriptor field;
+	boost::int64_t low;
+	boost::int64_t high;
+};
+
+namespace Implementation
+{
+
+/**
+A predicate translated to the raw bits of the record: the field is extracted from a load of width bytes with shift
+and mask. Signed fields are mapped to unsigned order by flipping the sign bit, so every predicate becomes a single
+unsigned comparison (key - lowKey) <= span.
+*/
+struct FilterField
+{
+	unsigned int byteOffset;
+	unsigned int bytes; //bytes covering the field
+	unsigned int width; //bytes loaded per record (1, 2, 4 or 8)
+	bool bigEndian;
+	unsigned int shift;
+	boost::uint64_t mask;
+	boost::uint64_t flip;
+	boost::uint64_t lowKey;
+	boost::uint64_t span;
+	bool never; //the range is empty
+};
+
+inline unsigned int CountTrailingZeros(boost::uint64_t value)
+{
+	assert(value != 0);
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return index;
+#elif defined(__GNUC__)
+	return __builtin_ctzll(value);
+#else
+	unsigned int index = 0;
+	while ((value & 1) == 0) { value >>= 1; ++index; }
+	return index;
+#endif
+}
+
+inline unsigned int PopCount(boost::uint64_t value)
+{
+#if defined(__GNUC__)
+	return __builtin_popcountll(value);
+#else
+	unsigned int count = 0;
+	for (; value != 0; value &= value - 1) { ++count; }
+	return count;
+#endif
+}
+
+inline FilterField MakeFilterField(const FieldPredicate& predicate)
+{
+	const FieldDescriptor& d = predicate.field;
+	if (d.type == FloatLittleEndian || d.type == FloatBigEndian)
+	{
+		throw std::invalid_argument("predicates are only supported on integer fields");
+	}
+	FilterField f;
+	f.byteOffset = d.startbit / 8;
+	f.bytes = (d.startbit % 8 + d.sizeInBits + 7) / 8;
+	if (f.bytes > 8)
+	{
+		throw std::invalid_argument("field spans more than 8 bytes");
+	}
+	f.width = f.bytes <= 1 ? 1 : f.bytes <= 2 ? 2 : f.bytes <= 4 ? 4 : 8;
+	//1bit fields are read the same for both endianesses, see CreateBufferHandler
+	f.bigEndian = d.sizeInBits > 1 && (d.type == SignedIntegerBigEndian || d.type == UnsignedIntegerBigEndian);
+	f.shift = (f.bigEndian ? (f.width - f.bytes) * 8 : 0) + d.startbit % 8;
+	f.mask = d.sizeInBits >= 64 ? ~static_cast<boost::uint64_t>(0) : (static_cast<boost::uint64_t>(1) << d.sizeInBits) - 1;
+	const bool isSigned = d.type == SignedIntegerLittleEndian || d.type == SignedIntegerBigEndian;
+
+	//clamp the bounds to the range of the field
+	boost::int64_t low = predicate.low;
+	boost::int64_t high = predicate.high;
+	if (d.sizeInBits == 0)
+	{
+		f.flip = 0;
+		low = std::max<boost::int64_t>(low, 0);
+		high = std::min<boost::int64_t>(high, 0);
+	}
+	else if (isSigned)
+	{
+		f.flip = static_cast<boost::uint64_t>(1) << (d.sizeInBits - 1);
+		const boost::int64_t minimum = d.sizeInBits >= 64 ? std::numeric_limits<boost::int64_t>::min() : -static_cast<boost::int64_t>(f.flip);
+		const boost::int64_t maximum = d.sizeInBits >= 64 ? std::numeric_limits<boost::int64_t>::max() : static_cast<boost::int64_t>(f.flip - 1);
+		low = std::max(low, minimum);
+		high = std::min(high, maximum);
+	}
+	else
+	{
+		f.flip = 0;
+		low = std::max<boost::int64_t>(low, 0);
+		if (d.sizeInBits < 63)
+		{
+			high = std::min(high, static_cast<boost::int64_t>(f.mask));
+		}
+	}
+	f.never = low > high;
+	f.lowKey = (static_cast<boost::uint64_t>(low) & f.mask) ^ f.flip;
+	f.span = ((static_cast<boost::uint64_t>(high) & f.mask) ^ f.flip) - f.lowKey;
+	return f;
+}
+
+template<typename W>
+inline W SwapWord(W value);
+template<> inline boost::uint8_t SwapWord(boost::uint8_t value) { return value; }
+template<> inline boost::uint16_t SwapWord(boost::uint16_t value) { return Swap16(value); }
+template<> inline boost::uint32_t SwapWord(boost::uint32_t value) { return Swap32(value); }
+template<> inline boost::uint64_t SwapWord(boost::uint64_t value) { return Swap64(value); }
+
+/**
+Loads the words of the field from n records starting at record first. The loads have a fixed width, only the records
+at the very end of the buffer where this would read beyond bufferSize copy exactly the bytes of the field.
+*/
+template<typename W>
+void GatherFilterWords(const FilterField& f, const unsigned char* records, size_t recordSize, size_t bufferSize, size_t first, size_t n, boost::uint64_t* words)
+{
+	for (size_t i=0; i<n; ++i)
+	{
+		const size_t offset = (first + i) * recordSize + f.byteOffset;
+		W word = 0;
+		memcpy(&word, records + offset, offset + sizeof(W) <= bufferSize ? sizeof(W) : f.bytes);
+		words[i] = f.bigEndian ? SwapWord(word) : word;
+	}
+}
+
+/**
+Evaluates the predicate on the words [first, n).
+@return bitmap with bit i set if word i matches
+*/
+inline boost::uint64_t MatchFilterWordsScalar(const FilterField& f, const boost::uint64_t* words, size_t first, size_t n)
+{
+	boost::uint64_t result = 0;
+	for (size_t i=first; i<n; ++i)
+	{
+		boost::uint64_t key = ((words[i] >> f.shift) & f.mask) ^ f.flip;
+		result |= static_cast<boost::uint64_t>(key - f.lowKey <= f.span) << i;
+	}
+	return result;
+}
+
+#if defined(BUFFERHANDLER_AVX2_BACKEND)
+/**
+Evaluates the predicate on up to 64 words, 4 at a time. Requires \ref CpuSupportsAvx2.
+@return bitmap with bit i set if word i matches
+*/
+BUFFERHANDLER_TARGET_AVX2 inline boost::uint64_t MatchFilterWordsAvx2(const FilterField& f, const boost::uint64_t* words, size_t n)
+{
+	boost::uint64_t result = 0;
+	size_t i = 0;
+	const __m256i mask = _mm256_set1_epi64x(static_cast<long long>(f.mask));
+	const __m256i flip = _mm256_set1_epi64x(static_cast<long long>(f.flip));
+	const __m256i lowKey = _mm256_set1_epi64x(static_cast<long long>(f.lowKey));
+	//AVX2 only has a signed comparison, moving the sign bit turns it into an unsigned one
+	const __m256i bias = _mm256_set1_epi64x(static_cast<long long>(0x8000000000000000ULL));
+	const __m256i span = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(f.span)), bias);
+	const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(f.shift));
+	for (; i + 4 <= n; i += 4)
+	{
+		__m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i));
+		key = _mm256_xor_si256(_mm256_and_si256(_mm256_srl_epi64(key, shift), mask), flip);
+		__m256i offset = _mm256_xor_si256(_mm256_sub_epi64(key, lowKey), bias);
+		//match if offset <= span, i.e. not (offset > span)
+		int outside = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(offset, span)));
+		result |= static_cast<boost::uint64_t>(~outside & 0xF) << i;
+	}
+	return result | MatchFilterWordsScalar(f, words, i, n);
+}
+#endif
+
+/**
+Evaluates the predicate on up to 64 words.
+@param useAvx2 use the AVX2 kernel, only if \ref CpuSupportsAvx2 returns true
+@return bitmap with bit i set if word i matches
+*/
+inline boost::uint64_t MatchFilterWords(const FilterField& f, const boost::uint64_t* words, size_t n, bool useAvx2)
+{
+#if defined(BUFFERHANDLER_AVX2_BACKEND)
+	if (useAvx2)
+	{
+		return MatchFilterWordsAvx2(f, words, n);
+	}
+#else
+	(void)useAvx2;
+#endif
+	return MatchFilterWordsScalar(f, words, 0, n);
+}
+
+}
+
+/**
+Scan that selects the records matching all of its predicates, without decoding them. Each predicate is evaluated on
+the raw words of the records: a fixed width load per record, then shift, mask and one unsigned comparison for a block
+of 64 records at a time (vectorized with AVX2 if the CPU supports it). Predicates after the first one only look at
+blocks that still have matches.
+
+The selection (or bitmap) can then be used to decode other fields only for the matching records, see \ref DecodeSelected.
+*/
+class RecordFilter
+{
+	std::vector<Implementation::FilterField> m_fields;
+	size_t m_extent; //minimum record size for all predicates
+	bool m_useAvx2;
+
+public:
+	/**
+	Creates a filter without predicates, it matches every record.
+	@param allowAvx2 compare with AVX2 if the CPU supports it
+	*/
+	explicit RecordFilter(bool allowAvx2 = true)
+		: m_extent(0)
+		, m_useAvx2(allowAvx2 && Implementation::CpuSupportsAvx2())
+	{}
+
+	/**
+	Adds a predicate, all predicates must match (logical and).
+	@throw std::invalid_argument if the field is not an integer field or spans more than 8 bytes
+	*/
+	void AddPredicate(const FieldPredicate& predicate)
+	{
+		Implementation::FilterField f = Implementation::MakeFilterField(predicate);
+		if (predicate.field.sizeInBits > 0)
+		{
+			m_extent = std::max<size_t>(m_extent, f.byteOffset + f.bytes);
+		}
+		m_fields.push_back(f);
+	}
+
+	/**
+	@return true if the predicates are compared with the AVX2 instructions
+	*/
+	bool UsesAvx2() const { return m_useAvx2; }
+
+	/**
+	@return number of predicates
+	*/
+	size_t PredicateCount() const { return m_fields.size(); }
+
+	/**
+	Evaluates the predicates on count records.
+	@param records first record
+	@param recordSize size of each record in bytes
+	@param count number of records
+	@param bitmap receives one bit per record (bit i%64 of word i/64), set if the record matches
+	@return number of matching records
+	@throw std::out_of_range if a predicate field lies (partly) outside of the records
+	*/
+	size_t SelectBitmap(const unsigned char* records, size_t recordSize, size_t count, std::vector<boost::uint64_t>& bitmap) const
+	{
+		if (count != 0 && recordSize < m_extent)
+		{
+			throw std::out_of_range("records are too small for the predicates");
+		}
+		const size_t blocks = (count + 63) / 64;
+		bitmap.assign(blocks, ~static_cast<boost::uint64_t>(0));
+		if (blocks > 0 && count % 64 != 0)
+		{
+			bitmap[blocks-1] = (static_cast<boost::uint64_t>(1) << (count % 64)) - 1;
+		}
+		const size_t bufferSize = count * recordSize;
+		boost::uint64_t words[64];
+		for (size_t p=0; p<m_fields.size(); ++p)
+		{
+			const Implementation::FilterField& f = m_fields[p];
+			for (size_t b=0; b<blocks; ++b)
+			{
+				if (bitmap[b] == 0)
+				{
+					continue;
+				}
+				if (f.never)
+				{
+					bitmap[b] = 0;
+					continue;
+				}
+				const size_t first = b * 64;
+				const size_t n = std::min<size_t>(64, count - first);
+				switch (f.width)
+				{
+				case 1: Implementation::GatherFilterWords<boost::uint8_t>(f, records, recordSize, bufferSize, first, n, words); break;
+				case 2: Implementation::GatherFilterWords<boost::uint16_t>(f, records, recordSize, bufferSize, first, n, words); break;
+				case 4: Implementation::GatherFilterWords<boost::uint32_t>(f, records, recordSize, bufferSize, first, n, words); break;
+				default: Implementation::GatherFilterWords<boost::uint64_t>(f, records, recordSize, bufferSize, first, n, words); break;
+				}
+				bitmap[b] &= Implementation::MatchFilterWords(f, words, n, m_useAvx2);
+			}
+		}
+		size_t matches = 0;
+		for (size_t b=0; b<blocks; ++b)
+		{
+			matches += Implementation::PopCount(bitmap[b]);
+		}
+		return matches;
+	}
+
+	/**
+	Evaluates the predicates on count records.
+	@param records first record
+	@param recordSize size of each record in bytes
+	@param count number of records
+	@param selection receives the indices of the matching records in ascending order
+	@return number of matching records
+	@throw std::out_of_range if a predicate field lies (partly) outside of the records
+	*/
+	size_t Select(const unsigned char* records, size_t recordSize, size_t count, std::vector<size_t>& selection) const
+	{
+		std::vector<boost::uint64_t> bitmap;
+		selection.clear();
+		selection.reserve(SelectBitmap(records, recordSize, count, bitmap));
+		for (size_t b=0; b<bitmap.size(); ++b)
+		{
+			for (boost::uint64_t bits = bitmap[b]; bits != 0; bits &= bits - 1)
+			{
+				selection.push_back(b * 64 + Implementation::CountTrailingZeros(bits));
+			}
+		}
+		return selection.size();
+	}
+
+	/**
+	Evaluates the predicates on all records of a \ref RecordFile, see above.
+	*/
+	size_t SelectBitmap(const RecordFile& file, std::vector<boost::uint64_t>& bitmap) const
+	{
+		const size_t count = file.RecordCount();
+		return SelectBitmap(count > 0 ? file.Record(0) : NULL, file.RecordSize(), count, bitmap);
+	}
+
+	/**
+	Evaluates the predicates on all records of a \ref RecordFile, see above.
+	*/
+	size_t Select(const RecordFile& file, std::vector<size_t>& selection) const
+	{
+		const size_t count = file.RecordCount();
+		return Select(count > 0 ? file.Record(0) : NULL, file.RecordSize(), count, selection);
+	}
+};
+
+/**
+Decodes one field of the selected records into a column.
+@param handler handler for the field, see \ref CreateBufferHandler
+@param records first record
+@param recordSize size of each record in bytes
+@param selection indices of the records to be decoded, see \ref RecordFilter::Select
+@param column output array, must be able to hold selection.size() values
+*/
+template<typename T>
+void DecodeSelected(const DataHandler& handler, const unsigned char* records, size_t recordSize, const std::vector<size_t>& selection, T* column)
+{
+	for (size_t i=0; i<selection.size(); ++i)
+	{
+		Implementation::ReadColumn(handler, records + selection[i]*recordSize, recordSize, 1, column + i);
+	}
+}
+
+}
+
+#endif
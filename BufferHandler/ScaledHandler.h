@@ -0,0 +1,337 @@
+#ifndef SCALEDHANDLER_H
+#define SCALEDHANDLER_H
+/*
+Copyright (c) 2012, Tobias Langner
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include "BufferHandler.h"
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+namespace BufferHandler
+{
+
+namespace Implementation
+{
+
+/**
+Converts a raw value to its physical value: raw*factor + offset. Fused into one instruction if the target supports FMA,
+so the scalar and the vectorized path (\ref ScaleNarrowBlock) round the same way.
+*/
+inline double ScaleValue(double raw, double factor, double offset)
+{
+#if defined(__FMA__)
+	return std::fma(raw, factor, offset);
+#else
+	return raw * factor + offset;
+#endif
+}
+
+/**
+Converts raw integers with |raw| < 2^51 to physical values. The integers are converted to double without a
+conversion instruction (x86 has none for 64bit integers before AVX-512): biased by 2^51 and ORed into the mantissa of
+2^52, the double minus 2^52+2^51 is exactly the integer. With AVX2 and FMA 4 values are converted and scaled per
+iteration, the plain loop is vectorized by the compiler on other targets.
+*/
+inline void ScaleNarrowBlock(const boost::int64_t* raw, size_t count, double factor, double offset, double* values)
+{
+	const boost::uint64_t bias = 0x0008000000000000ULL; //2^51
+	const boost::uint64_t exponent = 0x4330000000000000ULL; //bits of 2^52
+	const double magic = 6755399441055744.0; //2^52 + 2^51
+	size_t i = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+	const __m256i vectorBias = _mm256_set1_epi64x(static_cast<long long>(bias));
+	const __m256i vectorExponent = _mm256_set1_epi64x(static_cast<long long>(exponent));
+	const __m256d vectorMagic = _mm256_set1_pd(magic);
+	const __m256d vectorFactor = _mm256_set1_pd(factor);
+	const __m256d vectorOffset = _mm256_set1_pd(offset);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m256i bits = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(raw + i));
+		bits = _mm256_or_si256(_mm256_add_epi64(bits, vectorBias), vectorExponent);
+		const __m256d converted = _mm256_sub_pd(_mm256_castsi256_pd(bits), vectorMagic);
+		_mm256_storeu_pd(values + i, _mm256_fmadd_pd(converted, vectorFactor, vectorOffset));
+	}
+#endif
+	for (; i<count; ++i)
+	{
+		const double converted = BitCast<double>((static_cast<boost::uint64_t>(raw[i]) + bias) | exponent) - magic;
+		values[i] = ScaleValue(converted, factor, offset);
+	}
+}
+
+/**
+Rounds to the nearest integer and saturates to the range of a signed field with sizeInBits bits. NaN becomes 0.
+*/
+inline boost::int64_t SaturateSigned(double value, unsigned int sizeInBits)
+{
+	if (sizeInBits == 0)
+	{
+		return 0;
+	}
+	const boost::int64_t max = static_cast<boost::int64_t>((static_cast<boost::uint64_t>(1) << (sizeInBits - 1)) - 1);
+	const boost::int64_t min = -max - 1;
+	const double rounded = std::round(value);
+	if (rounded != rounded)
+	{
+		return 0;
+	}
+	if (rounded <= static_cast<double>(min))
+	{
+		return min;
+	}
+	if (rounded >= static_cast<double>(max))
+	{
+		return max;
+	}
+	return static_cast<boost::int64_t>(rounded);
+}
+
+/**
+Rounds to the nearest integer and saturates to the range of an unsigned field with sizeInBits bits. NaN becomes 0.
+*/
+inline boost::uint64_t SaturateUnsigned(double value, unsigned int sizeInBits)
+{
+	const boost::uint64_t max = sizeInBits == 0 ? 0 : (~static_cast<boost::uint64_t>(0)) >> (64 - sizeInBits);
+	const double rounded = std::round(value);
+	if (!(rounded > 0))
+	{
+		return 0;
+	}
+	if (rounded >= static_cast<double>(max))
+	{
+		return max;
+	}
+	return static_cast<boost::uint64_t>(rounded);
+}
+
+}
+
+/**
+Decorator that applies a linear scaling to another handler: the reads return physical values
+(raw*factor + offset) and the writes take physical values. Integer fields are unscaled with round to nearest and
+saturated to the range of the field on write, the integer reads round and saturate the physical value to the
+requested type.
+
+The batch reads convert whole blocks: the raw values are read with the batch read of the wrapped handler and then
+converted and scaled with \ref Implementation::ScaleNarrowBlock for fields with up to 51 bits (52 signed).
+*/
+class ScaledDataHandler : public DataHandler
+{
+	enum { BlockSize = 256 };
+
+	boost::shared_ptr<DataHandler> m_raw;
+	double m_factor;
+	double m_offset;
+	unsigned int m_sizeInBits;
+	bool m_float;
+	bool m_signed;
+	bool m_narrow; //every raw value is exactly convertible by ScaleNarrowBlock
+
+	double Unscale(double value) const { return (value - m_offset) / m_factor; }
+
+	void ScaleBlock(const unsigned char* records, size_t recordSize, size_t count, double* values) const
+	{
+		if (m_float)
+		{
+			m_raw->ReadDBatch(records, recordSize, count, values);
+			for (size_t i=0; i<count; ++i)
+			{
+				values[i] = Implementation::ScaleValue(values[i], m_factor, m_offset);
+			}
+		}
+		else if (m_narrow)
+		{
+			boost::int64_t raw[BlockSize];
+			m_raw->ReadI64Batch(records, recordSize, count, raw);
+			Implementation::ScaleNarrowBlock(raw, count, m_factor, m_offset, values);
+		}
+		else if (m_signed)
+		{
+			boost::int64_t raw[BlockSize];
+			m_raw->ReadI64Batch(records, recordSize, count, raw);
+			for (size_t i=0; i<count; ++i)
+			{
+				values[i] = Implementation::ScaleValue(static_cast<double>(raw[i]), m_factor, m_offset);
+			}
+		}
+		else
+		{
+			boost::uint64_t raw[BlockSize];
+			m_raw->ReadUI64Batch(records, recordSize, count, raw);
+			for (size_t i=0; i<count; ++i)
+			{
+				values[i] = Implementation::ScaleValue(static_cast<double>(raw[i]), m_factor, m_offset);
+			}
+		}
+	}
+
+public:
+	/**
+	@param raw handler of the field (the raw value)
+	@param sizeInBits size of the field
+	@param type type of the field
+	@param factor factor of the scaling
+	@param offset offset of the scaling
+	*/
+	ScaledDataHandler(const boost::shared_ptr<DataHandler>& raw, unsigned int sizeInBits, DataType type, double factor, double offset)
+		: m_raw(raw)
+		, m_factor(factor)
+		, m_offset(offset)
+		, m_sizeInBits(sizeInBits)
+		, m_float(type == FloatLittleEndian || type == FloatBigEndian)
+		, m_signed(type == SignedIntegerLittleEndian || type == SignedIntegerBigEndian)
+		, m_narrow(sizeInBits <= (m_signed ? 52u : 51u))
+	{
+		if (m_float && sizeInBits == 1)
+		{
+			m_float = false; //a single bit float is a flag
+		}
+	}
+
+	/**
+	@return the handler of the raw value
+	*/
+	const boost::shared_ptr<DataHandler>& RawHandler() const { return m_raw; }
+
+	double Factor() const { return m_factor; }
+	double Offset() const { return m_offset; }
+	virtual size_t Extent() const { return m_raw->Extent(); }
+
+	virtual void WriteD(double value, unsigned char* buffer, size_t bufferSize) const
+	{
+		if (m_float)
+		{
+			m_raw->WriteD(Unscale(value), buffer, bufferSize);
+		}
+		else if (m_signed)
+		{
+			m_raw->WriteI64(Implementation::SaturateSigned(Unscale(value), m_sizeInBits), buffer, bufferSize);
+		}
+		else
+		{
+			m_raw->WriteUI64(Implementation::SaturateUnsigned(Unscale(value), m_sizeInBits), buffer, bufferSize);
+		}
+	}
+	virtual void WriteUI64(boost::uint64_t value, unsigned char* buffer, size_t bufferSize) const { WriteD(static_cast<double>(value), buffer, bufferSize); }
+	virtual void WriteI64(boost::int64_t value, unsigned char* buffer, size_t bufferSize) const { WriteD(static_cast<double>(value), buffer, bufferSize); }
+	virtual void WriteUI32(boost::uint32_t value, unsigned char* buffer, size_t bufferSize) const { WriteD(value, buffer, bufferSize); }
+	virtual void WriteI32(boost::int32_t value, unsigned char* buffer, size_t bufferSize) const { WriteD(value, buffer, bufferSize); }
+	virtual void WriteF(float value, unsigned char* buffer, size_t bufferSize) const { WriteD(value, buffer, bufferSize); }
+	virtual void WriteB(bool value, unsigned char* buffer, size_t bufferSize) const { WriteD(value ? 1.0 : 0.0, buffer, bufferSize); }
+
+	virtual double ReadD(const unsigned char* buffer, size_t bufferSize) const
+	{
+		double raw;
+		if (m_float)
+		{
+			raw = m_raw->ReadD(buffer, bufferSize);
+		}
+		else if (m_signed)
+		{
+			raw = static_cast<double>(m_raw->ReadI64(buffer, bufferSize));
+		}
+		else
+		{
+			raw = static_cast<double>(m_raw->ReadUI64(buffer, bufferSize));
+		}
+		return Implementation::ScaleValue(raw, m_factor, m_offset);
+	}
+	virtual boost::uint64_t ReadUI64(const unsigned char* buffer, size_t bufferSize) const { return Implementation::SaturateUnsigned(ReadD(buffer, bufferSize), 64); }
+	virtual boost::int64_t ReadI64(const unsigned char* buffer, size_t bufferSize) const { return Implementation::SaturateSigned(ReadD(buffer, bufferSize), 64); }
+	virtual boost::uint32_t ReadUI32(const unsigned char* buffer, size_t bufferSize) const { return static_cast<boost::uint32_t>(Implementation::SaturateUnsigned(ReadD(buffer, bufferSize), 32)); }
+	virtual boost::int32_t ReadI32(const unsigned char* buffer, size_t bufferSize) const { return static_cast<boost::int32_t>(Implementation::SaturateSigned(ReadD(buffer, bufferSize), 32)); }
+	virtual float ReadF(const unsigned char* buffer, size_t bufferSize) const { return static_cast<float>(ReadD(buffer, bufferSize)); }
+	virtual bool ReadB(const unsigned char* buffer, size_t bufferSize) const { return ReadD(buffer, bufferSize) != 0; }
+
+	virtual void ReadDBatch(const unsigned char* records, size_t recordSize, size_t count, double* values) const
+	{
+		for (size_t first=0; first<count; first+=BlockSize)
+		{
+			ScaleBlock(records + first*recordSize, recordSize, std::min<size_t>(BlockSize, count - first), values + first);
+		}
+	}
+	virtual void ReadFBatch(const unsigned char* records, size_t recordSize, size_t count, float* values) const
+	{
+		double block[BlockSize];
+		for (size_t first=0; first<count; first+=BlockSize)
+		{
+			const size_t n = std::min<size_t>(BlockSize, count - first);
+			ScaleBlock(records + first*recordSize, recordSize, n, block);
+			for (size_t i=0; i<n; ++i)
+			{
+				values[first + i] = static_cast<float>(block[i]);
+			}
+		}
+	}
+	virtual FieldAggregate Aggregate(const unsigned char* records, size_t recordSize, size_t count) const
+	{
+		FieldAggregate result;
+		double block[BlockSize];
+		for (size_t first=0; first<count; first+=BlockSize)
+		{
+			const size_t n = std::min<size_t>(BlockSize, count - first);
+			ScaleBlock(records + first*recordSize, recordSize, n, block);
+			Implementation::AggregateBlock(block, n, result);
+		}
+		return result;
+	}
+};
+
+/**
+Creates a handler that converts between the raw value of the field and its physical value: physical = raw*factor + offset.
+See \ref ScaledDataHandler.
+
+@param startbit first bit of the data inside of the buffer
+@param sizeInBits number of bits for the data
+@param DataType determines how the data is interpreted (Integer / Float, Little or Big Endian)
+@param factor factor of the scaling
+@param offset offset of the scaling
+@return reader/writer of the physical value, empty if there is no handler for the field
+@throw std::invalid_argument if the factor is 0 or factor or offset are not finite
+*/
+inline boost::shared_ptr<DataHandler> CreateScaledBufferHandler(unsigned int startbit, unsigned int sizeInBits, DataType type, double factor, double offset)
+{
+	if (factor == 0 || !(std::abs(factor) <= std::numeric_limits<double>::max()) || !(std::abs(offset) <= std::numeric_limits<double>::max()))
+	{
+		throw std::invalid_argument("invalid scaling");
+	}
+	boost::shared_ptr<DataHandler> raw = CreateBufferHandler(startbit, sizeInBits, type);
+	if (!raw)
+	{
+		return raw;
+	}
+	return boost::shared_ptr<DataHandler>(new ScaledDataHandler(raw, sizeInBits, type, factor, offset));
+}
+
+}
+
+#endif
@@ -0,0 +1,549 @@
+#ifndef SCHEMA_H
+#define SCHEMA_H
+/*
+Copyright (c) 2012, Tobias Langner
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include "BufferHandler.h"
+#include "DecodePlan.h"
+#include "HandlerCache.h"
+
+namespace BufferHandler
+{
+
+/**
+Signal of a message: a named field with the linear conversion to its physical value (physical = raw*factor + offset).
+*/
+struct SchemaSignal
+{
+	enum
+	{
+		AlwaysPresent = -1, //not multiplexed
+		Selector = -2 //multiplexer signal of the message
+	};
+
+	SchemaSignal(const std::string& name_, const FieldDescriptor& field_, double factor_, double offset_, int muxValue_)
+		: name(name_)
+		, field(field_)
+		, factor(factor_)
+		, offset(offset_)
+		, muxValue(muxValue_)
+	{}
+
+	std::string name;
+	FieldDescriptor field;
+	double factor;
+	double offset;
+	int muxValue; //value of the selector for which the signal is present, or AlwaysPresent / Selector
+};
+
+/**
+Message of a schema with its signals in the order of the description.
+*/
+struct SchemaMessage
+{
+	unsigned int id;
+	std::string name;
+	unsigned int size; //in bytes
+	std::vector<SchemaSignal> signals;
+
+	/**
+	@return the field descriptors of all signals, e.g. to create a \ref DecodePlan
+	*/
+	std::vector<FieldDescriptor> Fields() const
+	{
+		std::vector<FieldDescriptor> fields;
+		for (size_t i=0; i<signals.size(); ++i)
+		{
+			fields.push_back(signals[i].field);
+		}
+		return fields;
+	}
+};
+
+namespace Implementation
+{
+
+const boost::uint32_t SchemaCacheMagic = 0x43534842; //"BHSC"
+const boost::uint32_t SchemaCacheVersion = 1;
+
+/**
+Header of the binary schema cache. All integers are stored in the byte order of the machine that wrote the cache, a
+cache from a machine with another byte order is rejected by the byteOrder marker.
+*/
+struct SchemaCacheHeader
+{
+	boost::uint32_t magic;
+	boost::uint32_t version;
+	boost::uint32_t byteOrder; //0x01020304
+	boost::uint32_t messageCount;
+	boost::uint32_t signalCount;
+	boost::uint32_t stringBytes;
+	boost::uint64_t sourceSize; //size and hash of the text description the cache was created from
+	boost::uint64_t sourceHash;
+};
+
+struct SchemaCacheMessage
+{
+	boost::uint32_t id;
+	boost::uint32_t size;
+	boost::uint32_t signalCount;
+	boost::uint32_t nameOffset;
+	boost::uint32_t nameLength;
+	boost::uint32_t reserved;
+};
+
+struct SchemaCacheSignal
+{
+	double factor;
+	double offset;
+	boost::uint32_t startbit;
+	boost::uint32_t sizeInBits;
+	boost::uint32_t type;
+	boost::int32_t muxValue;
+	boost::uint32_t nameOffset;
+	boost::uint32_t nameLength;
+};
+
+/**
+64bit FNV-1a hash, identifies the text description a binary cache was created from.
+*/
+inline boost::uint64_t SchemaHash(const std::string& text)
+{
+	boost::uint64_t hash = 14695981039346656037ULL;
+	for (size_t i=0; i<text.size(); ++i)
+	{
+		hash = (hash ^ static_cast<unsigned char>(text[i])) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+/**
+Converts the start bit of a big endian (Motorola) DBC signal to the start bit of a big endian \ref FieldDescriptor.
+DBC counts the start bit at the most significant bit of the value, descending inside of a byte and continuing at bit 7
+of the next byte. The descriptor counts it at the least significant bit, which is in the last byte of the signal.
+*/
+inline unsigned int MotorolaStartbit(unsigned int msb, unsigned int sizeInBits)
+{
+	unsigned int byte = msb / 8;
+	unsigned int bit = msb % 8;
+	unsigned int steps = sizeInBits - 1;
+	if (steps > bit)
+	{
+		steps -= bit + 1;
+		bit = 7 - steps % 8;
+	}
+	else
+	{
+		bit -= steps;
+	}
+	return byte * 8 + bit;
+}
+
+inline std::string ReadTextFile(const std::string& path)
+{
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+	if (!file)
+	{
+		throw std::runtime_error("can't open " + path);
+	}
+	std::ostringstream text;
+	text << file.rdbuf();
+	return text.str();
+}
+
+}
+
+/**
+Message layouts read from a DBC style text description. Only the parts that describe the layout are interpreted:
+
+	BO_ <id> <name>: <size in bytes> <sender>
+	 SG_ <name> [M|m<value>] : <startbit>|<size>@<1=little endian|0=big endian><+|-> (<factor>,<offset>) [<min>|<max>] "<unit>" <receivers>
+	SIG_VALTYPE_ <message id> <signal name> : <1=32bit float|2=64bit float>;
+
+All other lines are ignored. The start bit of big endian signals is given like in DBC files (at the most significant
+bit) and converted to the convention of \ref FieldDescriptor.
+
+Parsing a large description takes a while, so the schema can be stored in a compact binary cache that is read back
+with a single file read and no parsing (see \ref LoadCached).
+*/
+class Schema
+{
+	std::vector<SchemaMessage> m_messages; //sorted by id
+
+	struct MessageIdLess
+	{
+		bool operator()(const SchemaMessage& message, unsigned int id) const { return message.id < id; }
+		bool operator()(const SchemaMessage& a, const SchemaMessage& b) const { return a.id < b.id; }
+	};
+
+	static std::runtime_error ParseError(size_t line, const std::string& what)
+	{
+		std::ostringstream message;
+		message << "schema line " << line << ": " << what;
+		return std::runtime_error(message.str());
+	}
+
+	static void ParseSignal(const std::string& text, size_t line, SchemaMessage& message)
+	{
+		const size_t colon = text.find(':');
+		if (colon == std::string::npos)
+		{
+			throw ParseError(line, "missing ':' in signal");
+		}
+		std::istringstream head(text.substr(0, colon));
+		std::string keyword, name, mux;
+		head >> keyword >> name >> mux;
+		int muxValue = SchemaSignal::AlwaysPresent;
+		if (mux == "M")
+		{
+			muxValue = SchemaSignal::Selector;
+		}
+		else if (!mux.empty())
+		{
+			if (mux[0] != 'm' || sscanf(mux.c_str() + 1, "%d", &muxValue) != 1 || muxValue < 0)
+			{
+				throw ParseError(line, "invalid multiplexer indicator " + mux);
+			}
+		}
+		unsigned int startbit, sizeInBits;
+		char byteOrder, sign;
+		double factor, offset;
+		if (sscanf(text.c_str() + colon + 1, " %u|%u@%c%c (%lf,%lf)", &startbit, &sizeInBits, &byteOrder, &sign, &factor, &offset) != 6 ||
+			(byteOrder != '0' && byteOrder != '1') || (sign != '+' && sign != '-') || sizeInBits > 64)
+		{
+			throw ParseError(line, "invalid layout of signal " + name);
+		}
+		const bool bigEndian = byteOrder == '0';
+		DataType type = sign == '-' ? (bigEndian ? SignedIntegerBigEndian : SignedIntegerLittleEndian) : (bigEndian ? UnsignedIntegerBigEndian : UnsignedIntegerLittleEndian);
+		if (bigEndian && sizeInBits > 0)
+		{
+			startbit = Implementation::MotorolaStartbit(startbit, sizeInBits);
+		}
+		if (startbit / 8 + (startbit % 8 + sizeInBits + 7) / 8 > message.size)
+		{
+			throw ParseError(line, "signal " + name + " exceeds the message");
+		}
+		message.signals.push_back(SchemaSignal(name, FieldDescriptor(startbit, sizeInBits, type), factor, offset, muxValue));
+	}
+
+	void ParseValueType(const std::string& text, size_t line)
+	{
+		std::istringstream stream(text);
+		std::string keyword, name, colon;
+		unsigned int id = 0;
+		int valueType = 0;
+		stream >> keyword >> id >> name >> colon >> valueType;
+		SchemaMessage* message = FindMutableMessage(id);
+		if (!stream || colon != ":" || message == 0)
+		{
+			throw ParseError(line, "invalid value type");
+		}
+		for (size_t i=0; i<message->signals.size(); ++i)
+		{
+			FieldDescriptor& field = message->signals[i].field;
+			if (message->signals[i].name == name)
+			{
+				if ((valueType != 1 || field.sizeInBits != 32) && (valueType != 2 || field.sizeInBits != 64))
+				{
+					throw ParseError(line, "value type doesn't match the size of signal " + name);
+				}
+				field.type = (field.type == SignedIntegerBigEndian || field.type == UnsignedIntegerBigEndian) ? FloatBigEndian : FloatLittleEndian;
+				return;
+			}
+		}
+		throw ParseError(line, "unknown signal " + name);
+	}
+
+	SchemaMessage* FindMutableMessage(unsigned int id)
+	{
+		auto found = std::lower_bound(m_messages.begin(), m_messages.end(), id, MessageIdLess());
+		return found != m_messages.end() && found->id == id ? &*found : 0;
+	}
+
+public:
+	/**
+	@return the messages, sorted by their id
+	*/
+	const std::vector<SchemaMessage>& Messages() const { return m_messages; }
+
+	/**
+	@param id id of the message
+	@return the message, 0 if the schema doesn't contain it
+	*/
+	const SchemaMessage* FindMessage(unsigned int id) const
+	{
+		auto found = std::lower_bound(m_messages.begin(), m_messages.end(), id, MessageIdLess());
+		return found != m_messages.end() && found->id == id ? &*found : 0;
+	}
+
+	/**
+	Creates the handlers of all signals of a message. Signals with the same layout (e.g. in different messages) share
+	their handler through the cache.
+	@param message message of this schema
+	@param cache cache for the handlers
+	@return one handler per signal, in the order of the signals
+	@throw std::invalid_argument if a signal isn't supported by any handler
+	*/
+	static std::vector<boost::shared_ptr<DataHandler>> CreateHandlers(const SchemaMessage& message, HandlerCache& cache)
+	{
+		std::vector<boost::shared_ptr<DataHandler>> handlers;
+		for (size_t i=0; i<message.signals.size(); ++i)
+		{
+			const FieldDescriptor& field = message.signals[i].field;
+			handlers.push_back(CreateBufferHandler(field.startbit, field.sizeInBits, field.type, cache));
+			if (!handlers.back())
+			{
+				throw std::invalid_argument("signal " + message.signals[i].name + " is not supported by any handler");
+			}
+		}
+		return handlers;
+	}
+
+	/**
+	Parses a text description.
+	@param text DBC style description
+	@return the schema
+	@throw std::runtime_error with the line number if the description is invalid
+	*/
+	static Schema Parse(const std::string& text)
+	{
+		Schema schema;
+		std::istringstream stream(text);
+		std::string lineText;
+		SchemaMessage* message = 0;
+		for (size_t line=1; std::getline(stream, lineText); ++line)
+		{
+			std::istringstream tokens(lineText);
+			std::string keyword;
+			tokens >> keyword;
+			if (keyword == "BO_")
+			{
+				SchemaMessage parsed;
+				std::string name;
+				tokens >> parsed.id >> name >> parsed.size;
+				if (!tokens || name.size() < 2 || name[name.size() - 1] != ':')
+				{
+					throw ParseError(line, "invalid message");
+				}
+				parsed.name = name.substr(0, name.size() - 1);
+				auto position = std::lower_bound(schema.m_messages.begin(), schema.m_messages.end(), parsed.id, MessageIdLess());
+				if (position != schema.m_messages.end() && position->id == parsed.id)
+				{
+					throw ParseError(line, "duplicate message " + parsed.name);
+				}
+				message = &*schema.m_messages.insert(position, parsed);
+			}
+			else if (keyword == "SG_")
+			{
+				if (message == 0)
+				{
+					throw ParseError(line, "signal outside of a message");
+				}
+				ParseSignal(lineText, line, *message);
+			}
+			else if (keyword == "SIG_VALTYPE_")
+			{
+				schema.ParseValueType(lineText, line);
+			}
+			else if (!keyword.empty())
+			{
+				message = 0;
+			}
+		}
+		return schema;
+	}
+
+	/**
+	Parses a text description from a file.
+	@param path path of the DBC style description
+	@return the schema
+	@throw std::runtime_error if the file can't be read or the description is invalid
+	*/
+	static Schema ParseFile(const std::string& path)
+	{
+		return Parse(Implementation::ReadTextFile(path));
+	}
+
+	/**
+	Writes the schema to a binary cache.
+	@param path path of the cache file
+	@param sourceText text description the schema was parsed from, used to detect a stale cache
+	@throw std::runtime_error if the file can't be written
+	*/
+	void SaveBinary(const std::string& path, const std::string& sourceText) const
+	{
+		std::vector<Implementation::SchemaCacheMessage> messages;
+		std::vector<Implementation::SchemaCacheSignal> signals;
+		std::string strings;
+		for (size_t m=0; m<m_messages.size(); ++m)
+		{
+			const SchemaMessage& message = m_messages[m];
+			Implementation::SchemaCacheMessage cached = { message.id, message.size, static_cast<boost::uint32_t>(message.signals.size()),
+				static_cast<boost::uint32_t>(strings.size()), static_cast<boost::uint32_t>(message.name.size()), 0 };
+			messages.push_back(cached);
+			strings += message.name;
+			for (size_t s=0; s<message.signals.size(); ++s)
+			{
+				const SchemaSignal& signal = message.signals[s];
+				Implementation::SchemaCacheSignal cachedSignal = { signal.factor, signal.offset, signal.field.startbit, signal.field.sizeInBits,
+					static_cast<boost::uint32_t>(signal.field.type), signal.muxValue,
+					static_cast<boost::uint32_t>(strings.size()), static_cast<boost::uint32_t>(signal.name.size()) };
+				signals.push_back(cachedSignal);
+				strings += signal.name;
+			}
+		}
+		Implementation::SchemaCacheHeader header = { Implementation::SchemaCacheMagic, Implementation::SchemaCacheVersion, 0x01020304,
+			static_cast<boost::uint32_t>(messages.size()), static_cast<boost::uint32_t>(signals.size()), static_cast<boost::uint32_t>(strings.size()),
+			sourceText.size(), Implementation::SchemaHash(sourceText) };
+		std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		if (!messages.empty())
+		{
+			file.write(reinterpret_cast<const char*>(&messages[0]), messages.size() * sizeof(messages[0]));
+		}
+		if (!signals.empty())
+		{
+			file.write(reinterpret_cast<const char*>(&signals[0]), signals.size() * sizeof(signals[0]));
+		}
+		file.write(strings.data(), strings.size());
+		if (!file)
+		{
+			throw std::runtime_error("can't write " + path);
+		}
+	}
+
+	/**
+	Reads a binary cache written by \ref SaveBinary.
+	@param path path of the cache file
+	@param sourceText text description the schema must have been created from, or 0 to accept any cache
+	@return the schema
+	@throw std::runtime_error if the file can't be read, is not a valid cache or was created from another description
+	*/
+	static Schema LoadBinary(const std::string& path, const std::string* sourceText = 0)
+	{
+		const std::string data = Implementation::ReadTextFile(path);
+		Implementation::SchemaCacheHeader header;
+		if (data.size() < sizeof(header))
+		{
+			throw std::runtime_error("invalid schema cache " + path);
+		}
+		memcpy(&header, data.data(), sizeof(header));
+		const size_t messageBytes = static_cast<size_t>(header.messageCount) * sizeof(Implementation::SchemaCacheMessage);
+		const size_t signalBytes = static_cast<size_t>(header.signalCount) * sizeof(Implementation::SchemaCacheSignal);
+		if (header.magic != Implementation::SchemaCacheMagic || header.version != Implementation::SchemaCacheVersion || header.byteOrder != 0x01020304 ||
+			data.size() != sizeof(header) + messageBytes + signalBytes + header.stringBytes)
+		{
+			throw std::runtime_error("invalid schema cache " + path);
+		}
+		if (sourceText != 0 && (header.sourceSize != sourceText->size() || header.sourceHash != Implementation::SchemaHash(*sourceText)))
+		{
+			throw std::runtime_error("stale schema cache " + path);
+		}
+		std::vector<Implementation::SchemaCacheMessage> messages(header.messageCount);
+		std::vector<Implementation::SchemaCacheSignal> signals(header.signalCount);
+		if (messageBytes != 0)
+		{
+			memcpy(&messages[0], data.data() + sizeof(header), messageBytes);
+		}
+		if (signalBytes != 0)
+		{
+			memcpy(&signals[0], data.data() + sizeof(header) + messageBytes, signalBytes);
+		}
+		const char* strings = data.data() + sizeof(header) + messageBytes + signalBytes;
+		Schema schema;
+		schema.m_messages.resize(messages.size());
+		size_t nextSignal = 0;
+		for (size_t m=0; m<messages.size(); ++m)
+		{
+			const Implementation::SchemaCacheMessage& cached = messages[m];
+			if (cached.nameOffset > header.stringBytes || cached.nameLength > header.stringBytes - cached.nameOffset ||
+				cached.signalCount > signals.size() - nextSignal || (m > 0 && cached.id <= messages[m - 1].id))
+			{
+				throw std::runtime_error("invalid schema cache " + path);
+			}
+			SchemaMessage& message = schema.m_messages[m];
+			message.id = cached.id;
+			message.size = cached.size;
+			message.name.assign(strings + cached.nameOffset, cached.nameLength);
+			message.signals.reserve(cached.signalCount);
+			for (size_t s=0; s<cached.signalCount; ++s, ++nextSignal)
+			{
+				const Implementation::SchemaCacheSignal& signal = signals[nextSignal];
+				if (signal.nameOffset > header.stringBytes || signal.nameLength > header.stringBytes - signal.nameOffset ||
+					signal.type > FloatBigEndian || signal.sizeInBits > 64)
+				{
+					throw std::runtime_error("invalid schema cache " + path);
+				}
+				message.signals.push_back(SchemaSignal(std::string(strings + signal.nameOffset, signal.nameLength),
+					FieldDescriptor(signal.startbit, signal.sizeInBits, static_cast<DataType>(signal.type)), signal.factor, signal.offset, signal.muxValue));
+			}
+		}
+		return schema;
+	}
+
+	/**
+	Reads the schema from the binary cache if it was created from the current text description, otherwise parses the
+	description and (re)writes the cache. A cache that can't be written is not an error.
+	@param textPath path of the DBC style description
+	@param cachePath path of the binary cache
+	@return the schema
+	@throw std::runtime_error if the description can't be read or is invalid
+	*/
+	static Schema LoadCached(const std::string& textPath, const std::string& cachePath)
+	{
+		const std::string text = Implementation::ReadTextFile(textPath);
+		try
+		{
+			return LoadBinary(cachePath, &text);
+		}
+		catch (const std::runtime_error&)
+		{
+		}
+		Schema schema = Parse(text);
+		try
+		{
+			schema.SaveBinary(cachePath, text);
+		}
+		catch (const std::runtime_error&)
+		{
+		}
+		return schema;
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef STATICFIELD_H
+#define STATICFIELD_H
+
+/*
+Copyright (c) 2012, Tobias Langner
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+#include "BufferHandler.h"
+
+namespace BufferHandler
+{
+namespace Implementation
+{
+
+/**
+Selects the smallest unsigned integer that can hold the given number of bytes.
+*/
+template<unsigned int Bytes>
+struct FieldStorage
+{
+	BOOST_STATIC_ASSERT(Bytes > 0 && Bytes < 8);
+	typedef typename FieldStorage<Bytes+1>::type type;
+};
+
+template<> struct FieldStorage<1> { typedef boost::uint8_t type; };
+template<> struct FieldStorage<2> { typedef boost::uint16_t type; };
+template<> struct FieldStorage<4> { typedef boost::uint32_t type; };
+template<> struct FieldStorage<8> { typedef boost::uint64_t type; };
+
+/**
+Conversion between the extracted (aligned and masked) bits and the value type of a field.
+*/
+struct FieldConversionUnsigned
+{
+	typedef boost::uint64_t ValueType;
+	static ValueType FromBits(boost::uint64_t bits) { return bits; }
+	static boost::uint64_t ToBits(ValueType value) { return value; }
+};
+
+template<unsigned int SizeInBits>
+struct FieldConversionSigned
+{
+	typedef boost::int64_t ValueType;
+	//the size is a compile time constant, so the compiler folds the mask of the policy
+	static ValueType FromBits(boost::uint64_t bits) { return static_cast<boost::int64_t>(SignExtensionPolicyExtend<boost::uint64_t>(SizeInBits).Extend(bits)); }
+	static boost::uint64_t ToBits(ValueType value) { return static_cast<boost::uint64_t>(value); }
+};
+
+template<unsigned int SizeInBits>
+struct FieldConversionFloat;
+
+/**
+A single bit float is a flag, like the BitDataHandler returned by \ref CreateBufferHandler.
+*/
+template<>
+struct FieldConversionFloat<1>
+{
+	typedef bool ValueType;
+	static ValueType FromBits(boost::uint64_t bits) { return bits != 0; }
+	static boost::uint64_t ToBits(ValueType value) { return value ? 1 : 0; }
+};
+
+template<>
+struct FieldConversionFloat<32>
+{
+	typedef float ValueType;
+	static ValueType FromBits(boost::uint64_t bits) { return BitCast<float>(static_cast<boost::uint32_t>(bits)); }
+	static boost::uint64_t ToBits(ValueType value) { return BitCast<boost::uint32_t>(value); }
+};
+
+template<>
+struct FieldConversionFloat<64>
+{
+	typedef double ValueType;
+	static ValueType FromBits(boost::uint64_t bits) { return BitCast<double>(bits); }
+	static boost::uint64_t ToBits(ValueType value) { return BitCast<boost::uint64_t>(value); }
+};
+
+/**
+Maps a DataType to the swap policy and the value conversion used by \ref BufferHandler::Field.
+*/
+template<BufferHandler::DataType type, unsigned int SizeInBits>
+struct FieldTraits;
+
+template<unsigned int SizeInBits>
+struct FieldTraits<BufferHandler::UnsignedIntegerLittleEndian, SizeInBits> : FieldConversionUnsigned
+{
+	static const bool bigEndian = false;
+	template<typename T> struct Swap { typedef SwapPolicyNone<T> type; };
+};
+
+template<unsigned int SizeInBits>
+struct FieldTraits<BufferHandler::SignedIntegerLittleEndian, SizeInBits> : FieldConversionSigned<SizeInBits>
+{
+	static const bool bigEndian = false;
+	template<typename T> struct Swap { typedef SwapPolicyNone<T> type; };
+};
+
+template<unsigned int SizeInBits>
+struct FieldTraits<BufferHandler::UnsignedIntegerBigEndian, SizeInBits> : FieldConversionUnsigned
+{
+	static const bool bigEndian = true;
+	template<typename T> struct Swap { typedef SwapPolicySwap<T> type; };
+};
+
+template<unsigned int SizeInBits>
+struct FieldTraits<BufferHandler::SignedIntegerBigEndian, SizeInBits> : FieldConversionSigned<SizeInBits>
+{
+	static const bool bigEndian = true;
+	template<typename T> struct Swap { typedef SwapPolicySwap<T> type; };
+};
+
+template<unsigned int SizeInBits>
+struct FieldTraits<BufferHandler::FloatLittleEndian, SizeInBits> : FieldConversionFloat<SizeInBits>
+{
+	static const bool bigEndian = false;
+	template<typename T> struct Swap { typedef SwapPolicyNone<T> type; };
+};
+
+template<unsigned int SizeInBits>
+struct FieldTraits<BufferHandler::FloatBigEndian, SizeInBits> : FieldConversionFloat<SizeInBits>
+{
+	static const bool bigEndian = true;
+	template<typename T> struct Swap { typedef SwapPolicySwap<T> type; };
+};
+
+}
+
+/**
+Reader/writer for a field whose location and type are known at compile time. It has the same semantics as the handler
+returned by \ref CreateBufferHandler for the same parameters, but there is no allocation and no virtual call. Shift,
+masks and the number of bytes to load are compile time constants, so a read compiles down to a load, an optional byte
+swap, a shift and a mask.
+
+Example:
+	typedef BufferHandler::Field<12, 20, BufferHandler::SignedIntegerBigEndian> Temperature;
+	boost::int64_t value = Temperature::Read(buffer);
+
+@tparam StartBit first bit of the data inside of the buffer
+@tparam SizeInBits number of bits for the data (1 to 64, floats must be 32 or 64, or 1 for a flag)
+@tparam Type determines how the data is interpreted (Integer / Float, Little or Big Endian)
+*/
+template<unsigned int StartBit, unsigned int SizeInBits, BufferHandler::DataType Type>
+struct Field
+{
+	BOOST_STATIC_ASSERT(SizeInBits > 0 && SizeInBits <= 64);
+
+	typedef Implementation::FieldTraits<Type, SizeInBits> Traits;
+	typedef typename Traits::ValueType ValueType;
+
+	static const unsigned int ByteOffset = StartBit / 8;
+	static const unsigned int BytesToCopy = (SizeInBits + StartBit%8 + 7) / 8;
+	BOOST_STATIC_ASSERT(BytesToCopy <= 8);
+
+	typedef typename Implementation::FieldStorage<BytesToCopy>::type StorageType;
+	typedef typename Traits::template Swap<StorageType>::type SwapPolicy;
+
+	/** shift that aligns the lowest value bit to bit 0, same as EndianessPolicyNoSwap / EndianessPolicySwap */
+	static const unsigned int Shift = Traits::bigEndian
+		? (sizeof(StorageType) - BytesToCopy)*8 + StartBit%8
+		: StartBit%8;
+	static const boost::uint64_t Mask = SizeInBits == 64 ? ~static_cast<boost::uint64_t>(0) : (static_cast<boost::uint64_t>(1) << (SizeInBits%64)) - 1;
+
+	/**
+	Reads the field from the buffer.
+	@param buffer buffer to be read from, must contain at least ByteOffset+BytesToCopy bytes
+	@return value of the field
+	*/
+	static ValueType Read(const unsigned char* buffer)
+	{
+		StorageType raw = 0;
+		memcpy(&raw, buffer+ByteOffset, BytesToCopy);
+		boost::uint64_t bits = (static_cast<boost::uint64_t>(SwapPolicy::Swap(raw)) >> Shift) & Mask;
+		return Traits::FromBits(bits);
+	}
+
+	/**
+	Writes the field into the buffer. All bits outside of the field are preserved.
+	@param value value to be written
+	@param buffer buffer to be written to, must contain at least ByteOffset+BytesToCopy bytes
+	*/
+	static void Write(ValueType value, unsigned char* buffer)
+	{
+		const StorageType fieldMask = SwapPolicy::Swap(static_cast<StorageType>(Mask << Shift));
+		StorageType bits = SwapPolicy::Swap(static_cast<StorageType>((Traits::ToBits(value) & Mask) << Shift));
+		StorageType current = 0;
+		memcpy(&current, buffer+ByteOffset, BytesToCopy);
+		current = static_cast<StorageType>((current & ~fieldMask) | bits);
+		memcpy(buffer+ByteOffset, &current, BytesToCopy);
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,430 @@
+/*
+Copyright (c) 2012, Tobias Langner
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+/*
+Microbenchmark of every handler variant the factory can return. For each field descriptor the benchmark measures the
+scalar read, the batch read, the aggregation and the write over an array of records. The scaling of the ParallelDecoder
+is measured with an increasing number of threads, the frame plans are compared with one handler call per field and the
+scaled handlers with a batch read followed by a separate scaling loop. The scalar and the BMI2 bit extraction of the
+generic handlers are compared if the CPU supports BMI2. The results are printed as JSON, so that runs
+can be compared to detect regressions.
+
+Usage: BufferHandlerBench [minimum time per measurement in ms, default 50]
+*/
+
+#include <boost/timer/timer.hpp>
+#include <boost/core/demangle.hpp>
+#include <boost/smart_ptr.hpp>
+#include <typeinfo>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include "BufferHandler.h"
+#include "ParallelDecode.h"
+#include "DecodePlan.h"
+#include "EncodePlan.h"
+#include "ScaledHandler.h"
+
+using namespace BufferHandler;
+
+namespace
+{
+
+const size_t recordSize = 16;
+const size_t recordCount = 4096;
+
+struct Result
+{
+	double nsPerOp;
+	double gbPerS;
+};
+
+const char* TypeName(DataType type)
+{
+	switch (type)
+	{
+	case SignedIntegerLittleEndian: return "SignedIntegerLittleEndian";
+	case UnsignedIntegerLittleEndian: return "UnsignedIntegerLittleEndian";
+	case SignedIntegerBigEndian: return "SignedIntegerBigEndian";
+	case UnsignedIntegerBigEndian: return "UnsignedIntegerBigEndian";
+	case FloatLittleEndian: return "FloatLittleEndian";
+	case FloatBigEndian: return "FloatBigEndian";
+	}
+	return "unknown";
+}
+
+bool IsFloat(DataType type)
+{
+	return type == FloatLittleEndian || type == FloatBigEndian;
+}
+
+/**
+Runs operation (one pass over all records) until minimumNs have passed and reports the fastest pass.
+@param payloadBytes number of bytes of field data handled per operation
+*/
+template<typename Operation>
+Result Measure(Operation operation, double payloadBytes, boost::timer::nanosecond_type minimumNs)
+{
+	operation(); //warm up
+	boost::timer::nanosecond_type best = 0;
+	boost::timer::cpu_timer total;
+	do
+	{
+		boost::timer::cpu_timer timer;
+		operation();
+		boost::timer::nanosecond_type elapsed = timer.elapsed().wall;
+		if (best == 0 || elapsed < best)
+		{
+			best = elapsed;
+		}
+	}
+	while (total.elapsed().wall < minimumNs);
+	if (best == 0)
+	{
+		best = 1;
+	}
+	Result result;
+	result.nsPerOp = static_cast<double>(best) / recordCount;
+	result.gbPerS = payloadBytes * recordCount / static_cast<double>(best); //bytes per ns == GB/s
+	return result;
+}
+
+void PrintResult(bool& first, const std::string& handler, const char* padding, unsigned int startbit, unsigned int sizeInBits, DataType type, const char* operation, const Result& result)
+{
+	printf("%s\n    {\"handler\": \"%s\", \"padding\": \"%s\", \"startbit\": %u, \"size\": %u, \"type\": \"%s\", \"operation\": \"%s\", \"ns_per_op\": %.3f, \"gb_per_s\": %.3f}",
+		first ? "" : ",", handler.c_str(), padding, startbit, sizeInBits, TypeName(type), operation, result.nsPerOp, result.gbPerS);
+	first = false;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	boost::timer::nanosecond_type minimumNs = 50 * 1000000LL;
+	if (argc > 1)
+	{
+		minimumNs = static_cast<boost::timer::nanosecond_type>(atof(argv[1]) * 1000000.0);
+	}
+
+	const DataType types[] = { UnsignedIntegerLittleEndian, SignedIntegerLittleEndian, UnsignedIntegerBigEndian, SignedIntegerBigEndian, FloatLittleEndian, FloatBigEndian };
+	const unsigned int integerSizes[] = { 0, 1, 5, 8, 12, 16, 24, 32, 40, 57, 64 };
+	const unsigned int floatSizes[] = { 0, 1, 32, 64 };
+	const unsigned int offsets[] = { 0, 3, 8 };
+	const BufferPadding paddings[] = { ExactBuffer, PaddedBuffer };
+
+	//the records are over-allocated by 8 bytes to satisfy the PaddedBuffer contract
+	std::vector<unsigned char> records(recordSize * recordCount + 8);
+	for (size_t i=0; i<records.size(); ++i)
+	{
+		records[i] = static_cast<unsigned char>(i*131+17);
+	}
+	std::vector<boost::uint64_t> values(recordCount);
+	std::vector<double> doubles(recordCount);
+
+	printf("{\n  \"record_size\": %u,\n  \"record_count\": %u,\n  \"results\": [", static_cast<unsigned int>(recordSize), static_cast<unsigned int>(recordCount));
+	bool first = true;
+	for (size_t t=0; t<sizeof(types)/sizeof(types[0]); ++t)
+	{
+		const DataType type = types[t];
+		const unsigned int* sizes = IsFloat(type) ? floatSizes : integerSizes;
+		const size_t sizeCount = IsFloat(type) ? sizeof(floatSizes)/sizeof(floatSizes[0]) : sizeof(integerSizes)/sizeof(integerSizes[0]);
+		for (size_t s=0; s<sizeCount; ++s)
+		{
+			for (size_t o=0; o<sizeof(offsets)/sizeof(offsets[0]); ++o)
+			{
+				const unsigned int sizeInBits = sizes[s];
+				const unsigned int startbit = offsets[o];
+				if ((startbit%8 + sizeInBits + 7)/8 > 8)
+				{
+					continue; //not supported by any handler
+				}
+				for (size_t p=0; p<sizeof(paddings)/sizeof(paddings[0]); ++p)
+				{
+					auto handler = CreateBufferHandler(startbit, sizeInBits, type, paddings[p]);
+					if (!handler)
+					{
+						continue;
+					}
+					const DataHandler& h = *handler;
+					const std::string name = boost::core::demangle(typeid(h).name());
+					const char* padding = paddings[p] == PaddedBuffer ? "padded" : "exact";
+					const double payloadBytes = sizeInBits / 8.0;
+					unsigned char* data = &records[0];
+					volatile double sink = 0;
+
+					Result read = Measure([&]()
+					{
+						double sum = 0;
+						for (size_t i=0; i<recordCount; ++i)
+						{
+							sum += IsFloat(type) ? h.ReadD(data + i*recordSize, recordSize) : static_cast<double>(h.ReadUI64(data + i*recordSize, recordSize));
+						}
+						sink = sum;
+					}, payloadBytes, minimumNs);
+					PrintResult(first, name, padding, startbit, sizeInBits, type, "read", read);
+
+					Result batch = Measure([&]()
+					{
+						if (IsFloat(type))
+						{
+							h.ReadDBatch(data, recordSize, recordCount, &doubles[0]);
+						}
+						else
+						{
+							h.ReadUI64Batch(data, recordSize, recordCount, &values[0]);
+						}
+					}, payloadBytes, minimumNs);
+					PrintResult(first, name, padding, startbit, sizeInBits, type, "read_batch", batch);
+
+					Result aggregate = Measure([&]()
+					{
+						sink = h.Aggregate(data, recordSize, recordCount).sum;
+					}, payloadBytes, minimumNs);
+					PrintResult(first, name, padding, startbit, sizeInBits, type, "aggregate", aggregate);
+
+					Result write = Measure([&]()
+					{
+						for (size_t i=0; i<recordCount; ++i)
+						{
+							if (IsFloat(type))
+							{
+								h.WriteD(1.5, data + i*recordSize, recordSize);
+							}
+							else
+							{
+								h.WriteUI64(i, data + i*recordSize, recordSize);
+							}
+						}
+					}, payloadBytes, minimumNs);
+					PrintResult(first, name, padding, startbit, sizeInBits, type, "write", write);
+				}
+			}
+		}
+	}
+	printf("\n  ],\n  \"parallel\": [");
+
+	//parallel decode of three fields over 64MB of records, 1, 2, 4, ... threads up to the number of cores
+	{
+		const size_t parallelRecordCount = minimumNs > 0 ? 64*1024*1024 / recordSize : 64*1024;
+		std::vector<unsigned char> parallelRecords(parallelRecordCount * recordSize);
+		for (size_t i=0; i<parallelRecords.size(); ++i)
+		{
+			parallelRecords[i] = static_cast<unsigned char>(i*131+17);
+		}
+		std::vector<boost::shared_ptr<DataHandler>> handlers;
+		handlers.push_back(CreateBufferHandler(3, 21, SignedIntegerLittleEndian));
+		handlers.push_back(CreateBufferHandler(32, 32, UnsignedIntegerBigEndian));
+		handlers.push_back(CreateBufferHandler(69, 40, UnsignedIntegerBigEndian));
+		std::vector<boost::int64_t> output(parallelRecordCount * handlers.size());
+		boost::int64_t* columns[] = { &output[0], &output[parallelRecordCount], &output[2*parallelRecordCount] };
+
+		const unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+		bool firstParallel = true;
+		for (unsigned int threads=1; ; threads = std::min(threads*2, maxThreads))
+		{
+			ParallelDecoder decoder(threads);
+			ParallelDecodeStats best = decoder.Decode(&parallelRecords[0], recordSize, parallelRecordCount, handlers, columns);
+			boost::timer::cpu_timer total;
+			while (total.elapsed().wall < minimumNs)
+			{
+				ParallelDecodeStats stats = decoder.Decode(&parallelRecords[0], recordSize, parallelRecordCount, handlers, columns);
+				if (stats.seconds < best.seconds)
+				{
+					best = stats;
+				}
+			}
+			printf("%s\n    {\"threads\": %u, \"records\": %u, \"chunks\": %u, \"stolen_chunks\": %u, \"ns_per_record\": %.3f, \"gb_per_s\": %.3f}",
+				firstParallel ? "" : ",", best.threads, static_cast<unsigned int>(best.records), static_cast<unsigned int>(best.chunks),
+				static_cast<unsigned int>(best.stolenChunks), best.seconds * 1e9 / best.records, best.GigabytesPerSecond());
+			firstParallel = false;
+			if (threads == maxThreads)
+			{
+				break;
+			}
+		}
+	}
+	printf("\n  ],\n  \"frames\": [");
+
+	//a frame of 12 fields in 16 bytes: whole frame plans against one virtual call per field
+	{
+		std::vector<FieldDescriptor> fields;
+		fields.push_back(FieldDescriptor(0, 8, UnsignedIntegerLittleEndian));
+		fields.push_back(FieldDescriptor(8, 16, SignedIntegerBigEndian));
+		fields.push_back(FieldDescriptor(24, 1, UnsignedIntegerLittleEndian));
+		fields.push_back(FieldDescriptor(25, 7, UnsignedIntegerLittleEndian));
+		fields.push_back(FieldDescriptor(32, 12, SignedIntegerLittleEndian));
+		fields.push_back(FieldDescriptor(44, 4, UnsignedIntegerLittleEndian));
+		fields.push_back(FieldDescriptor(48, 16, UnsignedIntegerBigEndian));
+		fields.push_back(FieldDescriptor(64, 32, FloatLittleEndian));
+		fields.push_back(FieldDescriptor(96, 3, UnsignedIntegerLittleEndian));
+		fields.push_back(FieldDescriptor(99, 13, SignedIntegerLittleEndian));
+		fields.push_back(FieldDescriptor(112, 10, UnsignedIntegerLittleEndian));
+		fields.push_back(FieldDescriptor(122, 6, UnsignedIntegerLittleEndian));
+		std::vector<boost::shared_ptr<DataHandler>> handlers;
+		for (size_t f=0; f<fields.size(); ++f)
+		{
+			handlers.push_back(CreateBufferHandler(fields[f].startbit, fields[f].sizeInBits, fields[f].type));
+		}
+		const DecodePlan decodePlan(fields);
+		const EncodePlan encodePlan(fields);
+		std::vector<double> frameValues(fields.size() * recordCount);
+		for (size_t i=0; i<frameValues.size(); ++i)
+		{
+			frameValues[i] = static_cast<double>(i % 7);
+		}
+		unsigned char* data = &records[0];
+		const double frameBytes = 16;
+		volatile double sink = 0;
+
+		Result handlerWrite = Measure([&]()
+		{
+			for (size_t i=0; i<recordCount; ++i)
+			{
+				for (size_t f=0; f<handlers.size(); ++f)
+				{
+					handlers[f]->WriteD(frameValues[i*fields.size() + f], data + i*recordSize, recordSize);
+				}
+			}
+		}, frameBytes, minimumNs);
+		Result planEncode = Measure([&]()
+		{
+			for (size_t i=0; i<recordCount; ++i)
+			{
+				encodePlan.EncodeD(&frameValues[i*fields.size()], data + i*recordSize, recordSize);
+			}
+		}, frameBytes, minimumNs);
+		Result handlerRead = Measure([&]()
+		{
+			double sum = 0;
+			for (size_t i=0; i<recordCount; ++i)
+			{
+				for (size_t f=0; f<handlers.size(); ++f)
+				{
+					sum += handlers[f]->ReadD(data + i*recordSize, recordSize);
+				}
+			}
+			sink = sum;
+		}, frameBytes, minimumNs);
+		Result planDecode = Measure([&]()
+		{
+			for (size_t i=0; i<recordCount; ++i)
+			{
+				decodePlan.DecodeD(data + i*recordSize, recordSize, &frameValues[i*fields.size()]);
+			}
+		}, frameBytes, minimumNs);
+
+		const char* names[] = { "handler_write", "encode_plan", "handler_read", "decode_plan" };
+		const Result* results[] = { &handlerWrite, &planEncode, &handlerRead, &planDecode };
+		for (size_t i=0; i<4; ++i)
+		{
+			printf("%s\n    {\"operation\": \"%s\", \"fields\": %u, \"ns_per_frame\": %.3f, \"gb_per_s\": %.3f}",
+				i == 0 ? "" : ",", names[i], static_cast<unsigned int>(fields.size()), results[i]->nsPerOp, results[i]->gbPerS);
+		}
+	}
+	printf("\n  ],\n  \"scaled\": [");
+
+	//physical values: raw batch read plus a separate scaling loop against the fused conversion of the scaled handler
+	{
+		const unsigned int startbits[] = { 3, 16, 32 };
+		const unsigned int sizes[] = { 12, 16, 32 };
+		const DataType scaledTypes[] = { SignedIntegerLittleEndian, UnsignedIntegerBigEndian, SignedIntegerLittleEndian };
+		std::vector<boost::int64_t> raw(recordCount);
+		const double factor = 0.1;
+		const double offset = -40;
+		for (size_t f=0; f<3; ++f)
+		{
+			auto handler = CreateBufferHandler(startbits[f], sizes[f], scaledTypes[f]);
+			auto scaled = CreateScaledBufferHandler(startbits[f], sizes[f], scaledTypes[f], factor, offset);
+			const unsigned char* data = &records[0];
+			const double payloadBytes = sizes[f] / 8.0;
+			Result separate = Measure([&]()
+			{
+				handler->ReadI64Batch(data, recordSize, recordCount, &raw[0]);
+				for (size_t i=0; i<recordCount; ++i)
+				{
+					doubles[i] = static_cast<double>(raw[i]) * factor + offset;
+				}
+			}, payloadBytes, minimumNs);
+			Result fused = Measure([&]()
+			{
+				scaled->ReadDBatch(data, recordSize, recordCount, &doubles[0]);
+			}, payloadBytes, minimumNs);
+			const char* names[] = { "read_then_scale", "scaled_batch" };
+			const Result* results[] = { &separate, &fused };
+			for (size_t i=0; i<2; ++i)
+			{
+				printf("%s\n    {\"operation\": \"%s\", \"startbit\": %u, \"size\": %u, \"type\": \"%s\", \"ns_per_op\": %.3f, \"gb_per_s\": %.3f}",
+					f == 0 && i == 0 ? "" : ",", names[i], startbits[f], sizes[f], TypeName(scaledTypes[f]), results[i]->nsPerOp, results[i]->gbPerS);
+			}
+		}
+	}
+	printf("\n  ],\n  \"bit_extraction\": [");
+
+	//the generic handlers with the scalar shift/mask extraction against PEXT/PDEP, empty if the CPU doesn't have BMI2
+#if defined(BUFFERHANDLER_BMI2_BACKEND)
+	if (Implementation::CpuSupportsBmi2())
+	{
+		const unsigned int startbits[] = { 3, 13, 5 };
+		const unsigned int sizes[] = { 12, 17, 57 };
+		const DataType extractionTypes[] = { UnsignedIntegerLittleEndian, SignedIntegerBigEndian, UnsignedIntegerLittleEndian };
+		for (size_t f=0; f<3; ++f)
+		{
+			boost::shared_ptr<DataHandler> backends[] = {
+				Implementation::CreateGenericDataHandler<Implementation::CopyPolicyExact, Implementation::BitExtractionScalar>(startbits[f], sizes[f], extractionTypes[f]),
+				Implementation::CreateGenericDataHandler<Implementation::CopyPolicyExact, Implementation::BitExtractionBmi2>(startbits[f], sizes[f], extractionTypes[f]) };
+			const char* names[] = { "scalar", "bmi2" };
+			const unsigned char* data = &records[0];
+			const double payloadBytes = sizes[f] / 8.0;
+			volatile double sink = 0;
+			for (size_t b=0; b<2; ++b)
+			{
+				const DataHandler& h = *backends[b];
+				Result read = Measure([&]()
+				{
+					double sum = 0;
+					for (size_t i=0; i<recordCount; ++i)
+					{
+						sum += static_cast<double>(h.ReadUI64(data + i*recordSize, recordSize));
+					}
+					sink = sum;
+				}, payloadBytes, minimumNs);
+				Result batch = Measure([&]()
+				{
+					h.ReadUI64Batch(data, recordSize, recordCount, &values[0]);
+				}, payloadBytes, minimumNs);
+				printf("%s\n    {\"backend\": \"%s\", \"startbit\": %u, \"size\": %u, \"type\": \"%s\", \"read_ns_per_op\": %.3f, \"read_batch_ns_per_op\": %.3f}",
+					f == 0 && b == 0 ? "" : ",", names[b], startbits[f], sizes[f], TypeName(extractionTypes[f]), read.nsPerOp, batch.nsPerOp);
+			}
+		}
+	}
+#endif
+	printf("\n  ]\n}\n");
+	return 0;
+}
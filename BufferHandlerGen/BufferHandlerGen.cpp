@@ -0,0 +1,82 @@
+/*
+Copyright (c) 2012, Tobias Langner
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+/*
+Generates a C++ header with one struct and fully inlined decode and encode functions per message of a DBC style schema
+(see \ref BufferHandler::Schema and \ref BufferHandler::GenerateCode).
+
+Usage: BufferHandlerGen <schema file> <output header> [namespace, default Generated]
+*/
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <cctype>
+#include "CodeGenerator.h"
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3 || argc > 4)
+	{
+		std::cerr << "usage: " << argv[0] << " <schema file> <output header> [namespace]" << std::endl;
+		return 2;
+	}
+	const std::string namespaceName = argc > 3 ? argv[3] : "Generated";
+	std::string guard;
+	for (const char* c = argv[2]; *c; ++c)
+	{
+		if (*c == '/' || *c == '\\')
+		{
+			guard.clear();
+		}
+		else
+		{
+			guard += std::isalnum(static_cast<unsigned char>(*c)) ? static_cast<char>(std::toupper(static_cast<unsigned char>(*c))) : '_';
+		}
+	}
+	guard = "GENERATED_" + guard;
+	try
+	{
+		const BufferHandler::Schema schema = BufferHandler::Schema::ParseFile(argv[1]);
+		std::ostringstream code;
+		BufferHandler::GenerateCode(schema, namespaceName, guard, code);
+		std::ofstream file(argv[2], std::ios::out | std::ios::binary | std::ios::trunc);
+		file << code.str();
+		if (!file)
+		{
+			std::cerr << "can't write " << argv[2] << std::endl;
+			return 1;
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -33,7 +33,30 @@ either expressed or implied, of the FreeBSD Project.
 #include <boost/test/unit_test.hpp>
 
 #include <boost/smart_ptr.hpp>
+#include <vector>
+#include <thread>
+#include <cstdio>
+#include <sstream>
 #include "BufferHandler.h"
+#include "DecodePlan.h"
+#include "EncodePlan.h"
+#include "StaticField.h"
+#include "RecordFile.h"
+#include "ParallelDecode.h"
+#include "RecordFilter.h"
+#include "ChangeDetector.h"
+#include "IncrementalDecoder.h"
+#include "MultiplexedPlan.h"
+#include "Schema.h"
+#include "LayoutReport.h"
+#include "CodeGenerator.h"
+#include "ScaledHandler.h"
+#include "FrameRing.h"
+#if defined(BUFFERHANDLER_GENERATED_DECODERS)
+#include "TestSchemaDecoders.h"
+#endif
+#include "HandlerCache.h"
+#include "HandlerSet.h"
 
 using namespace BufferHandler;
 using namespace BufferHandler::Implementation;
@@ -133,6 +156,53 @@ BOOST_AUTO_TEST_CASE ( Swap64Test )
 	auto result2 = Swap64(result);
 	BOOST_CHECK(result2 = testvalue);
 }
+BOOST_AUTO_TEST_CASE ( SwapArrayTest )
+{
+	//cover the SIMD part as well as the scalar tail
+	for (size_t count=0; count<=70; ++count)
+	{
+		std::vector<boost::uint16_t> v16(count+1);
+		std::vector<boost::uint32_t> v32(count+1);
+		std::vector<boost::uint64_t> v64(count+1);
+		for (size_t i=0; i<=count; ++i)
+		{
+			v16[i] = static_cast<boost::uint16_t>(i*0x0301+7);
+			v32[i] = static_cast<boost::uint32_t>(i*0x07050301+7);
+			v64[i] = static_cast<boost::uint64_t>(i)*0x0F0D0B0907050301ULL+7;
+		}
+		std::vector<boost::uint16_t> s16(count+1, 0);
+		std::vector<boost::uint32_t> s32(count+1, 0);
+		std::vector<boost::uint64_t> s64(count+1, 0);
+		SwapArray16(&v16[0], &s16[0], count);
+		SwapArray32(&v32[0], &s32[0], count);
+		SwapArray64(&v64[0], &s64[0], count);
+		for (size_t i=0; i<count; ++i)
+		{
+			BOOST_CHECK(s16[i] == Swap16(v16[i]));
+			BOOST_CHECK(s32[i] == Swap32(v32[i]));
+			BOOST_CHECK(s64[i] == Swap64(v64[i]));
+		}
+		//the element behind the range must not be touched
+		BOOST_CHECK(s16[count] == 0 && s32[count] == 0 && s64[count] == 0);
+
+		SwapArray16(&s16[0], count);
+		SwapArray32(&s32[0], count);
+		SwapArray64(&s64[0], count);
+		for (size_t i=0; i<count; ++i)
+		{
+			BOOST_CHECK(s16[i] == v16[i]);
+			BOOST_CHECK(s32[i] == v32[i]);
+			BOOST_CHECK(s64[i] == v64[i]);
+		}
+	}
+
+	//the AVX2 shuffle is selected at runtime, even if the compiler doesn't target it
+	if (Implementation::CpuSupportsAvx2())
+	{
+		unsigned char bytes[70] = { 0 };
+		BOOST_CHECK(Implementation::SwapBytesSimd(bytes, bytes, sizeof(bytes), 4) == 64);
+	}
+}
 #pragma endregion
 
 #pragma region Policy Tests
@@ -562,7 +632,7 @@ BOOST_AUTO_TEST_CASE ( GenericBitPatternTestUnsignedInt )
 				BOOST_CHECK(result == expected);
 			}
 			{
-				unsigned long expected = 0;
+				boost::uint32_t expected = 0;
 				for (int l = 0; l<i; ++l)
 				{
 					expected <<= 1;
@@ -622,7 +692,7 @@ BOOST_AUTO_TEST_CASE ( FLoatPatternTest )
 		buffer.SetPattern();
 
 		//transfer expected float into buffer
-		boost::uint32_t transferbuffer = *reinterpret_cast<boost::uint32_t*>(&expected);
+		boost::uint32_t transferbuffer = Implementation::BitCast<boost::uint32_t>(expected);
 		for (int k=0; k<32; ++k)
 		{
 			auto tmp = transferbuffer & 1;
@@ -681,9 +751,7 @@ BOOST_AUTO_TEST_CASE(alignedWritingTestUILE8Bit)
 
 BOOST_AUTO_TEST_CASE(alignedWritingTestSILE8Bit)
 {
-#pragma warning ( push, 3 ) //set warning level to 3 for the following declaration
-	unsigned char buffer[10] = { 0,-1,2,3,4,5,6,7,8,9};
-#pragma warning ( pop )
+	unsigned char buffer[10] = { 0,0xFF,2,3,4,5,6,7,8,9};
 	auto h = CreateBufferHandler(8,8,SignedIntegerLittleEndian);
 
 	{
@@ -721,4 +789,1695 @@ BOOST_AUTO_TEST_CASE( bitWriting )
 	}
 }
 #pragma endregion
+#pragma region Generic Writing Tests
+BOOST_AUTO_TEST_CASE( genericWritingRoundTrip )
+{
+	const DataType types[] = { UnsignedIntegerLittleEndian, SignedIntegerLittleEndian, UnsignedIntegerBigEndian, SignedIntegerBigEndian };
+	const int bufferSizeInBytes = 10;
+	for (int t=0; t<4; ++t)
+	{
+		for (int i=2; i<=63; ++i) //loop through all numbers of bits
+		{
+			for (int k=0; (i+k%8+7)/8<=8 && k+i<=bufferSizeInBytes*8; k+=(i%8==0 ? 1 : 3))
+			{
+				TestBuffer buffer(bufferSizeInBytes);
+				buffer.ClearBuffer();
+				buffer.SetPattern();
+				unsigned char reference[bufferSizeInBytes];
+				memcpy(reference, buffer.GetBuffer(), bufferSizeInBytes);
+
+				auto h = CreateBufferHandler(k,i,types[t]);
+				auto original = h->ReadI64(buffer.GetBuffer(),bufferSizeInBytes);
+
+				h->WriteI64(-1,buffer.GetBuffer(),bufferSizeInBytes);
+				boost::uint64_t allOnes = i==64 ? ~0ULL : (1ULL<<i)-1;
+				BOOST_CHECK(h->ReadUI64(buffer.GetBuffer(),bufferSizeInBytes) == (t%2==0 ? allOnes : ~0ULL));
+				h->WriteUI64(1,buffer.GetBuffer(),bufferSizeInBytes);
+				BOOST_CHECK(h->ReadUI64(buffer.GetBuffer(),bufferSizeInBytes) == 1);
+				h->WriteI32(-2,buffer.GetBuffer(),bufferSizeInBytes);
+				BOOST_CHECK(h->ReadI32(buffer.GetBuffer(),bufferSizeInBytes) == (t%2==0 ? static_cast<boost::int32_t>(allOnes-1) : -2));
+
+				//restoring the original value must restore the whole buffer
+				h->WriteI64(original,buffer.GetBuffer(),bufferSizeInBytes);
+				BOOST_CHECK(memcmp(reference, buffer.GetBuffer(), bufferSizeInBytes) == 0);
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( genericWritingFloat )
+{
+	unsigned char buffer[10] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+	auto h = CreateBufferHandler(5,32,FloatLittleEndian);
+	auto h2 = CreateBufferHandler(45,32,FloatBigEndian);
+	h->WriteF(3.0e5f,&buffer[0],sizeof(buffer));
+	h2->WriteD(-1.5,&buffer[0],sizeof(buffer));
+	BOOST_CHECK(h->ReadF(&buffer[0],sizeof(buffer)) == 3.0e5f);
+	BOOST_CHECK(h2->ReadF(&buffer[0],sizeof(buffer)) == -1.5f);
+	//bits outside of both fields are unchanged
+	BOOST_CHECK((buffer[0] & 0x1F) == 0x1F);
+	BOOST_CHECK((buffer[4] & 0xE0) == 0xE0);
+	BOOST_CHECK((buffer[5] & 0xE0) == 0xE0);
+	BOOST_CHECK((buffer[9] & 0x1F) == 0x1F);
+}
+BOOST_AUTO_TEST_CASE( paddedBufferMatchesExactBuffer )
+{
+	const DataType types[] = { UnsignedIntegerLittleEndian, SignedIntegerLittleEndian, UnsignedIntegerBigEndian, SignedIntegerBigEndian };
+	const size_t bufferSizeInBytes = 9;
+	unsigned char buffer[bufferSizeInBytes+8];
+	for (size_t i=0; i<sizeof(buffer); ++i)
+	{
+		buffer[i] = static_cast<unsigned char>(i*97+13);
+	}
+	unsigned char reference[sizeof(buffer)];
+	memcpy(reference, buffer, sizeof(buffer));
+
+	for (int t=0; t<4; ++t)
+	{
+		for (unsigned int i=2; i<=60; ++i)
+		{
+			for (unsigned int k=1; (i+k%8+7)/8<=8 && k+i<=bufferSizeInBytes*8; k+=3)
+			{
+				auto exact = CreateBufferHandler(k,i,types[t]);
+				auto padded = CreateBufferHandler(k,i,types[t],PaddedBuffer);
+				//the padded handlers get the size including the padding
+				auto value = exact->ReadI64(&buffer[0],bufferSizeInBytes);
+				BOOST_CHECK(padded->ReadI64(&buffer[0],sizeof(buffer)) == value);
+
+				padded->WriteI64(value+1,&buffer[0],sizeof(buffer));
+				BOOST_CHECK(exact->ReadI64(&buffer[0],bufferSizeInBytes) == padded->ReadI64(&buffer[0],sizeof(buffer)));
+				padded->WriteI64(value,&buffer[0],sizeof(buffer));
+				BOOST_CHECK(memcmp(reference, buffer, sizeof(buffer)) == 0);
+			}
+		}
+	}
+}
+#pragma endregion
+#pragma endregion
+
+#pragma region Batch Reading Tests
+BOOST_AUTO_TEST_CASE( batchReadMatchesSingleRead )
+{
+	const size_t recordSize = 11;
+	const size_t recordCount = 17;
+	unsigned char buffer[recordSize*recordCount];
+	for (size_t i=0; i<sizeof(buffer); ++i)
+	{
+		buffer[i] = static_cast<unsigned char>(i*37+11);
+	}
+	for (size_t i=0; i<recordCount; ++i)
+	{
+		//keep the float field in a range that converts to all integer types
+		float value = i*1.5f - 7.0f;
+		memcpy(&buffer[i*recordSize+3], &value, sizeof(value));
+	}
+
+	// zero, bit, aligned and generic handlers
+	const unsigned int fields[][3] = {
+		{ 5, 0, SignedIntegerLittleEndian },
+		{ 13, 1, UnsignedIntegerLittleEndian },
+		{ 13, 1, SignedIntegerBigEndian },
+		{ 8, 16, SignedIntegerLittleEndian },
+		{ 16, 32, UnsignedIntegerBigEndian },
+		{ 8, 64, SignedIntegerBigEndian },
+		{ 24, 32, FloatLittleEndian },
+		{ 24, 8, UnsignedIntegerBigEndian },
+		{ 3, 12, UnsignedIntegerLittleEndian },
+		{ 5, 21, SignedIntegerBigEndian },
+		{ 7, 40, SignedIntegerLittleEndian } };
+
+	for (size_t f=0; f<sizeof(fields)/sizeof(fields[0]); ++f)
+	{
+		auto h = CreateBufferHandler(fields[f][0], fields[f][1], static_cast<DataType>(fields[f][2]));
+		boost::uint64_t ui64[recordCount];
+		boost::int64_t i64[recordCount];
+		boost::uint32_t ui32[recordCount];
+		boost::int32_t i32[recordCount];
+		float f32[recordCount];
+		double f64[recordCount];
+		bool b[recordCount];
+		h->ReadUI64Batch(&buffer[0], recordSize, recordCount, ui64);
+		h->ReadI64Batch(&buffer[0], recordSize, recordCount, i64);
+		h->ReadUI32Batch(&buffer[0], recordSize, recordCount, ui32);
+		h->ReadI32Batch(&buffer[0], recordSize, recordCount, i32);
+		h->ReadFBatch(&buffer[0], recordSize, recordCount, f32);
+		h->ReadDBatch(&buffer[0], recordSize, recordCount, f64);
+		h->ReadBBatch(&buffer[0], recordSize, recordCount, b);
+		for (size_t i=0; i<recordCount; ++i)
+		{
+			const unsigned char* record = &buffer[i*recordSize];
+			BOOST_CHECK(ui64[i] == h->ReadUI64(record, recordSize));
+			BOOST_CHECK(i64[i] == h->ReadI64(record, recordSize));
+			BOOST_CHECK(ui32[i] == h->ReadUI32(record, recordSize));
+			BOOST_CHECK(i32[i] == h->ReadI32(record, recordSize));
+			BOOST_CHECK(f32[i] == h->ReadF(record, recordSize));
+			BOOST_CHECK(f64[i] == h->ReadD(record, recordSize));
+			BOOST_CHECK(b[i] == h->ReadB(record, recordSize));
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( batchReadDenseBigEndian )
+{
+	//records that consist of a single big endian value take the block swap path
+	const size_t count = 300;
+	std::vector<boost::uint32_t> buffer(count);
+	for (size_t i=0; i<count; ++i)
+	{
+		buffer[i] = Swap32(static_cast<boost::uint32_t>(i*2654435761u));
+	}
+	auto h = CreateBufferHandler(0, 32, UnsignedIntegerBigEndian);
+	std::vector<boost::uint64_t> values(count);
+	h->ReadUI64Batch(reinterpret_cast<const unsigned char*>(&buffer[0]), sizeof(boost::uint32_t), count, &values[0]);
+	for (size_t i=0; i<count; ++i)
+	{
+		BOOST_CHECK(values[i] == static_cast<boost::uint32_t>(i*2654435761u));
+	}
+}
+#pragma endregion
+
+#pragma region Bounds Check Tests
+BOOST_AUTO_TEST_CASE( boundsCheckPolicies )
+{
+	//the buffers are always large enough, only the size passed to the handlers is too small
+	unsigned char records[64] = {};
+	boost::uint64_t values[4];
+
+	AlignedDataHandler<boost::uint16_t, boost::uint16_t, SwapPolicyNone<boost::uint16_t>, BoundsCheckPerCall> alignedPerCall(8);
+	BOOST_CHECK(alignedPerCall.Extent() == 3);
+	BOOST_CHECK_NO_THROW(alignedPerCall.ReadUI64(records, 3));
+	BOOST_CHECK_THROW(alignedPerCall.ReadUI64(records, 2), std::out_of_range);
+	BOOST_CHECK_THROW(alignedPerCall.WriteUI64(1, records, 2), std::out_of_range);
+	BOOST_CHECK_THROW(alignedPerCall.ReadUI64Batch(records, 2, 4, values), std::out_of_range);
+	BOOST_CHECK_NO_THROW(alignedPerCall.ReadUI64Batch(records, 2, 0, values));
+
+	GenericHandler<boost::uint32_t, boost::uint32_t, BitExtractionScalar<EndianessPolicySwap<boost::uint32_t>>, SignExtensionPolicyExtend<boost::uint32_t>, CopyPolicyExact, BoundsCheckPerCall> genericPerCall(13, 17);
+	BOOST_CHECK(genericPerCall.Extent() == 4);
+	BOOST_CHECK_THROW(genericPerCall.ReadI64(records, 3), std::out_of_range);
+	BOOST_CHECK_THROW(genericPerCall.WriteI64(-1, records, 3), std::out_of_range);
+	BOOST_CHECK_THROW(genericPerCall.ReadUI64Batch(records, 3, 4, values), std::out_of_range);
+	BOOST_CHECK_NO_THROW(genericPerCall.ReadUI64Batch(records, 4, 4, values));
+	//a padded copy loads the whole internal buffer, the extent covers all of it
+	GenericHandler<boost::uint32_t, boost::uint32_t, BitExtractionScalar<EndianessPolicySwap<boost::uint32_t>>, SignExtensionPolicyExtend<boost::uint32_t>, CopyPolicyPadded, BoundsCheckPerCall> paddedPerCall(13, 17);
+	BOOST_CHECK(paddedPerCall.Extent() == 5);
+	BOOST_CHECK_NO_THROW(paddedPerCall.ReadI64(records, 5));
+	BOOST_CHECK_THROW(paddedPerCall.ReadI64(records, 4), std::out_of_range);
+	BOOST_CHECK_THROW(paddedPerCall.WriteI64(-1, records, 4), std::out_of_range);
+	BOOST_CHECK_THROW(paddedPerCall.ReadUI64Batch(records, 4, 4, values), std::out_of_range);
+
+	BitDataHandler<SignPolicyUnsigned, BoundsCheckPerCall> bitPerCall(17);
+	BOOST_CHECK(bitPerCall.Extent() == 3);
+	BOOST_CHECK_THROW(bitPerCall.ReadB(records, 2), std::out_of_range);
+	BOOST_CHECK_THROW(bitPerCall.WriteB(true, records, 2), std::out_of_range);
+
+	//per batch: single calls are only asserted, the batch is checked once
+	GenericHandler<boost::uint32_t, boost::uint32_t, BitExtractionScalar<EndianessPolicySwap<boost::uint32_t>>, SignExtensionPolicyExtend<boost::uint32_t>, CopyPolicyExact, BoundsCheckPerBatch> genericPerBatch(13, 17);
+	BOOST_CHECK_NO_THROW(genericPerBatch.ReadI64(records, 4));
+	BOOST_CHECK_THROW(genericPerBatch.ReadUI64Batch(records, 3, 4, values), std::out_of_range);
+	BOOST_CHECK_THROW(genericPerBatch.Aggregate(records, 3, 4), std::out_of_range);
+	BitDataHandler<SignPolicyUnsigned, BoundsCheckPerBatch> bitPerBatch(17);
+	BOOST_CHECK_THROW(bitPerBatch.ReadUI64Batch(records, 2, 4, values), std::out_of_range);
+
+	AlignedDataHandler<boost::uint16_t, boost::uint16_t, SwapPolicySwap<boost::uint16_t>, BoundsCheckNone> alignedUnchecked(8);
+	BOOST_CHECK_NO_THROW(alignedUnchecked.ReadUI64Batch(records, 2, 4, values));
+
+	//the extents of the factory handlers and the up front validation of a batch of buffers
+	std::vector<boost::shared_ptr<DataHandler>> handlers;
+	handlers.push_back(CreateBufferHandler(3, 12, SignedIntegerLittleEndian));
+	handlers.push_back(CreateBufferHandler(8, 16, UnsignedIntegerBigEndian));
+	handlers.push_back(CreateBufferHandler(9, 1, UnsignedIntegerLittleEndian));
+	handlers.push_back(CreateBufferHandler(40, 0, UnsignedIntegerLittleEndian));
+	handlers.push_back(CreateScaledBufferHandler(32, 32, FloatBigEndian, 2, 1));
+	BOOST_CHECK(handlers[0]->Extent() == 2);
+	BOOST_CHECK(handlers[1]->Extent() == 3);
+	BOOST_CHECK(handlers[2]->Extent() == 2);
+	BOOST_CHECK(handlers[3]->Extent() == 0);
+	BOOST_CHECK(handlers[4]->Extent() == 8);
+	BOOST_CHECK(CreateBufferHandler(20, 13, SignedIntegerLittleEndian, PaddedBuffer)->Extent() == 2 + sizeof(boost::uint32_t));
+	//a handler without an extent fails every validation
+	BOOST_CHECK(handlers[0]->DataHandler::Extent() == std::numeric_limits<size_t>::max());
+	BufferBatchValidator validator(handlers);
+	BOOST_CHECK(validator.Extent() == 8);
+	BOOST_CHECK_NO_THROW(validator.Check(8, 100));
+	BOOST_CHECK_NO_THROW(validator.Check(7, 0));
+	BOOST_CHECK_THROW(validator.Check(7, 100), std::out_of_range);
+	const size_t sizes[] = { 8, 12, 9, 7, 8 };
+	BOOST_CHECK_NO_THROW(validator.Check(sizes, 3));
+	try
+	{
+		validator.Check(sizes, 5);
+		BOOST_ERROR("buffer 3 is too small");
+	}
+	catch (const std::out_of_range& e)
+	{
+		BOOST_CHECK(std::string(e.what()).find("buffer 3 ") != std::string::npos);
+	}
+}
+#pragma endregion
+
+#pragma region Instrumentation Tests
+BOOST_AUTO_TEST_CASE( instrumentationCountsHandlerCalls )
+{
+	auto aligned = CreateBufferHandler(8, 16, UnsignedIntegerBigEndian);
+	auto bit = CreateBufferHandler(3, 1, UnsignedIntegerLittleEndian);
+	auto generic = CreateBufferHandler(20, 13, SignedIntegerLittleEndian);
+	auto padded = CreateBufferHandler(20, 13, SignedIntegerLittleEndian, PaddedBuffer);
+	std::vector<unsigned char> records(10 * 16, 0x5A);
+	std::vector<double> values(10);
+
+	ResetHandlerStatistics();
+	aligned->ReadD(&records[0], 16);
+	aligned->WriteUI64(7, &records[0], 16);
+	aligned->ReadDBatch(&records[0], 16, 10, &values[0]);
+	aligned->Aggregate(&records[0], 16, 10);
+	bit->ReadB(&records[0], 16);
+	generic->ReadI64(&records[0], 16);
+	generic->ReadDBatch(&records[0], 16, 10, &values[0]); //counted once, not once per record
+	generic->WriteI64(-3, &records[0], 16);
+	padded->ReadI64(&records[0], 16);
+	//counts of finished threads are kept
+	std::thread([&]() { generic->ReadI64(&records[0], 16); }).join();
+	auto other = CreateBufferHandler(0, 1, SignedIntegerLittleEndian);
+	HandlerStatistics statistics = CollectHandlerStatistics();
+
+	std::ostringstream json;
+	statistics.WriteJson(json);
+	BOOST_CHECK(json.str().find("\"generic_exact\": {\"created\": ") != std::string::npos);
+	if (!HandlerStatisticsEnabled())
+	{
+		BOOST_CHECK(statistics.Counter(GenericExactHandlerKind, ReadOperation).calls == 0);
+		BOOST_CHECK(statistics.created[BitHandlerKind] == 0);
+		return;
+	}
+	BOOST_CHECK(statistics.Counter(AlignedHandlerKind, ReadOperation).calls == 1);
+	BOOST_CHECK(statistics.Counter(AlignedHandlerKind, ReadOperation).bytes == 2);
+	BOOST_CHECK(statistics.Counter(AlignedHandlerKind, WriteOperation).calls == 1);
+	BOOST_CHECK(statistics.Counter(AlignedHandlerKind, BatchOperation).calls == 2);
+	BOOST_CHECK(statistics.Counter(AlignedHandlerKind, BatchOperation).values == 20);
+	BOOST_CHECK(statistics.Counter(AlignedHandlerKind, BatchOperation).bytes == 40);
+	BOOST_CHECK(statistics.Counter(BitHandlerKind, ReadOperation).calls == 1);
+	BOOST_CHECK(statistics.Counter(GenericExactHandlerKind, ReadOperation).calls == 2);
+	BOOST_CHECK(statistics.Counter(GenericExactHandlerKind, ReadOperation).bytes == 2*3); //3 bytes cover bits 20 to 32
+	BOOST_CHECK(statistics.Counter(GenericExactHandlerKind, BatchOperation).calls == 1);
+	BOOST_CHECK(statistics.Counter(GenericExactHandlerKind, BatchOperation).values == 10);
+	BOOST_CHECK(statistics.Counter(GenericExactHandlerKind, WriteOperation).calls == 1);
+	BOOST_CHECK(statistics.Counter(GenericPaddedHandlerKind, ReadOperation).bytes == 4);
+	BOOST_CHECK(statistics.created[BitHandlerKind] == 1);
+	BOOST_CHECK(statistics.created[AlignedHandlerKind] == 0);
+
+	std::ostringstream text;
+	statistics.WriteText(text);
+	BOOST_CHECK(text.str().find("generic_exact: created 0\n  read: calls 2, values 2, bytes 6\n") != std::string::npos);
+
+	ResetHandlerStatistics();
+	statistics = CollectHandlerStatistics();
+	BOOST_CHECK(statistics.Counter(GenericExactHandlerKind, ReadOperation).calls == 0);
+	bit->ReadB(&records[0], 16);
+	BOOST_CHECK(CollectHandlerStatistics().Counter(BitHandlerKind, ReadOperation).calls == 1);
+}
+#pragma endregion
+
+#pragma region Aggregate Tests
+BOOST_AUTO_TEST_CASE( aggregateMatchesReadD )
+{
+	const size_t recordSize = 13;
+	const size_t recordCount = 1003;
+	std::vector<unsigned char> records(recordSize*recordCount);
+	for (size_t i=0; i<records.size(); ++i)
+	{
+		records[i] = static_cast<unsigned char>(i*151+i/13);
+	}
+	auto floatHandler = CreateBufferHandler(32, 32, FloatBigEndian);
+	auto doubleHandler = CreateBufferHandler(40, 64, FloatLittleEndian);
+	for (size_t i=0; i<recordCount; ++i)
+	{
+		floatHandler->WriteD(i*0.25 - 100, &records[i*recordSize], recordSize);
+		doubleHandler->WriteD(i*-1.5, &records[i*recordSize], recordSize);
+	}
+	const FieldDescriptor fields[] = {
+		FieldDescriptor(0, 8, UnsignedIntegerLittleEndian), FieldDescriptor(8, 8, SignedIntegerLittleEndian),
+		FieldDescriptor(0, 16, SignedIntegerBigEndian), FieldDescriptor(16, 16, UnsignedIntegerLittleEndian),
+		FieldDescriptor(0, 32, SignedIntegerLittleEndian), FieldDescriptor(0, 32, UnsignedIntegerBigEndian),
+		FieldDescriptor(0, 64, SignedIntegerBigEndian), FieldDescriptor(0, 64, UnsignedIntegerLittleEndian),
+		FieldDescriptor(32, 32, FloatBigEndian), FieldDescriptor(40, 64, FloatLittleEndian),
+		FieldDescriptor(3, 17, SignedIntegerLittleEndian), FieldDescriptor(5, 40, UnsignedIntegerBigEndian),
+		FieldDescriptor(9, 1, UnsignedIntegerLittleEndian), FieldDescriptor(9, 0, UnsignedIntegerLittleEndian),
+		FieldDescriptor(14, 1, SignedIntegerBigEndian), FieldDescriptor(21, 1, FloatLittleEndian)
+	};
+	for (size_t f=0; f<sizeof(fields)/sizeof(fields[0]); ++f)
+	{
+		auto handler = CreateBufferHandler(fields[f].startbit, fields[f].sizeInBits, fields[f].type);
+		FieldAggregate expected;
+		for (size_t i=0; i<recordCount; ++i)
+		{
+			expected.Add(handler->ReadD(&records[i*recordSize], recordSize));
+		}
+		FieldAggregate actual = handler->Aggregate(&records[0], recordSize, recordCount);
+		BOOST_CHECK(actual.count == expected.count);
+		BOOST_CHECK(actual.nonZero == expected.nonZero);
+		BOOST_CHECK(actual.min == expected.min);
+		BOOST_CHECK(actual.max == expected.max);
+		BOOST_CHECK_CLOSE(actual.sum, expected.sum, 1e-9);
+	}
+	BOOST_CHECK(CreateBufferHandler(0, 16, SignedIntegerBigEndian)->Aggregate(&records[0], recordSize, 0).count == 0);
+	BOOST_CHECK(CreateBufferHandler(0, 16, SignedIntegerBigEndian)->Aggregate(&records[0], recordSize, 1).Mean() == CreateBufferHandler(0, 16, SignedIntegerBigEndian)->ReadD(&records[0], recordSize));
+}
+#pragma endregion
+
+#pragma region Decode Plan Tests
+BOOST_AUTO_TEST_CASE( decodePlanMatchesHandlers )
+{
+	unsigned char buffer[24];
+	for (size_t i=0; i<sizeof(buffer); ++i)
+	{
+		buffer[i] = static_cast<unsigned char>(i*73+5);
+	}
+	float floatValue = -12.25f;
+	memcpy(&buffer[16], &floatValue, sizeof(floatValue));
+
+	std::vector<FieldDescriptor> fields;
+	fields.push_back(FieldDescriptor(100, 12, SignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(0, 8, UnsignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(8, 16, SignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(27, 1, SignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(29, 0, UnsignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(30, 13, SignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(43, 17, UnsignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(64, 64, SignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(65, 63, UnsignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(128, 32, FloatLittleEndian));
+	fields.push_back(FieldDescriptor(131, 61, SignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(70, 16, FloatLittleEndian)); // read through the handler
+
+	DecodePlan plan(fields);
+	BOOST_CHECK(plan.FieldCount() == fields.size());
+
+	std::vector<double> d(fields.size());
+	std::vector<boost::int64_t> i64(fields.size());
+	plan.DecodeD(&buffer[0], sizeof(buffer), &d[0]);
+	plan.DecodeI64(&buffer[0], sizeof(buffer), &i64[0]);
+	for (size_t i=0; i<fields.size(); ++i)
+	{
+		auto h = CreateBufferHandler(fields[i].startbit, fields[i].sizeInBits, fields[i].type);
+		BOOST_CHECK(d[i] == h->ReadD(&buffer[0], sizeof(buffer)));
+		BOOST_CHECK(i64[i] == h->ReadI64(&buffer[0], sizeof(buffer)));
+	}
+}
+
+BOOST_AUTO_TEST_CASE( decodePlanMergesLoads )
+{
+	std::vector<FieldDescriptor> fields;
+	for (unsigned int i=0; i<8; ++i)
+	{
+		fields.push_back(FieldDescriptor(i*8, 8, i%2 == 0 ? UnsignedIntegerLittleEndian : SignedIntegerBigEndian));
+	}
+	fields.push_back(FieldDescriptor(64, 16, UnsignedIntegerLittleEndian));
+	DecodePlan plan(fields);
+	BOOST_CHECK(plan.WordCount() == 2);
+	fields.push_back(FieldDescriptor(130, 64, UnsignedIntegerLittleEndian));
+	BOOST_CHECK_THROW(DecodePlan tooWide(fields), std::invalid_argument);
+
+	unsigned char buffer[10] = { 1, 0xFF, 3, 0xFE, 5, 6, 7, 8, 9, 10 };
+	std::vector<boost::int64_t> values(fields.size());
+	plan.DecodeI64(&buffer[0], sizeof(buffer), &values[0]);
+	BOOST_CHECK(values[0] == 1);
+	BOOST_CHECK(values[1] == -1);
+	BOOST_CHECK(values[3] == -2);
+	BOOST_CHECK(values[8] == 0x0A09);
+}
+
+BOOST_AUTO_TEST_CASE( decodePlanRejectsShortBuffer )
+{
+	std::vector<FieldDescriptor> fields;
+	fields.push_back(FieldDescriptor(0, 8, UnsignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(8, 16, UnsignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(200, 0, UnsignedIntegerBigEndian)); //0bit fields don't need any byte
+	DecodePlan plan(fields);
+	BOOST_CHECK(plan.Extent() == 3);
+
+	const unsigned char buffer[3] = { 7, 0x12, 0x34 };
+	std::vector<boost::int64_t> values(fields.size());
+	plan.DecodeI64(buffer, sizeof(buffer), &values[0]);
+	BOOST_CHECK(values[1] == 0x1234);
+	//a buffer that ends inside of a field must not decode the truncated bits
+	BOOST_CHECK_THROW(plan.DecodeI64(buffer, 2, &values[0]), std::out_of_range);
+	BOOST_CHECK_THROW(plan.DecodeI64(buffer, 0, &values[0]), std::out_of_range);
+
+	fields.push_back(FieldDescriptor(30, 16, FloatLittleEndian)); //read through the handler, ends in byte 5
+	BOOST_CHECK(DecodePlan(fields).Extent() == 6);
+	BOOST_CHECK(DecodePlan(std::vector<FieldDescriptor>()).Extent() == 0);
+}
+
+BOOST_AUTO_TEST_CASE( encodePlanMatchesHandlers )
+{
+	std::vector<FieldDescriptor> fields;
+	fields.push_back(FieldDescriptor(100, 12, SignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(0, 8, UnsignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(8, 16, SignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(27, 1, SignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(29, 0, UnsignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(30, 10, SignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(45, 17, UnsignedIntegerBigEndian)); // big endian: bytes 5 to 7, lowest bit is bit 5 of byte 7
+	fields.push_back(FieldDescriptor(64, 32, FloatLittleEndian));
+	fields.push_back(FieldDescriptor(128, 64, FloatBigEndian));
+	fields.push_back(FieldDescriptor(113, 11, UnsignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(196, 16, FloatLittleEndian)); // written through the handler
+	fields.push_back(FieldDescriptor(212, 20, SignedIntegerLittleEndian)); // ends at the last byte
+	const double values[] = { -2000, 200, -30000, -1, 0, -400, 100000, 2.5, -1.0e100, 2047, 1, -500000 };
+
+	EncodePlan plan(fields);
+	BOOST_CHECK(plan.FieldCount() == fields.size());
+	BOOST_CHECK(plan.WordCount() < fields.size());
+
+	unsigned char expected[29];
+	for (size_t i=0; i<sizeof(expected); ++i)
+	{
+		expected[i] = static_cast<unsigned char>(i*73+5);
+	}
+	unsigned char actual[sizeof(expected)];
+	memcpy(actual, expected, sizeof(expected));
+	for (size_t i=0; i<fields.size(); ++i)
+	{
+		CreateBufferHandler(fields[i].startbit, fields[i].sizeInBits, fields[i].type)->WriteD(values[i], &expected[0], sizeof(expected));
+	}
+	plan.EncodeD(values, &actual[0], sizeof(actual));
+	BOOST_CHECK(memcmp(expected, actual, sizeof(expected)) == 0);
+
+	//round trip of the integers
+	std::vector<boost::int64_t> integers(fields.size());
+	for (size_t i=0; i<fields.size(); ++i)
+	{
+		integers[i] = static_cast<boost::int64_t>(values[i]);
+	}
+	memset(actual, 0xA5, sizeof(actual));
+	plan.EncodeI64(&integers[0], &actual[0], sizeof(actual));
+	std::vector<boost::int64_t> decoded(fields.size());
+	DecodePlan(fields).DecodeI64(&actual[0], sizeof(actual), &decoded[0]);
+	for (size_t i=0; i<fields.size(); ++i)
+	{
+		if (fields[i].type != FloatLittleEndian && fields[i].type != FloatBigEndian)
+		{
+			BOOST_CHECK(decoded[i] == (fields[i].sizeInBits == 0 ? 0 : integers[i]));
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( encodePlanOutOfRangeValues )
+{
+	std::vector<FieldDescriptor> fields;
+	fields.push_back(FieldDescriptor(0, 1, UnsignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(1, 1, UnsignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(2, 1, SignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(4, 12, UnsignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(16, 12, SignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(28, 4, UnsignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(64, 64, UnsignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(128, 64, SignedIntegerBigEndian));
+	const double values[] = { 2, 0.5, -2, 1.0e30, -1.0e30, std::numeric_limits<double>::quiet_NaN(), 1.0e30, -std::numeric_limits<double>::infinity() };
+	EncodePlan plan(fields);
+
+	unsigned char buffer[24];
+	memset(buffer, 0, sizeof(buffer));
+	plan.EncodeD(values, &buffer[0], sizeof(buffer));
+	std::vector<boost::int64_t> decoded(fields.size());
+	DecodePlan(fields).DecodeI64(&buffer[0], sizeof(buffer), &decoded[0]);
+	//single bit fields are flags, every value other than 0 sets them
+	BOOST_CHECK(decoded[0] == 1);
+	BOOST_CHECK(decoded[1] == 1);
+	BOOST_CHECK(decoded[2] == -1);
+	//out of range values saturate to 64 bit before they are masked to the field, NaN becomes 0
+	BOOST_CHECK(decoded[3] == 0xFFF);
+	BOOST_CHECK(decoded[4] == 0);
+	BOOST_CHECK(decoded[5] == 0);
+	BOOST_CHECK(CreateBufferHandler(64, 64, UnsignedIntegerLittleEndian)->ReadUI64(&buffer[0], sizeof(buffer)) == std::numeric_limits<boost::uint64_t>::max());
+	BOOST_CHECK(decoded[7] == std::numeric_limits<boost::int64_t>::min());
+
+	const boost::int64_t integers[] = { 2, -4, 6, 0, 0, 0, 0, 0 };
+	memset(buffer, 0, sizeof(buffer));
+	plan.EncodeI64(integers, &buffer[0], sizeof(buffer));
+	DecodePlan(fields).DecodeI64(&buffer[0], sizeof(buffer), &decoded[0]);
+	BOOST_CHECK(decoded[0] == 1);
+	BOOST_CHECK(decoded[1] == 1);
+	BOOST_CHECK(decoded[2] == -1);
+}
+
+BOOST_AUTO_TEST_CASE( encodePlanRejectsShortBuffer )
+{
+	std::vector<FieldDescriptor> fields;
+	fields.push_back(FieldDescriptor(32, 16, UnsignedIntegerLittleEndian));
+	EncodePlan plan(fields);
+	BOOST_CHECK(plan.Extent() == 6);
+
+	const boost::int64_t value = 0x1234;
+	unsigned char buffer[16];
+	memset(buffer, 0xA5, sizeof(buffer));
+	//the buffer ends before the field and inside of the field, nothing may be written
+	BOOST_CHECK_THROW(plan.EncodeI64(&value, buffer, 3), std::out_of_range);
+	BOOST_CHECK_THROW(plan.EncodeI64(&value, buffer, 5), std::out_of_range);
+	for (size_t i=0; i<sizeof(buffer); ++i)
+	{
+		BOOST_CHECK(buffer[i] == 0xA5);
+	}
+	plan.EncodeI64(&value, buffer, 6);
+	BOOST_CHECK(buffer[4] == 0x34);
+	BOOST_CHECK(buffer[5] == 0x12);
+	BOOST_CHECK(buffer[6] == 0xA5);
+}
+#pragma endregion
+
+#pragma region Static Field Tests
+template<typename StaticField>
+void CheckStaticField(unsigned int startbit, unsigned int sizeInBits, DataType type)
+{
+	unsigned char buffer[16];
+	for (size_t i=0; i<sizeof(buffer); ++i)
+	{
+		buffer[i] = static_cast<unsigned char>(i*59+3);
+	}
+	auto h = CreateBufferHandler(startbit, sizeInBits, type);
+	BOOST_CHECK(static_cast<boost::uint64_t>(StaticField::Read(&buffer[0])) == h->ReadUI64(&buffer[0], sizeof(buffer)));
+	BOOST_CHECK(static_cast<boost::int64_t>(StaticField::Read(&buffer[0])) == h->ReadI64(&buffer[0], sizeof(buffer)));
+
+	//write a different value, read it again and make sure the surrounding bits are unchanged
+	unsigned char reference[16];
+	memcpy(reference, buffer, sizeof(buffer));
+	typename StaticField::ValueType value = StaticField::Read(&buffer[0]);
+	typename StaticField::ValueType other = static_cast<typename StaticField::ValueType>(value != 0 ? 0 : (std::numeric_limits<typename StaticField::ValueType>::is_signed ? -1 : 1));
+	StaticField::Write(other, &buffer[0]);
+	BOOST_CHECK(StaticField::Read(&buffer[0]) == other);
+	StaticField::Write(value, &buffer[0]);
+	BOOST_CHECK(memcmp(reference, buffer, sizeof(buffer)) == 0);
+}
+
+BOOST_AUTO_TEST_CASE( staticFieldMatchesHandlers )
+{
+	CheckStaticField<Field<8,8,UnsignedIntegerLittleEndian>>(8, 8, UnsignedIntegerLittleEndian);
+	CheckStaticField<Field<16,16,SignedIntegerBigEndian>>(16, 16, SignedIntegerBigEndian);
+	CheckStaticField<Field<32,32,UnsignedIntegerBigEndian>>(32, 32, UnsignedIntegerBigEndian);
+	CheckStaticField<Field<64,64,SignedIntegerLittleEndian>>(64, 64, SignedIntegerLittleEndian);
+	CheckStaticField<Field<3,1,SignedIntegerLittleEndian>>(3, 1, SignedIntegerLittleEndian);
+	CheckStaticField<Field<5,11,UnsignedIntegerLittleEndian>>(5, 11, UnsignedIntegerLittleEndian);
+	CheckStaticField<Field<13,19,SignedIntegerLittleEndian>>(13, 19, SignedIntegerLittleEndian);
+	CheckStaticField<Field<21,7,UnsignedIntegerBigEndian>>(21, 7, UnsignedIntegerBigEndian);
+	CheckStaticField<Field<42,22,SignedIntegerBigEndian>>(42, 22, SignedIntegerBigEndian);
+	CheckStaticField<Field<7,50,SignedIntegerLittleEndian>>(7, 50, SignedIntegerLittleEndian);
+	CheckStaticField<Field<11,1,FloatLittleEndian>>(11, 1, FloatLittleEndian);
+	CheckStaticField<Field<12,1,FloatBigEndian>>(12, 1, FloatBigEndian);
+}
+
+BOOST_AUTO_TEST_CASE( staticFieldFloat )
+{
+	typedef Field<32,32,FloatBigEndian> AlignedFloat;
+	typedef Field<67,32,FloatLittleEndian> UnalignedFloat;
+	typedef Field<64,64,FloatLittleEndian> AlignedDouble;
+	unsigned char buffer[16] = { 0 };
+	AlignedFloat::Write(-2.5f, &buffer[0]);
+	AlignedDouble::Write(0.5, &buffer[0]);
+	UnalignedFloat::Write(1.75f, &buffer[0]);
+	BOOST_CHECK(AlignedFloat::Read(&buffer[0]) == -2.5f);
+	BOOST_CHECK(CreateBufferHandler(32,32,FloatBigEndian)->ReadF(&buffer[0], sizeof(buffer)) == -2.5f);
+	BOOST_CHECK(UnalignedFloat::Read(&buffer[0]) == 1.75f);
+	BOOST_CHECK(CreateBufferHandler(67,32,FloatLittleEndian)->ReadF(&buffer[0], sizeof(buffer)) == 1.75f);
+
+	//a single bit float is a flag
+	typedef Field<100,1,FloatBigEndian> Flag;
+	Flag::Write(true, &buffer[0]);
+	BOOST_CHECK(Flag::Read(&buffer[0]));
+	BOOST_CHECK(CreateBufferHandler(100,1,FloatBigEndian)->ReadD(&buffer[0], sizeof(buffer)) == 1.0);
+	BOOST_CHECK(UnalignedFloat::Read(&buffer[0]) == 1.75f);
+}
+#pragma endregion
+
+#pragma region Handler Cache Tests
+BOOST_AUTO_TEST_CASE( handlerCacheInterning )
+{
+	HandlerCache cache;
+	auto a = CreateBufferHandler(12, 20, SignedIntegerBigEndian, cache);
+	auto b = CreateBufferHandler(12, 20, SignedIntegerBigEndian, cache);
+	auto c = CreateBufferHandler(12, 20, SignedIntegerLittleEndian, cache);
+	BOOST_CHECK(a.get() == b.get());
+	BOOST_CHECK(a.get() != c.get());
+
+	//descriptors that lead to the same handler share it
+	auto zero1 = CreateBufferHandler(3, 0, UnsignedIntegerLittleEndian, cache);
+	auto zero2 = CreateBufferHandler(40, 0, FloatBigEndian, cache);
+	BOOST_CHECK(zero1.get() == zero2.get());
+	auto bit1 = CreateBufferHandler(9, 1, SignedIntegerLittleEndian, cache);
+	auto bit2 = CreateBufferHandler(9, 1, SignedIntegerBigEndian, cache);
+	BOOST_CHECK(bit1.get() == bit2.get());
+	BOOST_CHECK(cache.Size() == 4);
+
+	unsigned char buffer[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+	BOOST_CHECK(a->ReadI64(&buffer[0], sizeof(buffer)) == CreateBufferHandler(12, 20, SignedIntegerBigEndian)->ReadI64(&buffer[0], sizeof(buffer)));
+
+	cache.Clear();
+	BOOST_CHECK(cache.Size() == 0);
+	BOOST_CHECK(a->ReadI64(&buffer[0], sizeof(buffer)) == b->ReadI64(&buffer[0], sizeof(buffer)));
+}
+
+BOOST_AUTO_TEST_CASE( handlerCacheConcurrentAccess )
+{
+	HandlerCache cache;
+	std::vector<DataHandler*> seen(4);
+	std::vector<std::thread> threads;
+	for (size_t t=0; t<seen.size(); ++t)
+	{
+		threads.push_back(std::thread([&cache, &seen, t]()
+		{
+			for (unsigned int i=0; i<1000; ++i)
+			{
+				cache.Get((i/8)%64, 8+i%8, UnsignedIntegerLittleEndian);
+			}
+			seen[t] = cache.Get(5, 11, UnsignedIntegerLittleEndian).get();
+		}));
+	}
+	for (size_t t=0; t<threads.size(); ++t)
+	{
+		threads[t].join();
+	}
+	BOOST_CHECK(cache.Size() == 64*8);
+	for (size_t t=1; t<seen.size(); ++t)
+	{
+		BOOST_CHECK(seen[t] == seen[0]);
+	}
+}
+#pragma endregion
+
+#pragma region Handler Set Tests
+BOOST_AUTO_TEST_CASE( handlerSetMatchesFactory )
+{
+	//one field for every handler variant
+	std::vector<FieldDescriptor> fields;
+	fields.push_back(FieldDescriptor(0, 0, UnsignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(3, 1, SignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(8, 16, UnsignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(24, 8, SignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(32, 32, FloatBigEndian));
+	fields.push_back(FieldDescriptor(64, 64, FloatLittleEndian));
+	fields.push_back(FieldDescriptor(131, 13, UnsignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(145, 27, SignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(177, 47, SignedIntegerLittleEndian));
+	const BufferPadding paddings[] = { ExactBuffer, PaddedBuffer };
+	for (size_t p=0; p<2; ++p)
+	{
+		HandlerSet set(fields, paddings[p]);
+		BOOST_REQUIRE(set.Size() == fields.size());
+		std::vector<unsigned char> buffer(28 + 8);
+		for (size_t i=0; i<buffer.size(); ++i)
+		{
+			buffer[i] = static_cast<unsigned char>(i * 37 + 11);
+		}
+		for (size_t i=0; i<fields.size(); ++i)
+		{
+			auto handler = CreateBufferHandler(fields[i].startbit, fields[i].sizeInBits, fields[i].type, paddings[p]);
+			BOOST_CHECK(set[i].ReadUI64(&buffer[0], buffer.size()) == handler->ReadUI64(&buffer[0], buffer.size()));
+			BOOST_CHECK(set[i].Extent() == handler->Extent());
+			BOOST_CHECK(set.Handlers()[i] == &set[i]);
+			//all handlers of a small set are placed in one block
+			const char* first = reinterpret_cast<const char*>(&set[0]);
+			BOOST_CHECK(reinterpret_cast<const char*>(&set[i]) - first < static_cast<std::ptrdiff_t>(set.BytesReserved()));
+		}
+		set[6].WriteUI64(0x1234, &buffer[0], buffer.size());
+		BOOST_CHECK(set[6].ReadUI64(&buffer[0], buffer.size()) == 0x1234);
+	}
+
+	HandlerSet set(64);
+	for (unsigned int i=0; i<100; ++i)
+	{
+		set.Add(i, 11, SignedIntegerLittleEndian);
+	}
+	BOOST_CHECK(set.Size() == 100);
+	BOOST_CHECK(set.BytesReserved() >= 100 * sizeof(void*));
+	BOOST_CHECK_THROW(set.Add(0, 16, FloatLittleEndian), std::invalid_argument);
+	BOOST_CHECK(set.Size() == 100);
+	unsigned char buffer[16] = { 0xFF, 0x07, 0x80 };
+	BOOST_CHECK(set[0].ReadI64(&buffer[0], sizeof(buffer)) == -1);
+	BOOST_CHECK(set[11].ReadI64(&buffer[0], sizeof(buffer)) == 0);
+	set.Clear();
+	BOOST_CHECK(set.Size() == 0 && set.BytesReserved() == 0);
+}
+#pragma endregion
+
+#pragma region BMI2 Backend Tests
+#if defined(BUFFERHANDLER_BMI2_BACKEND)
+BOOST_AUTO_TEST_CASE( bmi2MatchesScalar )
+{
+	if (!Implementation::CpuSupportsBmi2())
+	{
+		BOOST_TEST_MESSAGE("BMI2 not supported by this CPU, skipping");
+		return;
+	}
+	const DataType types[] = { UnsignedIntegerLittleEndian, SignedIntegerLittleEndian, UnsignedIntegerBigEndian, SignedIntegerBigEndian };
+	unsigned char buffer[16];
+	for (size_t i=0; i<sizeof(buffer); ++i)
+	{
+		buffer[i] = static_cast<unsigned char>(i*59+7);
+	}
+	unsigned char reference[sizeof(buffer)];
+	memcpy(reference, buffer, sizeof(buffer));
+
+	std::vector<FieldDescriptor> fields;
+	for (int t=0; t<4; ++t)
+	{
+		for (unsigned int i=2; i<=60; ++i)
+		{
+			for (unsigned int k=1; (i+k%8+7)/8<=8 && k+i<=sizeof(buffer)*8; k+=5)
+			{
+				auto scalar = Implementation::CreateGenericDataHandler<Implementation::CopyPolicyExact, Implementation::BitExtractionScalar>(k,i,types[t]);
+				auto bmi2 = Implementation::CreateGenericDataHandler<Implementation::CopyPolicyExact, Implementation::BitExtractionBmi2>(k,i,types[t]);
+				auto value = scalar->ReadI64(&buffer[0],sizeof(buffer));
+				BOOST_CHECK(bmi2->ReadI64(&buffer[0],sizeof(buffer)) == value);
+
+				bmi2->WriteI64(value-1,&buffer[0],sizeof(buffer));
+				BOOST_CHECK(scalar->ReadI64(&buffer[0],sizeof(buffer)) == bmi2->ReadI64(&buffer[0],sizeof(buffer)));
+				bmi2->WriteI64(value,&buffer[0],sizeof(buffer));
+				BOOST_CHECK(memcmp(reference, buffer, sizeof(buffer)) == 0);
+				fields.push_back(FieldDescriptor(k,i,types[t]));
+			}
+		}
+	}
+
+	DecodePlan scalarPlan(fields, false);
+	DecodePlan bmi2Plan(fields);
+	BOOST_CHECK(!scalarPlan.UsesBmi2());
+	BOOST_CHECK(bmi2Plan.UsesBmi2());
+	std::vector<boost::int64_t> expected(fields.size());
+	std::vector<boost::int64_t> actual(fields.size());
+	scalarPlan.DecodeI64(&buffer[0], sizeof(buffer), &expected[0]);
+	bmi2Plan.DecodeI64(&buffer[0], sizeof(buffer), &actual[0]);
+	BOOST_CHECK(expected == actual);
+}
+#endif
+#pragma endregion
+
+#pragma region Record File Tests
+BOOST_AUTO_TEST_CASE( recordFileDecodesColumns )
+{
+	const char* path = "BufferHandlerTest_records.bin";
+	const size_t recordSize = 12;
+	const size_t recordCount = 20000; //more than one block of DecodeColumns
+	std::vector<boost::shared_ptr<DataHandler>> handlers;
+	handlers.push_back(CreateBufferHandler(0, 16, UnsignedIntegerLittleEndian));
+	handlers.push_back(CreateBufferHandler(20, 19, SignedIntegerBigEndian));
+	handlers.push_back(CreateBufferHandler(64, 32, FloatLittleEndian));
+
+	std::vector<unsigned char> records(recordSize*recordCount + 5); //with a trailing partial record
+	for (size_t i=0; i<recordCount; ++i)
+	{
+		unsigned char* record = &records[i*recordSize];
+		handlers[0]->WriteUI64(i, record, recordSize);
+		handlers[1]->WriteI64(static_cast<boost::int64_t>(i) - 10000, record, recordSize);
+		handlers[2]->WriteD(i*0.5, record, recordSize);
+	}
+	FILE* file = fopen(path, "wb");
+	BOOST_REQUIRE(file != NULL);
+	fwrite(&records[0], 1, records.size(), file);
+	fclose(file);
+
+	{
+		RecordFile recordFile(path, recordSize);
+		BOOST_CHECK(recordFile.RecordCount() == recordCount);
+		BOOST_CHECK(memcmp(recordFile.Record(7), &records[7*recordSize], recordSize) == 0);
+
+		std::vector<double> a(recordCount), b(recordCount), c(recordCount);
+		double* columns[] = { &a[0], &b[0], &c[0] };
+		recordFile.DecodeColumns(handlers, 0, recordCount, columns);
+		bool allEqual = true;
+		for (size_t i=0; i<recordCount; ++i)
+		{
+			allEqual = allEqual && a[i] == (i & 0xFFFF) && b[i] == static_cast<double>(static_cast<boost::int64_t>(i) - 10000) && c[i] == i*0.5;
+		}
+		BOOST_CHECK(allEqual);
+
+		std::vector<boost::int64_t> signedColumn(100);
+		recordFile.DecodeColumn(*handlers[1], 50, signedColumn.size(), &signedColumn[0]);
+		BOOST_CHECK(signedColumn[0] == 50 - 10000);
+		BOOST_CHECK(signedColumn[99] == 149 - 10000);
+	}
+	remove(path);
+
+	BOOST_CHECK_THROW(RecordFile missing(path, recordSize), std::runtime_error);
+	BOOST_CHECK_THROW(RecordFile zeroSize(path, 0), std::invalid_argument);
+}
+#pragma endregion
+
+#pragma region Parallel Decode Tests
+BOOST_AUTO_TEST_CASE( parallelDecodeMatchesSerial )
+{
+	const size_t recordSize = 10;
+	const size_t recordCount = 50000;
+	std::vector<unsigned char> records(recordSize*recordCount);
+	for (size_t i=0; i<records.size(); ++i)
+	{
+		records[i] = static_cast<unsigned char>(i*41+3);
+	}
+	std::vector<boost::shared_ptr<DataHandler>> handlers;
+	handlers.push_back(CreateBufferHandler(3, 21, SignedIntegerLittleEndian));
+	handlers.push_back(CreateBufferHandler(32, 32, UnsignedIntegerBigEndian));
+	handlers.push_back(CreateBufferHandler(66, 13, UnsignedIntegerBigEndian));
+
+	std::vector<boost::int64_t> expected(recordCount*handlers.size());
+	for (size_t f=0; f<handlers.size(); ++f)
+	{
+		handlers[f]->ReadI64Batch(&records[0], recordSize, recordCount, &expected[f*recordCount]);
+	}
+
+	const unsigned int threadCounts[] = { 1, 4 };
+	for (size_t t=0; t<2; ++t)
+	{
+		ParallelDecoder decoder(threadCounts[t]);
+		BOOST_CHECK(decoder.ThreadCount() == threadCounts[t]);
+		for (size_t chunk=0; chunk<=100; chunk+=100) //default and small chunks
+		{
+			std::vector<boost::int64_t> actual(recordCount*handlers.size(), 0);
+			boost::int64_t* columns[] = { &actual[0], &actual[recordCount], &actual[2*recordCount] };
+			ParallelDecodeStats stats = decoder.Decode(&records[0], recordSize, recordCount, handlers, columns, chunk);
+			BOOST_CHECK(actual == expected);
+			BOOST_CHECK(stats.records == recordCount);
+			BOOST_CHECK(stats.threads == threadCounts[t]);
+			BOOST_CHECK(stats.chunks > 0);
+		}
+	}
+	ParallelDecoder decoder;
+	boost::int64_t* columns[] = { NULL, NULL, NULL };
+	BOOST_CHECK(decoder.Decode(&records[0], recordSize, 0, handlers, columns).chunks == 0);
+}
+
+/**
+Fails the batch read of every chunk that contains the record at failAt.
+*/
+class ThrowingDataHandler : public Implementation::ZeroDataHandler
+{
+	const unsigned char* m_failAt;
+public:
+	explicit ThrowingDataHandler(const unsigned char* failAt) : m_failAt(failAt) {}
+	virtual void ReadI64Batch(const unsigned char* records, size_t recordSize, size_t count, boost::int64_t* values) const
+	{
+		if (m_failAt >= records && m_failAt < records + recordSize*count)
+		{
+			throw std::runtime_error("decode failed");
+		}
+		ZeroDataHandler::ReadI64Batch(records, recordSize, count, values);
+	}
+};
+
+BOOST_AUTO_TEST_CASE( parallelDecodeForwardsExceptions )
+{
+	const size_t recordSize = 8;
+	const size_t recordCount = 10000;
+	std::vector<unsigned char> records(recordSize*recordCount, 0x5A);
+	std::vector<boost::int64_t> output(2*recordCount);
+	boost::int64_t* columns[] = { &output[0], &output[recordCount] };
+
+	const unsigned int threadCounts[] = { 1, 4 };
+	for (size_t t=0; t<2; ++t)
+	{
+		ParallelDecoder decoder(threadCounts[t]);
+		//the first record is decoded by the caller, the last one by the last worker
+		const size_t failingRecords[] = { 0, recordCount - 1 };
+		for (size_t r=0; r<2; ++r)
+		{
+			std::vector<boost::shared_ptr<DataHandler>> handlers;
+			handlers.push_back(CreateBufferHandler(0, 32, UnsignedIntegerLittleEndian));
+			handlers.push_back(boost::shared_ptr<DataHandler>(new ThrowingDataHandler(&records[failingRecords[r]*recordSize])));
+			BOOST_CHECK_THROW(decoder.Decode(&records[0], recordSize, recordCount, handlers, columns, 64), std::runtime_error);
+		}
+
+		//records too small for the fields are rejected before any work is started
+		std::vector<boost::shared_ptr<DataHandler>> handlers;
+		handlers.push_back(CreateBufferHandler(0, 32, UnsignedIntegerLittleEndian));
+		handlers.push_back(CreateBufferHandler(40, 32, UnsignedIntegerLittleEndian));
+		BOOST_CHECK_THROW(decoder.Decode(&records[0], recordSize, recordCount, handlers, columns), std::out_of_range);
+
+		//the decoder is still usable
+		handlers[1] = CreateBufferHandler(32, 32, UnsignedIntegerLittleEndian);
+		BOOST_CHECK(decoder.Decode(&records[0], recordSize, recordCount, handlers, columns).records == recordCount);
+		BOOST_CHECK(output[recordCount - 1] == 0x5A5A5A5A);
+	}
+}
+#pragma endregion
+
+#pragma region Record Filter Tests
+BOOST_AUTO_TEST_CASE( recordFilterMatchesDecodedValues )
+{
+	const size_t recordSize = 11;
+	const size_t recordCount = 1000;
+	std::vector<unsigned char> records(recordSize*recordCount);
+	for (size_t i=0; i<records.size(); ++i)
+	{
+		records[i] = static_cast<unsigned char>(i*89+i/7);
+	}
+	const FieldDescriptor fields[] = {
+		FieldDescriptor(0, 8, UnsignedIntegerLittleEndian),
+		FieldDescriptor(8, 16, SignedIntegerBigEndian),
+		FieldDescriptor(27, 11, SignedIntegerLittleEndian),
+		FieldDescriptor(43, 21, UnsignedIntegerBigEndian),
+		FieldDescriptor(70, 1, UnsignedIntegerBigEndian),
+		FieldDescriptor(24, 64, SignedIntegerLittleEndian), //reaches the end of the record
+		FieldDescriptor(50, 0, UnsignedIntegerLittleEndian)
+	};
+	const boost::int64_t bounds[][2] = { { 10, 200 }, { -5000, 5000 }, { -100, -1 }, { 70000, 1000000 }, { 1, 1 }, { 0, 1LL << 62 }, { -1, 3 } };
+
+	//every predicate with the scalar and (if supported) with the AVX2 comparison
+	for (int allowAvx2=0; allowAvx2<2; ++allowAvx2)
+	{
+		for (size_t f=0; f<sizeof(fields)/sizeof(fields[0]); ++f)
+		{
+			auto handler = CreateBufferHandler(fields[f].startbit, fields[f].sizeInBits, fields[f].type);
+			RecordFilter filter(allowAvx2 != 0);
+			BOOST_CHECK(filter.UsesAvx2() == (allowAvx2 != 0 && Implementation::CpuSupportsAvx2()));
+			filter.AddPredicate(FieldPredicate::Between(fields[f], bounds[f][0], bounds[f][1]));
+			std::vector<size_t> selection;
+			filter.Select(&records[0], recordSize, recordCount, selection);
+
+			std::vector<size_t> expected;
+			for (size_t i=0; i<recordCount; ++i)
+			{
+				auto value = handler->ReadI64(&records[i*recordSize], recordSize);
+				if (value >= bounds[f][0] && value <= bounds[f][1])
+				{
+					expected.push_back(i);
+				}
+			}
+			BOOST_CHECK(selection == expected);
+			BOOST_CHECK(!expected.empty() || f == 6);
+		}
+	}
+
+	//conjunction, bitmap and decoding of the selected records
+	RecordFilter filter;
+	filter.AddPredicate(FieldPredicate::Between(fields[0], 0, 127));
+	filter.AddPredicate(FieldPredicate::Equal(fields[4], 0));
+	std::vector<boost::uint64_t> bitmap;
+	const size_t matches = filter.SelectBitmap(&records[0], recordSize, recordCount, bitmap);
+	BOOST_CHECK(bitmap.size() == (recordCount + 63) / 64);
+	std::vector<size_t> selection;
+	BOOST_CHECK(filter.Select(&records[0], recordSize, recordCount, selection) == matches);
+	std::vector<boost::int64_t> decoded(selection.size());
+	auto other = CreateBufferHandler(fields[3].startbit, fields[3].sizeInBits, fields[3].type);
+	DecodeSelected(*other, &records[0], recordSize, selection, decoded.empty() ? NULL : &decoded[0]);
+	size_t expectedMatches = 0;
+	for (size_t i=0; i<recordCount; ++i)
+	{
+		const unsigned char* record = &records[i*recordSize];
+		if (record[0] < 128 && (record[8] & 0x40) == 0)
+		{
+			BOOST_CHECK((bitmap[i/64] >> (i%64)) & 1);
+			BOOST_CHECK(decoded[expectedMatches] == other->ReadI64(record, recordSize));
+			++expectedMatches;
+		}
+	}
+	BOOST_CHECK(matches == expectedMatches);
+	BOOST_CHECK_THROW(filter.AddPredicate(FieldPredicate::Equal(FieldDescriptor(0, 32, FloatLittleEndian), 1)), std::invalid_argument);
+
+	//a predicate beyond the end of the record is rejected instead of reading the following records or past the buffer
+	filter.AddPredicate(FieldPredicate::Equal(FieldDescriptor(84, 8, UnsignedIntegerLittleEndian), 0));
+	BOOST_CHECK_THROW(filter.Select(&records[0], recordSize, recordCount, selection), std::out_of_range);
+	BOOST_CHECK(filter.Select(&records[0], recordSize, 0, selection) == 0);
+}
+#pragma endregion
+
+#pragma region Change Detector Tests
+BOOST_AUTO_TEST_CASE( changeDetectorMatchesDecodedValues )
+{
+	std::vector<FieldDescriptor> fields;
+	fields.push_back(FieldDescriptor(0, 8, UnsignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(8, 16, SignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(27, 1, SignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(29, 0, UnsignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(30, 10, SignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(45, 17, UnsignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(64, 32, FloatBigEndian));
+	fields.push_back(FieldDescriptor(96, 64, SignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(165, 13, UnsignedIntegerBigEndian)); // ends at the last byte
+	const size_t bufferSize = 23;
+	unsigned char previous[bufferSize];
+	for (size_t i=0; i<bufferSize; ++i)
+	{
+		previous[i] = static_cast<unsigned char>(i*73+5);
+	}
+
+	ChangeDetector detector(fields);
+	BOOST_CHECK(detector.FieldCount() == fields.size());
+	BOOST_CHECK(detector.WordCount() < fields.size());
+	std::vector<unsigned int> changed;
+	BOOST_CHECK(detector.ChangedFields(previous, previous, bufferSize, changed) == 0);
+
+	//flip every single bit and compare with the fields whose raw value changed
+	for (size_t bit=0; bit<bufferSize*8; ++bit)
+	{
+		unsigned char current[bufferSize];
+		memcpy(current, previous, bufferSize);
+		current[bit/8] ^= static_cast<unsigned char>(1 << (bit%8));
+		std::vector<unsigned int> expected;
+		for (unsigned int f=0; f<fields.size(); ++f)
+		{
+			auto handler = CreateBufferHandler(fields[f].startbit, fields[f].sizeInBits, fields[f].type);
+			const bool isFloat = fields[f].type == FloatLittleEndian || fields[f].type == FloatBigEndian;
+			if (isFloat ? Implementation::BitCast<boost::uint64_t>(handler->ReadD(previous, bufferSize)) != Implementation::BitCast<boost::uint64_t>(handler->ReadD(current, bufferSize))
+				: handler->ReadUI64(previous, bufferSize) != handler->ReadUI64(current, bufferSize))
+			{
+				expected.push_back(f);
+			}
+		}
+		detector.ChangedFields(previous, current, bufferSize, changed);
+		BOOST_CHECK(changed == expected);
+	}
+	BOOST_CHECK_THROW(ChangeDetector tooWide(std::vector<FieldDescriptor>(1, FieldDescriptor(3, 64, SignedIntegerLittleEndian))), std::invalid_argument);
+	//buffers that end before the last field are rejected instead of read past their end
+	BOOST_CHECK(detector.Extent() == bufferSize);
+	BOOST_CHECK_THROW(detector.ChangedFields(previous, previous, bufferSize - 1, changed), std::out_of_range);
+	BOOST_CHECK_THROW(detector.ChangedFields(previous, previous, 0, changed), std::out_of_range);
+
+	//more words than one block, one field per word, the last field ends at the last byte
+	std::vector<FieldDescriptor> spread;
+	for (unsigned int i=0; i<150; ++i)
+	{
+		spread.push_back(FieldDescriptor(i*9*8 + 3, 5, UnsignedIntegerLittleEndian));
+	}
+	ChangeDetector spreadDetector(spread);
+	BOOST_CHECK(spreadDetector.WordCount() == spread.size());
+	std::vector<unsigned char> before(149*9 + 1, 0x3C);
+	BOOST_CHECK(spreadDetector.Extent() == before.size());
+	const unsigned int changedFields[] = { 0, 63, 64, 100, 149 };
+	for (size_t i=0; i<sizeof(changedFields)/sizeof(changedFields[0]); ++i)
+	{
+		std::vector<unsigned char> after(before);
+		after[changedFields[i]*9] ^= 0x10;
+		after[changedFields[i]*9] ^= 0x01; //outside of the field
+		BOOST_CHECK(spreadDetector.ChangedFields(&before[0], &after[0], before.size(), changed) == 1);
+		BOOST_CHECK(changed[0] == changedFields[i]);
+	}
+}
+#pragma endregion
+
+#pragma region Incremental Decoder Tests
+BOOST_AUTO_TEST_CASE( incrementalDecoderMatchesFullDecode )
+{
+	std::vector<FieldDescriptor> fields;
+	fields.push_back(FieldDescriptor(0, 8, UnsignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(8, 16, SignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(27, 1, SignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(29, 0, UnsignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(30, 10, SignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(45, 17, UnsignedIntegerBigEndian));
+	fields.push_back(FieldDescriptor(64, 32, FloatBigEndian));
+	fields.push_back(FieldDescriptor(96, 64, SignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(165, 13, UnsignedIntegerBigEndian));
+	const size_t bufferSize = 23;
+	unsigned char buffer[bufferSize];
+	for (size_t i=0; i<bufferSize; ++i)
+	{
+		buffer[i] = static_cast<unsigned char>(i*73+5);
+	}
+
+	IncrementalDecoder decoder(fields, bufferSize);
+	BOOST_CHECK(decoder.Update(buffer) == fields.size());
+	BOOST_CHECK(decoder.Update(buffer) == 0);
+
+	boost::uint32_t state = 12345;
+	for (int step=0; step<200; ++step)
+	{
+		state = state * 1103515245 + 12345;
+		const size_t firstByte = (state >> 8) % bufferSize;
+		const size_t byteCount = 1 + (state >> 20) % std::min<size_t>(3, bufferSize - firstByte);
+		for (size_t b=firstByte; b<firstByte+byteCount; ++b)
+		{
+			buffer[b] = static_cast<unsigned char>(buffer[b] + (state >> 13) + 1);
+		}
+		const size_t decoded = step % 2 ? decoder.UpdateRange(buffer, firstByte, byteCount) : decoder.Update(buffer);
+		BOOST_CHECK(decoded == decoder.LastChanged().size());
+		BOOST_CHECK(decoded < fields.size());
+		for (size_t f=0; f<fields.size(); ++f)
+		{
+			auto handler = CreateBufferHandler(fields[f].startbit, fields[f].sizeInBits, fields[f].type);
+			const double expected = handler->ReadD(buffer, bufferSize);
+			BOOST_CHECK(Implementation::BitCast<boost::uint64_t>(decoder.Value(f)) == Implementation::BitCast<boost::uint64_t>(expected));
+		}
+	}
+	BOOST_CHECK_THROW(decoder.UpdateRange(buffer, bufferSize + 1, 0), std::out_of_range);
+	BOOST_CHECK_THROW(IncrementalDecoder(fields, bufferSize - 1), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE( incrementalDecoderEmptyBuffer )
+{
+	std::vector<FieldDescriptor> fields;
+	fields.push_back(FieldDescriptor(0, 0, UnsignedIntegerLittleEndian));
+	IncrementalDecoder decoder(fields, 0);
+	const unsigned char buffer[1] = { 0 };
+	BOOST_CHECK(decoder.BufferSize() == 0);
+	BOOST_CHECK(decoder.Update(buffer) == fields.size());
+	BOOST_CHECK(decoder.Update(buffer) == 0);
+	BOOST_CHECK(decoder.UpdateRange(buffer, 0, 0) == 0);
+	BOOST_CHECK(decoder.Value(0) == 0.0);
+	BOOST_CHECK_THROW(decoder.UpdateRange(buffer, 0, 1), std::out_of_range);
+}
+#pragma endregion
+
+#pragma region Multiplexed Plan Tests
+BOOST_AUTO_TEST_CASE( multiplexedPlanDecodesSelectedLayout )
+{
+	MultiplexedPlan plan(FieldDescriptor(0, 8, UnsignedIntegerLittleEndian));
+	std::vector<FieldDescriptor> layouts[3];
+	layouts[0].push_back(FieldDescriptor(8, 16, SignedIntegerLittleEndian));
+	layouts[0].push_back(FieldDescriptor(24, 32, FloatBigEndian));
+	layouts[1].push_back(FieldDescriptor(8, 16, SignedIntegerLittleEndian));
+	layouts[1].push_back(FieldDescriptor(29, 3, UnsignedIntegerLittleEndian));
+	layouts[1].push_back(FieldDescriptor(37, 12, SignedIntegerBigEndian));
+	layouts[2].push_back(FieldDescriptor(8, 64, SignedIntegerBigEndian));
+	const unsigned int selectorValues[3] = { 0, 7, 255 };
+	for (int i=0; i<3; ++i)
+	{
+		plan.AddLayout(selectorValues[i], layouts[i]);
+	}
+	BOOST_CHECK(plan.LayoutCount() == 3);
+	BOOST_CHECK(plan.MaxFieldCount() == 3);
+	BOOST_CHECK_THROW(plan.AddLayout(7, layouts[0]), std::invalid_argument);
+	BOOST_CHECK_THROW(MultiplexedPlan(FieldDescriptor(0, 8, SignedIntegerLittleEndian)), std::invalid_argument);
+
+	unsigned char buffer[9];
+	for (size_t i=0; i<sizeof(buffer); ++i)
+	{
+		buffer[i] = static_cast<unsigned char>(i*37+11);
+	}
+	for (int i=0; i<3; ++i)
+	{
+		buffer[0] = static_cast<unsigned char>(selectorValues[i]);
+		double values[3];
+		boost::int64_t integers[3];
+		boost::uint64_t selector = 0;
+		BOOST_CHECK(plan.DecodeD(buffer, sizeof(buffer), values, selector) == layouts[i].size());
+		BOOST_CHECK(selector == selectorValues[i]);
+		BOOST_CHECK(plan.DecodeI64(buffer, sizeof(buffer), integers, selector) == layouts[i].size());
+		for (size_t f=0; f<layouts[i].size(); ++f)
+		{
+			auto handler = CreateBufferHandler(layouts[i][f].startbit, layouts[i][f].sizeInBits, layouts[i][f].type);
+			BOOST_CHECK(values[f] == handler->ReadD(buffer, sizeof(buffer)));
+			BOOST_CHECK(integers[f] == handler->ReadI64(buffer, sizeof(buffer)));
+		}
+	}
+	buffer[0] = 8;
+	double values[3];
+	boost::uint64_t selector = 0;
+	BOOST_CHECK(plan.DecodeD(buffer, sizeof(buffer), values, selector) == 0);
+	BOOST_CHECK(selector == 8);
+	BOOST_CHECK(plan.Layout(8) == 0);
+	BOOST_CHECK(plan.Layout(1000) == 0);
+	//an 8bit selector can't select 256, the layout would never be decoded
+	BOOST_CHECK_THROW(plan.AddLayout(256, layouts[0]), std::invalid_argument);
+	//a buffer that ends before the selector or inside of the selected layout
+	BOOST_CHECK_THROW(plan.DecodeD(buffer, 0, values, selector), std::out_of_range);
+	buffer[0] = static_cast<unsigned char>(selectorValues[0]);
+	BOOST_CHECK_THROW(plan.DecodeD(buffer, 1, values, selector), std::out_of_range);
+
+	//the selector is extracted like its handler, for every offset, size and endianess
+	const DataType selectorTypes[] = { UnsignedIntegerLittleEndian, UnsignedIntegerBigEndian };
+	for (int t=0; t<2; ++t)
+	{
+		for (unsigned int size=1; size<=16; ++size)
+		{
+			for (unsigned int startbit=0; startbit<8; startbit+=3)
+			{
+				MultiplexedPlan sized(FieldDescriptor(startbit, size, selectorTypes[t]));
+				BOOST_CHECK_THROW(sized.AddLayout(1u << size, layouts[0]), std::invalid_argument);
+				auto handler = CreateBufferHandler(startbit, size, selectorTypes[t]);
+				for (size_t i=0; i<sizeof(buffer); ++i)
+				{
+					buffer[i] = static_cast<unsigned char>(i*37 + size*11 + startbit);
+				}
+				BOOST_CHECK(sized.Selector(buffer, sizeof(buffer)) == handler->ReadUI64(buffer, sizeof(buffer)));
+				BOOST_CHECK_NO_THROW(sized.Selector(buffer, handler->Extent()));
+				BOOST_CHECK_THROW(sized.Selector(buffer, handler->Extent() - 1), std::out_of_range);
+			}
+		}
+	}
+}
+#pragma endregion
+
+#pragma region Schema Tests
+BOOST_AUTO_TEST_CASE( schemaParsesAndCachesDescription )
+{
+	const std::string text =
+		"VERSION \"\"\n"
+		"BU_: Engine Dashboard\n"
+		"BO_ 512 Dashboard: 4 Dashboard\n"
+		" SG_ Brightness : 0|8@1+ (1,0) [0|255] \"\" Engine\n"
+		"\n"
+		"BO_ 100 EngineData: 8 Engine\n"
+		" SG_ Speed : 0|16@1+ (0.1,0) [0|6553.5] \"km/h\" Dashboard\n"
+		" SG_ Torque : 11|12@0- (0.5,-10) [-1034|1013.5] \"Nm\" Dashboard\n"
+		" SG_ Mode M : 24|4@1+ (1,0) [0|15] \"\" Dashboard\n"
+		" SG_ Temperature m0 : 32|32@1- (1,0) [0|0] \"degC\" Dashboard\n"
+		" SG_ Pressure m1 : 39|32@0+ (1,0) [0|0] \"bar\" Dashboard\n"
+		"\n"
+		"CM_ SG_ 100 Speed \"vehicle speed\";\n"
+		"SIG_VALTYPE_ 100 Temperature : 1;\n";
+	Schema schema = Schema::Parse(text);
+	BOOST_REQUIRE(schema.Messages().size() == 2);
+	BOOST_CHECK(schema.Messages()[0].id == 100 && schema.Messages()[1].id == 512);
+	const SchemaMessage* engine = schema.FindMessage(100);
+	BOOST_REQUIRE(engine != 0 && engine->signals.size() == 5);
+	BOOST_CHECK(schema.FindMessage(101) == 0);
+	BOOST_CHECK(engine->name == "EngineData" && engine->size == 8);
+	BOOST_CHECK(engine->signals[1].field.startbit == 8 && engine->signals[1].field.type == SignedIntegerBigEndian);
+	BOOST_CHECK(engine->signals[1].factor == 0.5 && engine->signals[1].offset == -10);
+	BOOST_CHECK(engine->signals[2].muxValue == SchemaSignal::Selector && engine->signals[3].muxValue == 0 && engine->signals[4].muxValue == 1);
+	BOOST_CHECK(engine->signals[3].field.type == FloatLittleEndian);
+	BOOST_CHECK(engine->signals[4].field.startbit == 32 && engine->signals[4].field.type == UnsignedIntegerBigEndian);
+
+	//Motorola layout: the most significant nibble of Torque is the low nibble of byte 1, the rest is byte 2
+	HandlerCache cache;
+	std::vector<boost::shared_ptr<DataHandler>> handlers = Schema::CreateHandlers(*engine, cache);
+	unsigned char frame[8] = { 0, 0x5A, 0xBC, 0, 0x12, 0x34, 0x56, 0x78 };
+	BOOST_CHECK(handlers[1]->ReadI64(frame, sizeof(frame)) == 0xABC - 0x1000);
+	BOOST_CHECK(handlers[4]->ReadUI64(frame, sizeof(frame)) == 0x12345678);
+
+	BOOST_CHECK_THROW(Schema::Parse("BO_ 1 A: 2 X\n SG_ B : 8|16@1+ (1,0) [0|0] \"\" X\n"), std::runtime_error);
+	BOOST_CHECK_THROW(Schema::Parse(" SG_ B : 0|8@1+ (1,0) [0|0] \"\" X\n"), std::runtime_error);
+
+	const char* textPath = "BufferHandlerTest_schema.dbc";
+	const char* cachePath = "BufferHandlerTest_schema.bin";
+	std::remove(cachePath);
+	{
+		std::ofstream file(textPath, std::ios::out | std::ios::binary);
+		file << text;
+	}
+	Schema parsed = Schema::LoadCached(textPath, cachePath); //writes the cache
+	Schema cached = Schema::LoadBinary(cachePath, &text);
+	BOOST_REQUIRE(cached.Messages().size() == parsed.Messages().size());
+	for (size_t m=0; m<parsed.Messages().size(); ++m)
+	{
+		const SchemaMessage& a = parsed.Messages()[m];
+		const SchemaMessage& b = cached.Messages()[m];
+		BOOST_CHECK(a.id == b.id && a.name == b.name && a.size == b.size);
+		BOOST_REQUIRE(a.signals.size() == b.signals.size());
+		for (size_t i=0; i<a.signals.size(); ++i)
+		{
+			BOOST_CHECK(a.signals[i].name == b.signals[i].name);
+			BOOST_CHECK(a.signals[i].field.startbit == b.signals[i].field.startbit);
+			BOOST_CHECK(a.signals[i].field.sizeInBits == b.signals[i].field.sizeInBits);
+			BOOST_CHECK(a.signals[i].field.type == b.signals[i].field.type);
+			BOOST_CHECK(a.signals[i].factor == b.signals[i].factor && a.signals[i].offset == b.signals[i].offset);
+			BOOST_CHECK(a.signals[i].muxValue == b.signals[i].muxValue);
+		}
+	}
+	const std::string changed = text + "BO_ 7 Other: 1 X\n";
+	BOOST_CHECK_THROW(Schema::LoadBinary(cachePath, &changed), std::runtime_error);
+	std::remove(textPath);
+	std::remove(cachePath);
+}
+#pragma endregion
+
+#pragma region Layout Report Tests
+BOOST_AUTO_TEST_CASE( layoutReportExplainsSlowPaths )
+{
+	const std::string text =
+		"BO_ 7 Layout: 8 Engine\n"
+		" SG_ Speed : 0|16@1+ (1,0) [0|0] \"\" Dashboard\n"
+		" SG_ Flag : 16|1@1+ (1,0) [0|0] \"\" Dashboard\n"
+		" SG_ Odd : 17|12@1+ (1,0) [0|0] \"\" Dashboard\n"
+		" SG_ Shifted : 33|8@1- (1,0) [0|0] \"\" Dashboard\n";
+	Schema schema = Schema::Parse(text);
+	std::vector<LayoutReport> reports = AnalyzeSchema(schema);
+	BOOST_REQUIRE(reports.size() == 1);
+	const LayoutReport& report = reports[0];
+	BOOST_CHECK(report.name == "Layout" && report.size == 8);
+	BOOST_REQUIRE(report.fields.size() == 4);
+	BOOST_CHECK(report.fields[0].kind == AlignedHandlerKind && report.fields[0].reason.empty());
+	BOOST_CHECK(report.fields[1].kind == BitHandlerKind);
+	BOOST_CHECK(report.fields[2].name == "Odd" && report.fields[2].kind == GenericExactHandlerKind);
+	BOOST_CHECK(report.fields[2].suggestion.find("widen it to 16 bits") != std::string::npos);
+	BOOST_CHECK(report.fields[3].suggestion.find("startbit 32 or 40") != std::string::npos);
+	BOOST_CHECK(report.GenericFields().size() == 2 && report.UndecodableFields().empty());
+	BOOST_CHECK(report.kindCount[AlignedHandlerKind] == 1 && report.kindCount[GenericExactHandlerKind] == 2);
+	BOOST_CHECK(report.totalCost > 4);
+
+	//the report matches the handlers the factory creates
+	for (size_t i=0; i<report.fields.size(); ++i)
+	{
+		const FieldDescriptor& field = report.fields[i].field;
+		BOOST_CHECK(CreateBufferHandler(field.startbit, field.sizeInBits, field.type).get() != 0);
+	}
+
+	std::ostringstream out;
+	report.WriteText(out);
+	BOOST_CHECK(out.str().find("Odd #2 (startbit 17, 12 bits, UnsignedIntegerLittleEndian): generic_exact") != std::string::npos);
+	BOOST_CHECK(out.str().find("Speed") == std::string::npos); //fast paths are not listed
+	std::ostringstream json;
+	report.WriteJson(json);
+	BOOST_CHECK(json.str().find("{\"name\": \"Flag\", \"startbit\": 16, \"size\": 1, \"type\": \"UnsignedIntegerLittleEndian\", \"handler\": \"bit\"") != std::string::npos);
+
+	//the padded generic handler and the fields no handler can decode
+	std::vector<FieldDescriptor> fields;
+	fields.push_back(FieldDescriptor(17, 12, UnsignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(0, 16, FloatLittleEndian));
+	fields.push_back(FieldDescriptor(4, 64, SignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(60, 10, UnsignedIntegerLittleEndian));
+	fields.push_back(FieldDescriptor(8, 8, static_cast<DataType>(9)));
+	LayoutReport padded = AnalyzeLayout(fields, PaddedBuffer, 8);
+	BOOST_CHECK(padded.fields[0].kind == GenericPaddedHandlerKind && padded.fields[0].cost < report.fields[2].cost);
+	BOOST_CHECK(!CreateBufferHandler(0, 16, FloatLittleEndian));
+	BOOST_CHECK(padded.fields[1].reason == "floats must have 32 or 64 bits");
+	BOOST_CHECK(padded.fields[2].reason == "spans more than 8 bytes");
+	BOOST_CHECK(padded.fields[3].reason == "exceeds the message");
+	BOOST_CHECK(padded.fields[4].reason == "unknown data type");
+	BOOST_CHECK(padded.UndecodableFields().size() == 4);
+	BOOST_CHECK(padded.totalCost == padded.fields[0].cost);
+}
+#pragma endregion
+
+#pragma region Frame Ring Tests
+BOOST_AUTO_TEST_CASE( frameRingFullAndEmpty )
+{
+	BOOST_CHECK_THROW(SpscFrameRing(6, 16), std::invalid_argument);
+	BOOST_CHECK_THROW(MpmcFrameRing(0, 16), std::invalid_argument);
+	SpscFrameRing spsc(4, 12);
+	MpmcFrameRing mpmc(4, 12);
+	FrameSlot slot;
+	BOOST_CHECK(!spsc.TryBeginRead(slot));
+	BOOST_CHECK(!mpmc.TryBeginRead(slot));
+	std::vector<FrameSlot> open(4);
+	for (size_t i=0; i<4; ++i)
+	{
+		BOOST_REQUIRE(spsc.TryBeginWrite(slot));
+		BOOST_CHECK(reinterpret_cast<size_t>(slot.data) % 64 == 0);
+		slot.data[0] = static_cast<unsigned char>(i);
+		slot.size = i + 1;
+		spsc.CommitWrite(slot);
+		BOOST_REQUIRE(mpmc.TryBeginWrite(open[i])); //several slots may be open at once
+	}
+	BOOST_CHECK(!spsc.TryBeginWrite(slot));
+	BOOST_CHECK(!mpmc.TryBeginWrite(slot));
+	BOOST_CHECK(!mpmc.TryBeginRead(slot)); //nothing committed yet
+	for (size_t i=0; i<4; ++i)
+	{
+		open[3-i].data[0] = static_cast<unsigned char>(3-i);
+		open[3-i].size = 4-i;
+		mpmc.CommitWrite(open[3-i]);
+	}
+	for (size_t i=0; i<4; ++i)
+	{
+		BOOST_REQUIRE(spsc.TryBeginRead(slot));
+		BOOST_CHECK(slot.data[0] == i && slot.size == i + 1);
+		spsc.EndRead(slot);
+		BOOST_REQUIRE(mpmc.TryBeginRead(slot));
+		BOOST_CHECK(slot.data[0] == i && slot.size == i + 1);
+		mpmc.EndRead(slot);
+	}
+	BOOST_CHECK(!spsc.TryBeginRead(slot));
+	BOOST_CHECK(!mpmc.TryBeginRead(slot));
+	BOOST_CHECK(spsc.TryBeginWrite(slot));
+	BOOST_CHECK(mpmc.TryBeginWrite(slot));
+}
+
+/**
+Runs producers and decode workers on a ring and checks that every frame is decoded exactly once.
+*/
+template<typename Ring>
+void CheckFrameRing(Ring& ring, size_t producers, size_t workers, bool ordered)
+{
+	const size_t framesPerProducer = 20000;
+	std::vector<FieldDescriptor> fields;
+	fields.push_back(FieldDescriptor(0, 32, UnsignedIntegerLittleEndian)); //frame number
+	fields.push_back(FieldDescriptor(32, 8, UnsignedIntegerLittleEndian)); //producer
+	fields.push_back(FieldDescriptor(45, 19, SignedIntegerBigEndian));
+	const DecodePlan plan(fields);
+	auto number = CreateBufferHandler(0, 32, UnsignedIntegerLittleEndian);
+	auto producer = CreateBufferHandler(32, 8, UnsignedIntegerLittleEndian);
+	auto payload = CreateBufferHandler(45, 19, SignedIntegerBigEndian);
+	std::atomic<bool> stop(false);
+	std::atomic<size_t> decoded(0);
+	std::atomic<size_t> mismatches(0);
+
+	std::vector<std::thread> threads;
+	for (size_t w=0; w<workers; ++w)
+	{
+		threads.push_back(std::thread([&]()
+		{
+			std::vector<double> values(plan.FieldCount());
+			std::vector<double> last(producers, -1);
+			decoded += DecodeFrames(ring, plan, &values[0], [&](const FrameSlot& frame, const double* v)
+			{
+				const size_t p = static_cast<size_t>(v[1]);
+				if (frame.size != 8 || p >= producers || v[2] != static_cast<double>(static_cast<boost::int64_t>(v[0]) % 1000 - 500) || (ordered && v[0] <= last[p]))
+				{
+					++mismatches;
+				}
+				else
+				{
+					last[p] = v[0];
+				}
+			}, stop);
+		}));
+	}
+	std::vector<std::thread> producerThreads;
+	for (size_t p=0; p<producers; ++p)
+	{
+		producerThreads.push_back(std::thread([&, p]()
+		{
+			for (size_t i=0; i<framesPerProducer; ++i)
+			{
+				FrameSlot slot;
+				while (!ring.TryBeginWrite(slot))
+				{
+					std::this_thread::yield();
+				}
+				number->WriteUI64(i, slot.data, ring.SlotSize());
+				producer->WriteUI64(p, slot.data, ring.SlotSize());
+				payload->WriteI64(static_cast<boost::int64_t>(i % 1000) - 500, slot.data, ring.SlotSize());
+				slot.size = 8;
+				ring.CommitWrite(slot);
+			}
+		}));
+	}
+	for (size_t p=0; p<producerThreads.size(); ++p)
+	{
+		producerThreads[p].join();
+	}
+	stop = true;
+	for (size_t w=0; w<threads.size(); ++w)
+	{
+		threads[w].join();
+	}
+	BOOST_CHECK(decoded == producers * framesPerProducer);
+	BOOST_CHECK(mismatches == 0);
+}
+
+BOOST_AUTO_TEST_CASE( frameRingFeedsDecodeWorkers )
+{
+	SpscFrameRing spsc(64, 8);
+	CheckFrameRing(spsc, 1, 1, true);
+	MpmcFrameRing mpmc(64, 8);
+	CheckFrameRing(mpmc, 2, 3, false);
+}
+#pragma endregion
+
+#pragma region Scaled Handler Tests
+BOOST_AUTO_TEST_CASE( scaledHandlerMatchesRawValues )
+{
+	struct Scaling { unsigned int startbit; unsigned int sizeInBits; DataType type; double factor; double offset; };
+	const Scaling scalings[] = {
+		{ 3, 12, SignedIntegerLittleEndian, 0.5, -10 },
+		{ 16, 16, UnsignedIntegerBigEndian, 0.1, 100 },
+		{ 32, 32, FloatLittleEndian, 2, 1 },
+		{ 64, 60, SignedIntegerLittleEndian, 0.25, 3 } //too wide for the vectorized conversion
+	};
+	const size_t recordSize = 16;
+	const size_t recordCount = 1000; //several blocks of the batch read
+	std::vector<unsigned char> records(recordSize*recordCount);
+	for (size_t s=0; s<4; ++s)
+	{
+		auto raw = CreateBufferHandler(scalings[s].startbit, scalings[s].sizeInBits, scalings[s].type);
+		auto scaled = CreateScaledBufferHandler(scalings[s].startbit, scalings[s].sizeInBits, scalings[s].type, scalings[s].factor, scalings[s].offset);
+		for (size_t i=0; i<recordCount; ++i)
+		{
+			const boost::int64_t value = static_cast<boost::int64_t>(i*7919 % 4000) - (scalings[s].type == UnsignedIntegerBigEndian ? 0 : 2000);
+			raw->WriteI64(value * (s == 3 ? 1000000000LL : 1), &records[i*recordSize], recordSize);
+		}
+		std::vector<double> batch(recordCount);
+		std::vector<float> floats(recordCount);
+		scaled->ReadDBatch(&records[0], recordSize, recordCount, &batch[0]);
+		scaled->ReadFBatch(&records[0], recordSize, recordCount, &floats[0]);
+		FieldAggregate expected;
+		for (size_t i=0; i<recordCount; ++i)
+		{
+			const unsigned char* record = &records[i*recordSize];
+			const double rawValue = scalings[s].type == UnsignedIntegerBigEndian ? static_cast<double>(raw->ReadUI64(record, recordSize)) : raw->ReadD(record, recordSize);
+			const double physical = scaled->ReadD(record, recordSize);
+			BOOST_CHECK_CLOSE(physical, rawValue*scalings[s].factor + scalings[s].offset, 1e-12);
+			BOOST_CHECK(batch[i] == physical);
+			BOOST_CHECK(floats[i] == static_cast<float>(physical));
+			expected.Add(physical);
+		}
+		const FieldAggregate aggregate = scaled->Aggregate(&records[0], recordSize, recordCount);
+		BOOST_CHECK(aggregate.count == expected.count && aggregate.min == expected.min && aggregate.max == expected.max);
+		BOOST_CHECK_CLOSE(aggregate.sum, expected.sum, 1e-9);
+	}
+
+	//writes unscale, round and saturate
+	unsigned char buffer[recordSize] = {};
+	auto raw = CreateBufferHandler(3, 12, SignedIntegerLittleEndian);
+	auto scaled = CreateScaledBufferHandler(3, 12, SignedIntegerLittleEndian, 0.5, -10);
+	scaled->WriteD(-10 + 0.5*3.4, buffer, recordSize);
+	BOOST_CHECK(raw->ReadI64(buffer, recordSize) == 3);
+	scaled->WriteD(-10 - 0.5*3.6, buffer, recordSize);
+	BOOST_CHECK(raw->ReadI64(buffer, recordSize) == -4);
+	scaled->WriteD(1e9, buffer, recordSize);
+	BOOST_CHECK(raw->ReadI64(buffer, recordSize) == 2047);
+	scaled->WriteD(-1e9, buffer, recordSize);
+	BOOST_CHECK(raw->ReadI64(buffer, recordSize) == -2048);
+	scaled->WriteI32(90, buffer, recordSize);
+	BOOST_CHECK(raw->ReadI64(buffer, recordSize) == 200);
+	BOOST_CHECK(scaled->ReadI32(buffer, recordSize) == 90);
+	auto unsignedScaled = CreateScaledBufferHandler(16, 16, UnsignedIntegerBigEndian, 0.1, 100);
+	unsignedScaled->WriteD(-5, buffer, recordSize);
+	BOOST_CHECK(unsignedScaled->ReadD(buffer, recordSize) == 100);
+	unsignedScaled->WriteD(std::numeric_limits<double>::quiet_NaN(), buffer, recordSize);
+	BOOST_CHECK(unsignedScaled->ReadD(buffer, recordSize) == 100);
+	unsignedScaled->WriteD(1e12, buffer, recordSize);
+	BOOST_CHECK(CreateBufferHandler(16, 16, UnsignedIntegerBigEndian)->ReadUI64(buffer, recordSize) == 0xFFFF);
+	BOOST_CHECK_THROW(CreateScaledBufferHandler(0, 8, SignedIntegerLittleEndian, 0, 1), std::invalid_argument);
+}
+#pragma endregion
+
+#pragma region Code Generator Tests
+BOOST_AUTO_TEST_CASE( codeGeneratorRejectsInvalidNames )
+{
+	std::ostringstream code;
+	GenerateCode(Schema::Parse("BO_ 1 Frame: 2 X\n SG_ Value : 0|16@1+ (1,0) [0|0] \"\" X\n"), "Frames", "FRAMES_H", code);
+	BOOST_CHECK(code.str().find("inline void Decode(const unsigned char* buffer, Frame& message)") != std::string::npos);
+	BOOST_CHECK(code.str().find("inline void Encode(const Frame& message, unsigned char* buffer)") != std::string::npos);
+	std::ostringstream rejected;
+	BOOST_CHECK_THROW(GenerateCode(Schema::Parse("BO_ 1 Frame: 2 X\n SG_ Frame : 0|16@1+ (1,0) [0|0] \"\" X\n"), "Frames", "FRAMES_H", rejected), std::invalid_argument);
+	BOOST_CHECK_THROW(GenerateCode(Schema::Parse("BO_ 1 Frame: 2 X\n SG_ MessageId : 0|16@1+ (1,0) [0|0] \"\" X\n"), "Frames", "FRAMES_H", rejected), std::invalid_argument);
+	BOOST_CHECK_THROW(GenerateCode(Schema(), "1Frames", "FRAMES_H", rejected), std::invalid_argument);
+}
+
+#if defined(BUFFERHANDLER_GENERATED_DECODERS)
+/**
+Compares every signal of a message decoded by the generated code with the value read by the handler.
+*/
+struct GeneratedDecodeCheck
+{
+	const std::vector<boost::shared_ptr<DataHandler>>& handlers;
+	const unsigned char* buffer;
+	size_t bufferSize;
+	size_t index;
+
+	template<typename T>
+	void operator()(T value)
+	{
+		const DataHandler& handler = *handlers[index++];
+		if (std::is_floating_point<T>::value)
+		{
+			const T expected = static_cast<T>(handler.ReadD(buffer, bufferSize));
+			BOOST_CHECK(memcmp(&value, &expected, sizeof(T)) == 0 || (value != value && expected != expected));
+		}
+		else if (std::is_signed<T>::value)
+		{
+			BOOST_CHECK(static_cast<boost::int64_t>(value) == handler.ReadI64(buffer, bufferSize));
+		}
+		else
+		{
+			BOOST_CHECK(static_cast<boost::uint64_t>(value) == handler.ReadUI64(buffer, bufferSize));
+		}
+	}
+};
+
+/**
+Writes every signal of a message through its handler.
+*/
+struct HandlerEncode
+{
+	const std::vector<boost::shared_ptr<DataHandler>>& handlers;
+	unsigned char* buffer;
+	size_t bufferSize;
+	size_t index;
+
+	template<typename T>
+	void operator()(T value)
+	{
+		const DataHandler& handler = *handlers[index++];
+		if (std::is_floating_point<T>::value)
+		{
+			handler.WriteD(static_cast<double>(value), buffer, bufferSize);
+		}
+		else if (std::is_signed<T>::value)
+		{
+			handler.WriteI64(static_cast<boost::int64_t>(value), buffer, bufferSize);
+		}
+		else
+		{
+			handler.WriteUI64(static_cast<boost::uint64_t>(value), buffer, bufferSize);
+		}
+	}
+};
+
+template<typename Visitor> void VisitSignals(const TestSchema::Mixed& m, Visitor& v)
+{
+	v(m.Unsigned8); v(m.Signed12); v(m.Flag); v(m.Unsigned3); v(m.Motorola13); v(m.Unsigned3b); v(m.MotorolaSigned19); v(m.Signed5);
+}
+
+template<typename Visitor> void VisitSignals(const TestSchema::Floats& m, Visitor& v)
+{
+	v(m.Float32); v(m.Double64); v(m.Motorola32);
+}
+
+template<typename Visitor> void VisitSignals(const TestSchema::Unaligned& m, Visitor& v)
+{
+	v(m.Motorola10); v(m.Signed5); v(m.Signed1); v(m.Unsigned64);
+}
+
+/**
+Stores 2 in the single bit signals, every value other than 0 must set the bit.
+*/
+void SetFlags(TestSchema::Mixed& m) { m.Flag = 2; }
+void SetFlags(TestSchema::Floats& ) { }
+void SetFlags(TestSchema::Unaligned& m) { m.Signed1 = 2; }
+
+/**
+Decodes random buffers with the generated code and the handlers, then encodes the decoded values with both into
+another random buffer and compares the bytes.
+*/
+template<typename Message>
+void CheckGeneratedMessage(const Schema& schema, boost::uint32_t seed)
+{
+	const SchemaMessage* description = schema.FindMessage(Message::MessageId);
+	BOOST_REQUIRE(description != 0 && description->size == Message::MessageSize);
+	HandlerCache cache;
+	const std::vector<boost::shared_ptr<DataHandler>> handlers = Schema::CreateHandlers(*description, cache);
+	std::vector<unsigned char> buffer(Message::MessageSize), generated(Message::MessageSize), expected(Message::MessageSize);
+	for (int round=0; round<500; ++round)
+	{
+		for (size_t i=0; i<buffer.size(); ++i)
+		{
+			seed = seed * 1103515245 + 12345;
+			buffer[i] = static_cast<unsigned char>(seed >> 16);
+			seed = seed * 1103515245 + 12345;
+			generated[i] = expected[i] = static_cast<unsigned char>(seed >> 16);
+		}
+		Message message;
+		TestSchema::Decode(&buffer[0], message);
+		GeneratedDecodeCheck check = { handlers, &buffer[0], buffer.size(), 0 };
+		VisitSignals(message, check);
+		if (round % 2 == 1)
+		{
+			SetFlags(message);
+		}
+
+		TestSchema::Encode(message, &generated[0]);
+		HandlerEncode encode = { handlers, &expected[0], expected.size(), 0 };
+		VisitSignals(message, encode);
+		BOOST_CHECK(generated == expected);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( generatedCodeMatchesHandlers )
+{
+	const Schema schema = Schema::ParseFile(BUFFERHANDLER_TEST_SCHEMA);
+	CheckGeneratedMessage<TestSchema::Mixed>(schema, 1);
+	CheckGeneratedMessage<TestSchema::Floats>(schema, 2);
+	CheckGeneratedMessage<TestSchema::Unaligned>(schema, 3);
+}
+#endif
 #pragma endregion